@@ -0,0 +1,399 @@
+/* Filename: FileCompress.cpp
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This file contains the chunk compression for file transfers. Chunks are
+*				compressed in the LZ4 block format by worker threads that run ahead of
+*				the sender, and chunks that do not shrink are left to go out raw. One pool
+*				of workers serves every file of a transfer.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ReliablePrototypes.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5     // the block always ends in at least this many literals
+#define LZ4_MATCH_LIMIT 12      // no match may start closer than this to the end
+#define LZ4_HASH_BITS 12
+
+// after this many chunks in a row that did not shrink, only every SKIP_SAMPLE'th chunk is tried
+#define SKIP_AFTER 8
+#define SKIP_SAMPLE 16
+
+// Struct for one file's chunks in the pool, guarded by the pool's mutex
+struct CompressJob {
+    CompressPool* pool;
+    Chunk* chunks;
+    int numChunks;
+    int numGroups;
+    int nextGroup;                      // next group a worker takes
+    int busy;                           // groups being compressed right now
+    std::vector<unsigned char> ready;   // per group
+};
+
+// Struct for the workers a transfer shares, they take groups from the files in turn
+struct CompressPool {
+    std::mutex mutex;
+    std::condition_variable wake;       // a file was added, or the pool is stopping
+    std::condition_variable done;       // a group is ready, or a file has no group in the works
+    std::vector<CompressJob*> jobs;     // files with groups not yet taken
+    size_t cursor;
+    bool stop;
+    std::vector<std::thread> workers;
+};
+
+
+static unsigned int read32(const unsigned char* p) {
+    unsigned int value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static unsigned int hash32(unsigned int value) {
+    return (value * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// writes a length that did not fit in its token nibble as a run of 255s and a remainder
+static int writeLength(unsigned char* dst, int length) {
+    int n = 0;
+    while (length >= 255) {
+        dst[n++] = 255;
+        length -= 255;
+    }
+    dst[n++] = (unsigned char)length;
+    return n;
+}
+
+/* Function: static int writeSequence(unsigned char* dst, int capacity, const unsigned char* literals, int literalLength, int offset, int matchLength)
+         * Description: This function writes one LZ4 sequence, a token, the literals and then the
+         *				match (offset 0 means the last sequence, which has no match)
+         * Parameters: unsigned char* dst, int capacity, const unsigned char* literals, int literalLength, int offset, int matchLength
+         * Returns: the bytes written, -1 if it does not fit
+         */
+static int writeSequence(unsigned char* dst, int capacity, const unsigned char* literals, int literalLength, int offset, int matchLength) {
+    if (1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1 > capacity) {
+        return -1;
+    }
+
+    int n = 1;
+    int code = matchLength - LZ4_MIN_MATCH;
+    dst[0] = (unsigned char)((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15) {
+        n += writeLength(dst + n, literalLength - 15);
+    }
+    memcpy(dst + n, literals, literalLength);
+    n += literalLength;
+
+    if (offset == 0) {
+        return n;
+    }
+
+    dst[0] |= (unsigned char)(code < 15 ? code : 15);
+    dst[n++] = (unsigned char)offset;
+    dst[n++] = (unsigned char)(offset >> 8);
+    if (code >= 15) {
+        n += writeLength(dst + n, code - 15);
+    }
+    return n;
+}
+
+/* Function: int lz4Compress(const unsigned char* src, int srcSize, unsigned char* dst, int capacity)
+         * Description: This function compresses a buffer into an LZ4 block with a single pass
+         *				greedy match finder (one hash table slot per 4 byte prefix)
+         * Parameters: const unsigned char* src, int srcSize, unsigned char* dst, int capacity
+         * Returns: the compressed size, 0 if it does not fit in capacity
+         */
+int lz4Compress(const unsigned char* src, int srcSize, unsigned char* dst, int capacity) {
+    int table[1 << LZ4_HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+
+    int ip = 0;
+    int anchor = 0;
+    int out = 0;
+    const int matchEnd = srcSize - LZ4_LAST_LITERALS;
+
+    while (ip < srcSize - LZ4_MATCH_LIMIT) {
+        unsigned int sequence = read32(src + ip);
+        unsigned int h = hash32(sequence);
+        int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > 65535 || read32(src + ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        // extend backwards over literals that also match, then forwards
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            ip--;
+            ref--;
+        }
+        int length = LZ4_MIN_MATCH;
+        while (ip + length < matchEnd && src[ref + length] == src[ip + length]) {
+            length++;
+        }
+
+        int n = writeSequence(dst + out, capacity - out, src + anchor, ip - anchor, ip - ref, length);
+        if (n < 0) {
+            return 0;
+        }
+        out += n;
+        ip += length;
+        anchor = ip;
+    }
+
+    int n = writeSequence(dst + out, capacity - out, src + anchor, srcSize - anchor, 0, 0);
+    if (n < 0) {
+        return 0;
+    }
+    return out + n;
+}
+
+// reads a length continued past its token nibble, -1 if it runs off the end
+static int readLength(const unsigned char* src, int srcSize, int* ip, int length) {
+    unsigned char b;
+    do {
+        if (*ip >= srcSize) {
+            return -1;
+        }
+        b = src[(*ip)++];
+        length += b;
+    } while (b == 255 && length < (1 << 24));
+    return length;
+}
+
+/* Function: int lz4Decompress(const unsigned char* src, int srcSize, unsigned char* dst, int capacity)
+         * Description: This function expands an LZ4 block, every length and offset is checked
+         *				since the block came off the network
+         * Parameters: const unsigned char* src, int srcSize, unsigned char* dst, int capacity
+         * Returns: the decompressed size, -1 if the block is malformed or too big
+         */
+int lz4Decompress(const unsigned char* src, int srcSize, unsigned char* dst, int capacity) {
+    int ip = 0;
+    int op = 0;
+
+    while (ip < srcSize) {
+        const unsigned char token = src[ip++];
+
+        int literalLength = token >> 4;
+        if (literalLength == 15 && (literalLength = readLength(src, srcSize, &ip, literalLength)) < 0) {
+            return -1;
+        }
+        if (literalLength > srcSize - ip || literalLength > capacity - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == srcSize) {
+            break;
+        }
+
+        if (srcSize - ip < 2) {
+            return -1;
+        }
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        int matchLength = token & 15;
+        if (matchLength == 15 && (matchLength = readLength(src, srcSize, &ip, matchLength)) < 0) {
+            return -1;
+        }
+        matchLength += LZ4_MIN_MATCH;
+        if (matchLength > capacity - op) {
+            return -1;
+        }
+
+        // byte at a time, the match may overlap what it is copying
+        for (int i = 0; i < matchLength; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op;
+}
+
+/* Function: static void compressWorker(CompressPool* pool)
+         * Description: This function takes groups off the files in turn, each file in order, and
+         *				compresses their chunks, keeping a chunk only when it came out smaller.
+         *				After a run of chunks in a file that would not shrink it only samples the
+         *				data until one does
+         * Parameters: CompressPool* pool
+         * Returns: -
+         */
+static void compressWorker(CompressPool* pool) {
+    const CompressJob* last = NULL;
+    int misses = 0;
+    int skipped = 0;
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    while (true) {
+        pool->wake.wait(lock, [pool] { return pool->stop || !pool->jobs.empty(); });
+        if (pool->stop) {
+            return;
+        }
+
+        // the files take turns, the sender interleaves their groups the same way
+        if (pool->cursor >= pool->jobs.size()) {
+            pool->cursor = 0;
+        }
+        CompressJob* job = pool->jobs[pool->cursor];
+        const int group = job->nextGroup++;
+        job->busy++;
+        if (job->nextGroup >= job->numGroups) {
+            pool->jobs.erase(pool->jobs.begin() + pool->cursor);
+        }
+        else {
+            pool->cursor++;
+        }
+        lock.unlock();
+
+        if (job != last) {
+            last = job;
+            misses = 0;
+            skipped = 0;
+        }
+        int end = (group + 1) * FEC_MAX_DATA;
+        if (end > job->numChunks) {
+            end = job->numChunks;
+        }
+
+        for (int i = group * FEC_MAX_DATA; i < end; i++) {
+            Chunk* chunk = &job->chunks[i];
+            if (misses >= SKIP_AFTER && ++skipped % SKIP_SAMPLE != 0) {
+                continue;
+            }
+
+            unsigned char* packed = (unsigned char*)malloc(chunk->size);
+            int size = packed != NULL ? lz4Compress(chunk->data, (int)chunk->size, packed, (int)chunk->size - 1) : 0;
+            if (size > 0) {
+                chunk->packed = packed;
+                chunk->packedSize = size;
+                misses = 0;
+            }
+            else {
+                free(packed);
+                misses++;
+            }
+        }
+
+        lock.lock();
+        job->ready[group] = 1;
+        job->busy--;
+        pool->done.notify_all();
+    }
+}
+
+/* Function: CompressPool* compressPoolStart()
+         * Description: This function starts the workers a transfer's files share, one less than
+         *				the cores (the network loop keeps one) and no more than four
+         * Parameters: -
+         * Returns: the pool
+         */
+CompressPool* compressPoolStart() {
+    CompressPool* pool = new CompressPool;
+    pool->cursor = 0;
+    pool->stop = false;
+
+    unsigned int threads = std::thread::hardware_concurrency();
+    threads = threads > 1 ? threads - 1 : 1;
+    if (threads > 4) {
+        threads = 4;
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        pool->workers.push_back(std::thread(compressWorker, pool));
+    }
+    return pool;
+}
+
+/* Function: void compressPoolStop(CompressPool* pool)
+         * Description: This function stops the workers and frees the pool, every file in it
+         *				must have been through compressFinish
+         * Parameters: CompressPool* pool
+         * Returns: -
+         */
+void compressPoolStop(CompressPool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->stop = true;
+    }
+    pool->wake.notify_all();
+    for (size_t i = 0; i < pool->workers.size(); i++) {
+        pool->workers[i].join();
+    }
+    delete pool;
+}
+
+/* Function: CompressJob* compressStart(CompressPool* pool, Chunk* chunks, int numChunks)
+         * Description: This function hands a file's chunks to the pool, its groups are taken
+         *				from the front so the workers stay ahead of the sender
+         * Parameters: CompressPool* pool, Chunk* chunks, int numChunks
+         * Returns: the job
+         */
+CompressJob* compressStart(CompressPool* pool, Chunk* chunks, int numChunks) {
+    CompressJob* job = new CompressJob;
+    job->pool = pool;
+    job->chunks = chunks;
+    job->numChunks = numChunks;
+    job->numGroups = (numChunks + FEC_MAX_DATA - 1) / FEC_MAX_DATA;
+    job->nextGroup = 0;
+    job->busy = 0;
+    job->ready.assign(job->numGroups, 0);
+
+    if (job->numGroups > 0) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->jobs.push_back(job);
+        pool->wake.notify_all();
+    }
+    return job;
+}
+
+/* Function: void compressWait(CompressJob* job, int group)
+         * Description: This function blocks until a group has been through the compressor,
+         *				which only happens if the sender catches up with the workers
+         * Parameters: CompressJob* job, int group
+         * Returns: -
+         */
+void compressWait(CompressJob* job, int group) {
+    std::unique_lock<std::mutex> lock(job->pool->mutex);
+    job->pool->done.wait(lock, [job, group] { return job->ready[group] != 0; });
+}
+
+/* Function: void compressFinish(CompressJob* job)
+         * Description: This function takes a file out of the pool, waits for the groups of it
+         *				already being compressed and frees the job. The compressed chunks stay
+         *				with their chunks
+         * Parameters: CompressJob* job
+         * Returns: -
+         */
+void compressFinish(CompressJob* job) {
+    if (job == NULL) {
+        return;
+    }
+    CompressPool* pool = job->pool;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    std::vector<CompressJob*>::iterator itor = std::find(pool->jobs.begin(), pool->jobs.end(), job);
+    if (itor != pool->jobs.end()) {
+        pool->jobs.erase(itor);
+    }
+    pool->done.wait(lock, [job] { return job->busy == 0; });
+    lock.unlock();
+    delete job;
+}
@@ -0,0 +1,354 @@
+/* Filename: FileDelta.cpp
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This file contains the rsync style delta for file transfers. The receiver
+*				lists a weak rolling checksum and a strong hash for each block of its old
+*				copy, the sender rolls the weak checksum over the new file one byte at a
+*				time and answers with the runs of blocks the receiver can copy locally.
+*				The match runs on a worker thread so the network loop never waits on it.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "ReliablePrototypes.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DELTA_SSE2 1
+#endif
+
+// Struct for one block of the receiver's signature
+typedef struct {
+    unsigned int weak;
+    unsigned long long strong;
+    int index;
+} DeltaBlock;
+
+// Struct for a delta being matched on a worker thread
+struct DeltaJob {
+    const Chunk* chunks;
+    int numChunks;
+    int chunkSize;
+    int blockSize;
+    int blocks;
+    std::vector<unsigned char> signature;   // copied, the packet is gone once the job starts
+    std::vector<unsigned char> runs;
+    int count;                  // runs found, -1 if there was no memory
+    std::atomic<bool> ready;
+    std::thread worker;
+};
+
+
+static void put32(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static unsigned int get32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+// the weak checksum as one value, a in the low half and b in the high half
+static unsigned int weakValue(unsigned int a, unsigned int b) {
+    return (a & 0xFFFF) | (b << 16);
+}
+
+// folds the weak checksum to the 16 bit tag the sender checks before searching
+static unsigned int weakTag(unsigned int weak) {
+    return (weak ^ (weak >> 16)) & 0xFFFF;
+}
+
+// FNV-1a, only computed for windows whose weak checksum matched
+static unsigned long long strongHash(const unsigned char* data, int length) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Function: void deltaChecksum(const unsigned char* data, int length, unsigned int* a, unsigned int* b)
+         * Description: This function computes the weak checksum of a block from scratch,
+         *				a is the sum of the bytes and b the sum weighted by distance from the end.
+         *				Sixteen bytes at a time with SSE2 where there is one
+         * Parameters: const unsigned char* data, int length, unsigned int* a, unsigned int* b
+         * Returns: -
+         */
+void deltaChecksum(const unsigned char* data, int length, unsigned int* a, unsigned int* b) {
+    unsigned int sum = 0;
+    unsigned int weighted = 0;
+    int i = 0;
+
+#ifdef DELTA_SSE2
+    // per 16 bytes at p: sum += s, weighted += (length - p) * s - (0 * x0 + 1 * x1 + ... + 15 * x15)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowWeights = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i highWeights = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i offsets = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i sad = _mm_sad_epu8(bytes, zero);
+        unsigned int s = (unsigned int)(_mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4));
+        sum += s;
+        weighted += (unsigned int)(length - i) * s;
+
+        __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), lowWeights);
+        __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), highWeights);
+        offsets = _mm_add_epi32(offsets, _mm_add_epi32(low, high));
+    }
+    offsets = _mm_add_epi32(offsets, _mm_shuffle_epi32(offsets, _MM_SHUFFLE(1, 0, 3, 2)));
+    offsets = _mm_add_epi32(offsets, _mm_shuffle_epi32(offsets, _MM_SHUFFLE(2, 3, 0, 1)));
+    weighted -= (unsigned int)_mm_cvtsi128_si32(offsets);
+#endif
+
+    for (; i < length; i++) {
+        sum += data[i];
+        weighted += (unsigned int)(length - i) * data[i];
+    }
+    *a = sum;
+    *b = weighted;
+}
+
+/* Function: int deltaSignature(FILE* file, int blockSize, int blocks, unsigned char* signature)
+         * Description: This function writes the signature of the first blocks whole blocks of a
+         *				file, a 4 byte weak checksum and an 8 byte strong hash for each
+         * Parameters: FILE* file, int blockSize, int blocks, unsigned char* signature
+         * Returns: the number of blocks written, fewer if the file could not be read
+         */
+int deltaSignature(FILE* file, int blockSize, int blocks, unsigned char* signature) {
+    unsigned char* block = (unsigned char*)malloc(blockSize);
+    if (block == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    fseek(file, 0, SEEK_SET);
+    while (count < blocks && fread(block, 1, blockSize, file) == (size_t)blockSize) {
+        unsigned int a;
+        unsigned int b;
+        deltaChecksum(block, blockSize, &a, &b);
+        unsigned long long strong = strongHash(block, blockSize);
+
+        unsigned char* entry = signature + count * 12;
+        put32(entry, weakValue(a, b));
+        put32(entry + 4, (unsigned int)(strong >> 32));
+        put32(entry + 8, (unsigned int)strong);
+        count++;
+    }
+
+    free(block);
+    return count;
+}
+
+static int compareBlocks(const void* left, const void* right) {
+    const DeltaBlock* l = (const DeltaBlock*)left;
+    const DeltaBlock* r = (const DeltaBlock*)right;
+    if (l->weak != r->weak) {
+        return l->weak < r->weak ? -1 : 1;
+    }
+    return l->index - r->index;
+}
+
+/* Function: static int findBlock(const DeltaBlock* sorted, int blocks, unsigned int weak, const unsigned char* window, int blockSize, int preferred)
+         * Description: This function looks a window up in the sorted signature, the strong hash
+         *				settles weak collisions. The block after the last match is preferred so
+         *				unchanged stretches come out as one run
+         * Parameters: const DeltaBlock* sorted, int blocks, unsigned int weak, const unsigned char* window, int blockSize, int preferred
+         * Returns: the receiver's block index, -1 if there is no match
+         */
+static int findBlock(const DeltaBlock* sorted, int blocks, unsigned int weak, const unsigned char* window, int blockSize, int preferred) {
+    int low = 0;
+    int high = blocks;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (sorted[middle].weak < weak) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    if (low == blocks || sorted[low].weak != weak) {
+        return -1;
+    }
+
+    const unsigned long long strong = strongHash(window, blockSize);
+    int found = -1;
+    for (int i = low; i < blocks && sorted[i].weak == weak; i++) {
+        if (sorted[i].strong != strong) {
+            continue;
+        }
+        if (sorted[i].index == preferred) {
+            return preferred;
+        }
+        if (found < 0) {
+            found = sorted[i].index;
+        }
+    }
+    return found;
+}
+
+/* Function: int deltaMatch(const unsigned char* data, long size, int blockSize, const unsigned char* signature, int blocks, unsigned char* runs, int maxRuns)
+         * Description: This function finds the receiver's blocks in the new file at any offset.
+         *				Each run is the new offset (8 bytes), the first block (4) and the number of
+         *				blocks (4), in order of offset and never overlapping. Past maxRuns the rest
+         *				of the file is left to go as literal chunks
+         * Parameters: const unsigned char* data, long size, int blockSize, const unsigned char* signature, int blocks, unsigned char* runs, int maxRuns
+         * Returns: the number of runs written, -1 if there was no memory
+         */
+int deltaMatch(const unsigned char* data, long size, int blockSize, const unsigned char* signature, int blocks, unsigned char* runs, int maxRuns) {
+    if (blocks <= 0 || blockSize <= 0 || size < blockSize) {
+        return 0;
+    }
+
+    DeltaBlock* sorted = (DeltaBlock*)malloc(blocks * sizeof(DeltaBlock));
+    unsigned char* tags = (unsigned char*)calloc(65536, 1);
+    if (sorted == NULL || tags == NULL) {
+        free(sorted);
+        free(tags);
+        return -1;
+    }
+    for (int i = 0; i < blocks; i++) {
+        const unsigned char* entry = signature + i * 12;
+        sorted[i].weak = get32(entry);
+        sorted[i].strong = ((unsigned long long)get32(entry + 4) << 32) | get32(entry + 8);
+        sorted[i].index = i;
+        tags[weakTag(sorted[i].weak)] = 1;
+    }
+    qsort(sorted, blocks, sizeof(DeltaBlock), compareBlocks);
+
+    int count = 0;
+    long runEnd = -1;
+    int lastBlock = -2;
+    long pos = 0;
+    unsigned int a;
+    unsigned int b;
+    deltaChecksum(data, blockSize, &a, &b);
+
+    while (true) {
+        const unsigned int weak = weakValue(a, b);
+        int match = tags[weakTag(weak)] ? findBlock(sorted, blocks, weak, data + pos, blockSize, lastBlock + 1) : -1;
+
+        if (match >= 0) {
+            if (count > 0 && runEnd == pos && match == lastBlock + 1) {
+                unsigned char* run = runs + (count - 1) * 16;
+                put32(run + 12, get32(run + 12) + 1);
+            }
+            else {
+                if (count == maxRuns) {
+                    break;
+                }
+                unsigned char* run = runs + count * 16;
+                put32(run, (unsigned int)((unsigned long long)pos >> 32));
+                put32(run + 4, (unsigned int)pos);
+                put32(run + 8, (unsigned int)match);
+                put32(run + 12, 1);
+                count++;
+            }
+            runEnd = pos + blockSize;
+            lastBlock = match;
+
+            // a match is never overlapped, start over on the next whole window
+            pos += blockSize;
+            if (pos + blockSize > size) {
+                break;
+            }
+            deltaChecksum(data + pos, blockSize, &a, &b);
+        }
+        else {
+            if (pos + blockSize >= size) {
+                break;
+            }
+            const unsigned int out = data[pos];
+            const unsigned int in = data[pos + blockSize];
+            a += in - out;
+            b += a - (unsigned int)blockSize * out;
+            pos++;
+        }
+    }
+
+    free(sorted);
+    free(tags);
+    return count;
+}
+
+/* Function: static void deltaWorker(DeltaJob* job)
+         * Description: This function puts the file back in one piece, the rolling checksum
+         *				wants it that way, and matches the signature against it
+         * Parameters: DeltaJob* job
+         * Returns: -
+         */
+static void deltaWorker(DeltaJob* job) {
+    long size = 0;
+    for (int i = 0; i < job->numChunks; i++) {
+        size += (long)job->chunks[i].size;
+    }
+    unsigned char* data = (unsigned char*)malloc(size > 0 ? size : 1);
+    job->count = -1;
+    if (data != NULL) {
+        for (int i = 0; i < job->numChunks; i++) {
+            memcpy(data + (long)i * job->chunkSize, job->chunks[i].data, job->chunks[i].size);
+        }
+        job->count = deltaMatch(data, size, job->blockSize, job->signature.data(), job->blocks, job->runs.data(), FILE_SIGNATURE_BLOCKS);
+        free(data);
+    }
+    job->ready.store(true, std::memory_order_release);
+}
+
+/* Function: DeltaJob* deltaStart(const Chunk* chunks, int numChunks, int chunkSize, int blockSize, const unsigned char* signature, int blocks)
+         * Description: This function starts matching a signature against a file's chunks on a
+         *				worker thread, the chunks must stay loaded until deltaFinish
+         * Parameters: const Chunk* chunks, int numChunks, int chunkSize, int blockSize, const unsigned char* signature, int blocks
+         * Returns: the job
+         */
+DeltaJob* deltaStart(const Chunk* chunks, int numChunks, int chunkSize, int blockSize, const unsigned char* signature, int blocks) {
+    DeltaJob* job = new DeltaJob;
+    job->chunks = chunks;
+    job->numChunks = numChunks;
+    job->chunkSize = chunkSize;
+    job->blockSize = blockSize;
+    job->blocks = blocks;
+    job->signature.assign(signature, signature + blocks * 12);
+    job->runs.resize(16 * FILE_SIGNATURE_BLOCKS);
+    job->count = 0;
+    job->ready.store(false);
+    job->worker = std::thread(deltaWorker, job);
+    return job;
+}
+
+/* Function: int deltaReady(const DeltaJob* job)
+         * Description: This function checks, without waiting, if the match is done
+         * Parameters: const DeltaJob* job
+         * Returns: 1 if done, 0 if not
+         */
+int deltaReady(const DeltaJob* job) {
+    return job != NULL && job->ready.load(std::memory_order_acquire) ? 1 : 0;
+}
+
+/* Function: int deltaFinish(DeltaJob* job, unsigned char* runs)
+         * Description: This function waits for the worker, copies the runs out and frees the
+         *				job. runs may be NULL to throw the result away
+         * Parameters: DeltaJob* job, unsigned char* runs
+         * Returns: the number of runs, -1 if there was no memory
+         */
+int deltaFinish(DeltaJob* job, unsigned char* runs) {
+    if (job == NULL) {
+        return -1;
+    }
+    job->worker.join();
+    const int count = job->count;
+    if (runs != NULL && count > 0) {
+        memcpy(runs, job->runs.data(), count * 16);
+    }
+    delete job;
+    return count;
+}
@@ -0,0 +1,340 @@
+/* Filename: FileFEC.cpp
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This file contains the forward error correction for file transfers.
+*				Chunks are sent in groups of k data chunks followed by m parity chunks
+*				built with a systematic Reed-Solomon code over GF(2^8) (Cauchy matrix),
+*				so any k of the k + m chunks in a group rebuild the group.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ReliablePrototypes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FEC_X86 1
+#define FEC_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define FEC_X86 1
+#define FEC_TARGET(isa)
+#endif
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D)
+static unsigned char gfExp[512];
+static unsigned char gfLog[256];
+static int gfLevel = -1;   // -1 not initialized, 0 scalar, 1 ssse3, 2 avx2
+
+
+/* Function: static unsigned char gfMul(unsigned char a, unsigned char b)
+         * Description: This function multiplies two field elements with the log tables
+         * Parameters: unsigned char a, unsigned char b
+         * Returns: the product
+         */
+static unsigned char gfMul(unsigned char a, unsigned char b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gfExp[gfLog[a] + gfLog[b]];
+}
+
+/* Function: static unsigned char gfInv(unsigned char a)
+         * Description: This function finds the multiplicative inverse of a non zero element
+         * Parameters: unsigned char a
+         * Returns: the inverse
+         */
+static unsigned char gfInv(unsigned char a) {
+    return gfExp[255 - gfLog[a]];
+}
+
+/* Function: static unsigned char fecCoefficient(int parityIndex, int dataIndex, int k)
+         * Description: This function gives the Cauchy matrix entry 1 / (x ^ y) for a parity row
+         *				and data column, x = k + parityIndex and y = dataIndex never collide so
+         *				every square sub matrix is invertible
+         * Parameters: int parityIndex, int dataIndex, int k
+         * Returns: the coefficient
+         */
+static unsigned char fecCoefficient(int parityIndex, int dataIndex, int k) {
+    return gfInv((unsigned char)((k + parityIndex) ^ dataIndex));
+}
+
+#ifdef FEC_X86
+
+/* Function: static void gfMulAddSsse3(unsigned char* dst, const unsigned char* src, const unsigned char* lo, const unsigned char* hi, int size)
+         * Description: This function does dst ^= c * src 16 bytes at a time, pshufb looks up
+         *				the products of the low and high nibbles of each byte
+         * Parameters: unsigned char* dst, const unsigned char* src, nibble tables lo and hi, int size
+         * Returns: the number of bytes done
+         */
+FEC_TARGET("ssse3")
+static int gfMulAddSsse3(unsigned char* dst, const unsigned char* src, const unsigned char* lo, const unsigned char* hi, int size) {
+    const __m128i tableLo = _mm_loadu_si128((const __m128i*)lo);
+    const __m128i tableHi = _mm_loadu_si128((const __m128i*)hi);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i l = _mm_shuffle_epi8(tableLo, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(tableHi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+    }
+    return i;
+}
+
+/* Function: static int gfMulAddAvx2(unsigned char* dst, const unsigned char* src, const unsigned char* lo, const unsigned char* hi, int size)
+         * Description: This function is the 32 byte wide version of gfMulAddSsse3, vpshufb works
+         *				per 128 bit lane so the nibble tables are broadcast to both lanes
+         * Parameters: unsigned char* dst, const unsigned char* src, nibble tables lo and hi, int size
+         * Returns: the number of bytes done
+         */
+FEC_TARGET("avx2")
+static int gfMulAddAvx2(unsigned char* dst, const unsigned char* src, const unsigned char* lo, const unsigned char* hi, int size) {
+    const __m256i tableLo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)lo));
+    const __m256i tableHi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hi));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i l = _mm256_shuffle_epi8(tableLo, _mm256_and_si256(s, mask));
+        __m256i h = _mm256_shuffle_epi8(tableHi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+    }
+    return i;
+}
+
+/* Function: static int gfDetectLevel()
+         * Description: This function checks which of the SIMD paths the cpu (and os) supports
+         * Parameters: -
+         * Returns: 0 scalar, 1 ssse3, 2 avx2
+         */
+static int gfDetectLevel() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    int ssse3 = (info[2] >> 9) & 1;
+    int osxsave = (info[2] >> 27) & 1;
+    int avx2 = 0;
+    if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] >> 5) & 1;
+    }
+    return avx2 ? 2 : ssse3 ? 1 : 0;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return 2;
+    }
+    return __builtin_cpu_supports("ssse3") ? 1 : 0;
+#endif
+}
+
+#endif
+
+/* Function: static void gfInit()
+         * Description: This function builds the exp / log tables and picks the SIMD path once
+         * Parameters: -
+         * Returns: -
+         */
+static void gfInit() {
+    if (gfLevel >= 0) {
+        return;
+    }
+
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+        gfExp[i] = (unsigned char)x;
+        gfLog[x] = (unsigned char)i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= 0x11D;
+        }
+    }
+    // doubled so gfMul can skip the mod 255
+    for (int i = 255; i < 512; i++) {
+        gfExp[i] = gfExp[i - 255];
+    }
+
+#ifdef FEC_X86
+    gfLevel = gfDetectLevel();
+#else
+    gfLevel = 0;
+#endif
+}
+
+/* Function: static void gfMulAddRegion(unsigned char* dst, const unsigned char* src, unsigned char c, int size)
+         * Description: This function does dst ^= c * src over a whole chunk, using the widest
+         *				SIMD path available and finishing the tail one byte at a time
+         * Parameters: unsigned char* dst, const unsigned char* src, unsigned char c, int size
+         * Returns: -
+         */
+static void gfMulAddRegion(unsigned char* dst, const unsigned char* src, unsigned char c, int size) {
+    if (c == 0) {
+        return;
+    }
+
+    int i = 0;
+    if (c == 1) {
+        for (; i < size; i++) {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+
+#ifdef FEC_X86
+    if (gfLevel > 0) {
+        unsigned char lo[16];
+        unsigned char hi[16];
+        for (int n = 0; n < 16; n++) {
+            lo[n] = gfMul(c, (unsigned char)n);
+            hi[n] = gfMul(c, (unsigned char)(n << 4));
+        }
+        if (gfLevel == 2) {
+            i = gfMulAddAvx2(dst, src, lo, hi, size);
+        }
+        i += gfMulAddSsse3(dst + i, src + i, lo, hi, size - i);
+    }
+#endif
+
+    const unsigned char logC = gfLog[c];
+    for (; i < size; i++) {
+        if (src[i] != 0) {
+            dst[i] ^= gfExp[logC + gfLog[src[i]]];
+        }
+    }
+}
+
+/* Function: void fecEncode(unsigned char** data, int k, unsigned char** parity, int m, int size)
+         * Description: This function builds the m parity chunks for a group of k data chunks,
+         *				every chunk is size bytes (a short last chunk is zero padded by the caller)
+         * Parameters: unsigned char** data, int k, unsigned char** parity, int m, int size
+         * Returns: -
+         */
+void fecEncode(unsigned char** data, int k, unsigned char** parity, int m, int size) {
+    gfInit();
+
+    for (int i = 0; i < m; i++) {
+        memset(parity[i], 0, size);
+        for (int j = 0; j < k; j++) {
+            gfMulAddRegion(parity[i], data[j], fecCoefficient(i, j, k), size);
+        }
+    }
+}
+
+/* Function: int fecDecode(unsigned char** data, const int* present, int k, unsigned char** parity, const int* parityIndex, int parityCount, int size)
+         * Description: This function rebuilds the missing data chunks of a group in place. The
+         *				parity rows that arrived are turned into syndromes by removing the data
+         *				that did arrive, then the small system left over is inverted
+         * Parameters: unsigned char** data (all k buffers, missing ones are overwritten), const int* present,
+         *				int k, unsigned char** parity (clobbered), const int* parityIndex, int parityCount, int size
+         * Returns: the number of chunks rebuilt, -1 if there is not enough parity
+         */
+int fecDecode(unsigned char** data, const int* present, int k, unsigned char** parity, const int* parityIndex, int parityCount, int size) {
+    gfInit();
+
+    int missing[FEC_MAX_DATA];
+    int numMissing = 0;
+    for (int j = 0; j < k; j++) {
+        if (!present[j]) {
+            missing[numMissing++] = j;
+        }
+    }
+
+    if (numMissing == 0) {
+        return 0;
+    }
+    if (numMissing > parityCount || numMissing > FEC_MAX_PARITY) {
+        return -1;
+    }
+
+    // syndromes: parity row minus what the data that did arrive contributed
+    for (int r = 0; r < numMissing; r++) {
+        for (int j = 0; j < k; j++) {
+            if (present[j]) {
+                gfMulAddRegion(parity[r], data[j], fecCoefficient(parityIndex[r], j, k), size);
+            }
+        }
+    }
+
+    // invert the numMissing x numMissing cauchy sub matrix with gauss-jordan
+    unsigned char a[FEC_MAX_PARITY][FEC_MAX_PARITY];
+    unsigned char inv[FEC_MAX_PARITY][FEC_MAX_PARITY];
+    for (int r = 0; r < numMissing; r++) {
+        for (int c = 0; c < numMissing; c++) {
+            a[r][c] = fecCoefficient(parityIndex[r], missing[c], k);
+            inv[r][c] = (unsigned char)(r == c);
+        }
+    }
+
+    for (int col = 0; col < numMissing; col++) {
+        int pivot = col;
+        while (pivot < numMissing && a[pivot][col] == 0) {
+            pivot++;
+        }
+        if (pivot == numMissing) {
+            return -1;   // only if the same parity row was passed twice
+        }
+        if (pivot != col) {
+            for (int c = 0; c < numMissing; c++) {
+                unsigned char t = a[col][c]; a[col][c] = a[pivot][c]; a[pivot][c] = t;
+                t = inv[col][c]; inv[col][c] = inv[pivot][c]; inv[pivot][c] = t;
+            }
+        }
+        unsigned char scale = gfInv(a[col][col]);
+        for (int c = 0; c < numMissing; c++) {
+            a[col][c] = gfMul(a[col][c], scale);
+            inv[col][c] = gfMul(inv[col][c], scale);
+        }
+        for (int r = 0; r < numMissing; r++) {
+            unsigned char factor = a[r][col];
+            if (r == col || factor == 0) {
+                continue;
+            }
+            for (int c = 0; c < numMissing; c++) {
+                a[r][c] ^= gfMul(factor, a[col][c]);
+                inv[r][c] ^= gfMul(factor, inv[col][c]);
+            }
+        }
+    }
+
+    for (int r = 0; r < numMissing; r++) {
+        unsigned char* out = data[missing[r]];
+        memset(out, 0, size);
+        for (int c = 0; c < numMissing; c++) {
+            gfMulAddRegion(out, parity[c], inv[r][c], size);
+        }
+    }
+
+    return numMissing;
+}
+
+/* Function: int fecParityCount(float lossRate, int k)
+         * Description: This function picks how many parity chunks to add to a group of k from
+         *				the loss rate the reliability system is seeing, twice the expected
+         *				losses plus one so a burst above the average is still covered
+         * Parameters: float lossRate (0 to 1), int k
+         * Returns: the parity count, 0 when there is no loss
+         */
+int fecParityCount(float lossRate, int k) {
+    if (lossRate <= 0.001f) {
+        return 0;
+    }
+
+    int m = (int)(lossRate * k * 2.0f + 0.999f) + 1;
+    if (m > k / 2) {
+        m = k / 2 > 0 ? k / 2 : 1;
+    }
+    if (m > FEC_MAX_PARITY) {
+        m = FEC_MAX_PARITY;
+    }
+    return m;
+}
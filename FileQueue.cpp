@@ -0,0 +1,474 @@
+/* Filename: FileQueue.cpp
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This file contains the sending side of a transfer of many files. A directory
+*				is walked into a manifest, reader threads load the files ahead of the sender
+*				and up to FILE_MAX_ACTIVE files are sent at once, their groups interleaved
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// the crt has the mode bits but not the tests, and no symbolic links for lstat to report
+#ifdef _WIN32
+#define lstat stat
+#define S_ISDIR(mode) (((mode) & _S_IFMT) == _S_IFDIR)
+#define S_ISREG(mode) (((mode) & _S_IFMT) == _S_IFREG)
+#endif
+
+#include "ReliablePrototypes.h"
+
+// files loaded but not yet sent, and files being sent, stop growing past these many bytes
+#define PRELOAD_BYTES (64L * 1024 * 1024)
+#define ACTIVE_BYTES (128L * 1024 * 1024)
+
+// manifest entries are sent in batches of about this many bytes
+#define MANIFEST_BATCH 1024
+
+// Struct for one file of the transfer, its id is its index
+struct TransferFile {
+    std::string path;       // where the sender reads it
+    std::string name;       // where the receiver writes it, relative to its output directory
+    long size;
+};
+
+// Struct for the sending side of a transfer
+struct TransferSender {
+    std::vector<TransferFile> files;
+    long long totalBytes;
+    int chunkSize;
+    CompressPool* compressor;   // shared by the files being sent, NULL when compression is off
+
+    // reader threads, everything here is guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::thread> readers;
+    std::vector<FileSender*> loaded;
+    long loadedBytes;
+    int nextLoad;
+    std::atomic<int> failed;    // files the readers could not load, read without the lock
+    bool stop;
+
+    // files being sent, only touched by the network loop
+    FileSender* active[FILE_MAX_ACTIVE];
+    int nextGroup[FILE_MAX_ACTIVE];
+    int activeCount;
+    long activeBytes;
+    int cursor;
+    int manifestSent;       // manifest entries queued on this connection
+    int done;
+
+    // compression totals over the files that are done
+    long rawBytes;
+    long sentBytes;
+    int packedChunks;
+    int chunks;
+};
+
+
+/* Function: static void walk(TransferSender* transfer, const std::string& path, const std::string& name)
+         * Description: This function adds a file, or everything under a directory, to the
+         *				transfer. Entries are sorted so the same tree always gets the same ids.
+         *				Only regular files are sent, and a link to a directory (or a junction
+         *				on windows) is not followed, it could lead back up the tree
+         * Parameters: TransferSender* transfer, const std::string& path, const std::string& name
+         * Returns: -
+         */
+static void walk(TransferSender* transfer, const std::string& path, const std::string& name) {
+    std::vector<std::string> entries;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                entries.push_back(data.cFileName);
+            }
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+#else
+    DIR* dir = opendir(path.c_str());
+    if (dir != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            entries.push_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    std::sort(entries.begin(), entries.end());
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i] == "." || entries[i] == "..") {
+            continue;
+        }
+        std::string childPath = path + "/" + entries[i];
+        std::string childName = name + "/" + entries[i];
+
+        struct stat info;
+        if (lstat(childPath.c_str(), &info) != 0) {
+            continue;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            walk(transfer, childPath, childName);
+            continue;
+        }
+        // a link is sent as the file it points at, never walked into
+        if (!S_ISREG(info.st_mode) && (stat(childPath.c_str(), &info) != 0 || !S_ISREG(info.st_mode))) {
+            continue;
+        }
+        if (childName.size() >= FILE_MAX_PATH || transfer->files.size() >= FILE_MAX_FILES) {
+            printf("Skipped %s, the path is too long or there are too many files\n", childPath.c_str());
+        }
+        else {
+            TransferFile file = { childPath, childName, (long)info.st_size };
+            transfer->files.push_back(file);
+            transfer->totalBytes += info.st_size;
+        }
+    }
+}
+
+/* Function: static void readerThread(TransferSender* transfer)
+         * Description: This function loads files in id order while the preloaded files fit in
+         *				FILE_PRELOAD and PRELOAD_BYTES, so the sender never waits on the disk
+         * Parameters: TransferSender* transfer
+         * Returns: -
+         */
+static void readerThread(TransferSender* transfer) {
+    std::unique_lock<std::mutex> lock(transfer->mutex);
+    while (true) {
+        transfer->wake.wait(lock, [transfer] {
+            return transfer->stop || (transfer->nextLoad < (int)transfer->files.size() &&
+                (int)transfer->loaded.size() < FILE_PRELOAD && (transfer->loadedBytes < PRELOAD_BYTES || transfer->loaded.empty()));
+        });
+        if (transfer->stop) {
+            return;
+        }
+
+        // the bytes are counted before the file is read so the other reader sees them
+        const int id = transfer->nextLoad++;
+        const TransferFile& file = transfer->files[id];
+        transfer->loadedBytes += file.size;
+        lock.unlock();
+
+        FileSender* sender = (FileSender*)malloc(sizeof(FileSender));
+        int ok = sender != NULL && fileSenderStart(sender, file.path.c_str(), file.name.c_str(), id, transfer->chunkSize);
+        if (!ok) {
+            free(sender);
+        }
+
+        lock.lock();
+        if (ok) {
+            transfer->loaded.push_back(sender);
+        }
+        else {
+            transfer->loadedBytes -= file.size;
+            transfer->failed++;
+        }
+    }
+}
+
+/* Function: TransferSender* transferSenderOpen(const char* path, int chunkSize, int compress)
+         * Description: This function lists the file or directory to send and starts the readers.
+         *				A directory keeps its own name at the top of every path it sends
+         * Parameters: const char* path, int chunkSize, int compress
+         * Returns: the transfer, NULL if there is nothing to send
+         */
+TransferSender* transferSenderOpen(const char* path, int chunkSize, int compress) {
+    std::string root = path;
+    while (root.size() > 1 && (root[root.size() - 1] == '/' || root[root.size() - 1] == '\\')) {
+        root.erase(root.size() - 1);
+    }
+    std::string name = root.substr(root.find_last_of("/\\") == std::string::npos ? 0 : root.find_last_of("/\\") + 1);
+
+    struct stat info;
+    if (stat(root.c_str(), &info) != 0 || name.empty() || name == "." || name == "..") {
+        printf("Failed to open %s\n", path);
+        return NULL;
+    }
+
+    TransferSender* transfer = new TransferSender();
+    transfer->chunkSize = chunkSize;
+    if (S_ISDIR(info.st_mode)) {
+        walk(transfer, root, name);
+    }
+    else if (S_ISREG(info.st_mode) && name.size() < FILE_MAX_PATH) {
+        TransferFile file = { root, name, (long)info.st_size };
+        transfer->files.push_back(file);
+        transfer->totalBytes = info.st_size;
+    }
+
+    if (transfer->files.empty()) {
+        printf("No files to send in %s\n", path);
+        delete transfer;
+        return NULL;
+    }
+    printf("Sending %d files, %lld bytes\n", (int)transfer->files.size(), transfer->totalBytes);
+
+    if (compress) {
+        transfer->compressor = compressPoolStart();
+    }
+    for (int i = 0; i < FILE_READERS; i++) {
+        transfer->readers.push_back(std::thread(readerThread, transfer));
+    }
+    return transfer;
+}
+
+/* Function: void transferSenderConnected(TransferSender* transfer)
+         * Description: This function starts the manifest and metadata over on a new connection,
+         *				the channels come up empty so nothing queued before is coming. Chunks
+         *				wait for the receiver's first resume request on the new connection
+         * Parameters: TransferSender* transfer
+         * Returns: -
+         */
+void transferSenderConnected(TransferSender* transfer) {
+    transfer->manifestSent = 0;
+    for (int i = 0; i < transfer->activeCount; i++) {
+        transfer->active[i]->metadataQueued = 0;
+        transfer->active[i]->resumed = 0;
+    }
+}
+
+// moves loaded files into the free active slots while the active files fit in ACTIVE_BYTES, only a
+// file being sent has its chunks compressed
+static void activate(TransferSender* transfer) {
+    std::lock_guard<std::mutex> lock(transfer->mutex);
+    while (!transfer->loaded.empty() && transfer->activeCount < FILE_MAX_ACTIVE &&
+        (transfer->activeBytes < ACTIVE_BYTES || transfer->activeCount == 0)) {
+        FileSender* sender = transfer->loaded.front();
+        transfer->loaded.erase(transfer->loaded.begin());
+
+        const long size = transfer->files[sender->fileId].size;
+        transfer->loadedBytes -= size;
+        transfer->activeBytes += size;
+        transfer->nextGroup[transfer->activeCount] = 0;
+        transfer->active[transfer->activeCount++] = sender;
+        if (transfer->compressor != NULL && sender->numChunks > 0) {
+            sender->compressor = compressStart(transfer->compressor, sender->chunks, sender->numChunks);
+        }
+    }
+    transfer->wake.notify_all();
+}
+
+/* Function: int transferSenderControl(TransferSender* transfer, unsigned char* packet)
+         * Description: This function writes the next message for the reliable channel, the
+         *				manifest in batches, then any delta that is ready and the metadata of each
+         *				file as it becomes active. packet must hold FILE_DELTA_SIZE bytes
+         * Parameters: TransferSender* transfer, unsigned char* packet
+         * Returns: the packet size, 0 if there is nothing to send
+         */
+int transferSenderControl(TransferSender* transfer, unsigned char* packet) {
+    const int fileCount = (int)transfer->files.size();
+    if (transfer->manifestSent < fileCount) {
+        packet[0] = FILE_PACKET_MANIFEST;
+        packet[1] = 0xFF;
+        packet[2] = 0xFF;
+        for (int i = 0; i < 4; i++) {
+            packet[3 + i] = (unsigned char)(fileCount >> (24 - 8 * i));
+        }
+        for (int i = 0; i < 8; i++) {
+            packet[7 + i] = (unsigned char)(transfer->totalBytes >> (56 - 8 * i));
+        }
+
+        int size = 15;
+        while (transfer->manifestSent < fileCount && size < MANIFEST_BATCH) {
+            const int id = transfer->manifestSent++;
+            const TransferFile& file = transfer->files[id];
+            packet[size] = (unsigned char)(id >> 8);
+            packet[size + 1] = (unsigned char)id;
+            for (int i = 0; i < 8; i++) {
+                packet[size + 2 + i] = (unsigned char)((unsigned long long)file.size >> (56 - 8 * i));
+            }
+            packet[size + 10] = (unsigned char)file.name.size();
+            memcpy(packet + size + 11, file.name.c_str(), file.name.size());
+            size += 11 + (int)file.name.size();
+        }
+        return size;
+    }
+
+    activate(transfer);
+    for (int i = 0; i < transfer->activeCount; i++) {
+        int size = fileSenderDeltaPacket(transfer->active[i], packet);
+        if (size > 0) {
+            return size;
+        }
+    }
+    for (int i = 0; i < transfer->activeCount; i++) {
+        if (!transfer->active[i]->metadataQueued) {
+            transfer->active[i]->metadataQueued = 1;
+            return fileSenderMetadata(transfer->active[i], packet);
+        }
+    }
+    return 0;
+}
+
+/* Function: int transferSenderBulk(TransferSender* transfer, int parityCount, unsigned char* packets, int* sizes)
+         * Description: This function builds the next group, taking the active files in turn so
+         *				small files are not stuck behind a big one. A file is only sent once the
+         *				receiver has asked for its chunks, so nothing goes out that a checkpoint
+         *				or a delta already covers
+         * Parameters: TransferSender* transfer, int parityCount, unsigned char* packets, int* sizes
+         * Returns: the number of packets written, 0 if no active file has anything to send
+         */
+int transferSenderBulk(TransferSender* transfer, int parityCount, unsigned char* packets, int* sizes) {
+    for (int i = 0; i < transfer->activeCount; i++) {
+        const int slot = (transfer->cursor + i) % transfer->activeCount;
+        FileSender* sender = transfer->active[slot];
+        if (!sender->metadataQueued || !sender->resumed || sender->complete) {
+            continue;
+        }
+
+        int group = fileSenderNextGroup(sender, transfer->nextGroup[slot]);
+        if (group < 0) {
+            continue;
+        }
+        transfer->nextGroup[slot] = (group + 1) % fileSenderGroupCount(sender);
+        transfer->cursor = slot + 1;
+        return fileSenderBuildGroup(sender, group, parityCount, packets, sizes);
+    }
+    return 0;
+}
+
+/* Function: int transferSenderHeartbeat(const TransferSender* transfer, unsigned char* packet)
+         * Description: This function writes the status packet the sender repeats every tick,
+         *				the receiver ignores it but it keeps the connection from timing out
+         * Parameters: const TransferSender* transfer, unsigned char* packet
+         * Returns: the packet size
+         */
+int transferSenderHeartbeat(const TransferSender* transfer, unsigned char* packet) {
+    packet[0] = FILE_PACKET_STATUS;
+    packet[1] = 0xFF;
+    packet[2] = 0xFF;
+    for (int i = 0; i < 4; i++) {
+        packet[3 + i] = (unsigned char)(transfer->done >> (24 - 8 * i));
+    }
+    packet[7] = (unsigned char)transferSenderDone(transfer);
+    return 8;
+}
+
+/* Function: static void fileDone(TransferSender* transfer, int slot)
+         * Description: This function retires a file the receiver has, its slot goes to the next
+         *				loaded file
+         * Parameters: TransferSender* transfer, int slot
+         * Returns: -
+         */
+static void fileDone(TransferSender* transfer, int slot) {
+    FileSender* sender = transfer->active[slot];
+    printf("receiver has %s\n", transfer->files[sender->fileId].name.c_str());
+
+    // groups a checkpoint, resume or delta let the sender skip were never waited on, the workers may
+    // still be writing their chunks
+    compressFinish(sender->compressor);
+    sender->compressor = NULL;
+    for (int i = 0; i < sender->numChunks; i++) {
+        const Chunk* chunk = &sender->chunks[i];
+        transfer->rawBytes += (long)chunk->size;
+        transfer->sentBytes += (long)(chunk->packed != NULL ? chunk->packedSize : chunk->size);
+        transfer->packedChunks += chunk->packed != NULL;
+    }
+    transfer->chunks += sender->numChunks;
+    transfer->activeBytes -= transfer->files[sender->fileId].size;
+
+    fileSenderClose(sender);
+    free(sender);
+    transfer->activeCount--;
+    transfer->active[slot] = transfer->active[transfer->activeCount];
+    transfer->nextGroup[slot] = transfer->nextGroup[transfer->activeCount];
+    transfer->done++;
+    activate(transfer);
+
+    if (transferSenderDone(transfer)) {
+        printf("all %d files sent, %lld bytes\n", (int)transfer->files.size(), transfer->totalBytes);
+        if (transfer->compressor != NULL) {
+            printf("compression: %ld bytes sent as %ld (%.1f%%), %d of %d chunks compressed\n",
+                transfer->rawBytes, transfer->sentBytes, transfer->rawBytes > 0 ? transfer->sentBytes * 100.0 / transfer->rawBytes : 100.0,
+                transfer->packedChunks, transfer->chunks);
+        }
+    }
+}
+
+/* Function: void transferSenderHandle(TransferSender* transfer, const unsigned char* packet, int size)
+         * Description: This function reads a done, resume or signature message from the
+         *				receiver and passes it to the file it is about
+         * Parameters: TransferSender* transfer, const unsigned char* packet, int size
+         * Returns: -
+         */
+void transferSenderHandle(TransferSender* transfer, const unsigned char* packet, int size) {
+    if (size < 3) {
+        return;
+    }
+    const int fileId = (packet[1] << 8) | packet[2];
+    for (int i = 0; i < transfer->activeCount; i++) {
+        if (transfer->active[i]->fileId != fileId) {
+            continue;
+        }
+        if (packet[0] == FILE_PACKET_DONE) {
+            fileDone(transfer, i);
+        }
+        else if (packet[0] == FILE_PACKET_RESUME) {
+            fileSenderResume(transfer->active[i], packet, size);
+        }
+        else if (packet[0] == FILE_PACKET_SIGNATURE) {
+            fileSenderDelta(transfer->active[i], packet, size);
+        }
+        return;
+    }
+}
+
+/* Function: int transferSenderDone(const TransferSender* transfer)
+         * Description: This function checks if the receiver has every file, files that could
+         *				not be read count as done
+         * Parameters: const TransferSender* transfer
+         * Returns: 1 if done, 0 if not
+         */
+int transferSenderDone(const TransferSender* transfer) {
+    return transfer != NULL && transfer->done + transfer->failed >= (int)transfer->files.size();
+}
+
+/* Function: void transferSenderClose(TransferSender* transfer)
+         * Description: This function stops the readers and frees every file still loaded
+         * Parameters: TransferSender* transfer
+         * Returns: -
+         */
+void transferSenderClose(TransferSender* transfer) {
+    if (transfer == NULL) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(transfer->mutex);
+        transfer->stop = true;
+    }
+    transfer->wake.notify_all();
+    for (size_t i = 0; i < transfer->readers.size(); i++) {
+        transfer->readers[i].join();
+    }
+
+    for (size_t i = 0; i < transfer->loaded.size(); i++) {
+        fileSenderClose(transfer->loaded[i]);
+        free(transfer->loaded[i]);
+    }
+    for (int i = 0; i < transfer->activeCount; i++) {
+        fileSenderClose(transfer->active[i]);
+        free(transfer->active[i]);
+    }
+    compressPoolStop(transfer->compressor);
+    delete transfer;
+}
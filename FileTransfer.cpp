@@ -10,6 +10,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #include "ReliablePrototypes.h"
 
@@ -97,9 +104,1278 @@ Chunk* breakFileIntoChunks(const char* filename, int* numChunks, const int chunk
             return NULL;
         }
         chunks[i].size = fread(chunks[i].data, 1, chunkSize, file);
+        chunks[i].packed = NULL;
+        chunks[i].packedSize = 0;
     }
 
     // Close file
     fclose(file);
     return chunks;
-}
\ No newline at end of file
+}
+
+/* Function: void freeChunks(Chunk* chunks, int numChunks)
+         * Description: This function frees the chunks from breakFileIntoChunks
+         * Parameters: Chunk* chunks, int numChunks
+         * Returns: -
+         */
+void freeChunks(Chunk* chunks, int numChunks) {
+    if (chunks == NULL) {
+        return;
+    }
+    for (int i = 0; i < numChunks; i++) {
+        free(chunks[i].data);
+        free(chunks[i].packed);
+    }
+    free(chunks);
+}
+
+// big endian helpers for the packet headers
+static void writeU16(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)(value >> 8);
+    p[1] = (unsigned char)value;
+}
+
+static unsigned int readU16(const unsigned char* p) {
+    return ((unsigned int)p[0] << 8) | p[1];
+}
+
+static void writeU32(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static unsigned int readU32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static void write64(unsigned char* p, unsigned long long value) {
+    writeU32(p, (unsigned int)(value >> 32));
+    writeU32(p + 4, (unsigned int)value);
+}
+
+static unsigned long long read64(const unsigned char* p) {
+    return ((unsigned long long)readU32(p) << 32) | readU32(p + 4);
+}
+
+// FNV-1a, the file digest carried in the metadata and the checkpoint
+#define DIGEST_BASIS 14695981039346656037ULL
+
+static unsigned long long digestUpdate(unsigned long long hash, const unsigned char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Function: int fileSenderStart(FileSender* sender, const char* path, const char* name, int fileId, int chunkSize)
+         * Description: This function loads the file to send into chunks once, the tail of the
+         *				last chunk is zeroed so parity can always be built over whole chunks.
+         *				name is the path the receiver writes to. The chunks go to the compression
+         *				workers once the file is being sent, see activate in FileQueue.cpp
+         * Parameters: FileSender* sender, const char* path, const char* name, int fileId, int chunkSize
+         * Returns: 1 on success, 0 if the file could not be read
+         */
+int fileSenderStart(FileSender* sender, const char* path, const char* name, int fileId, int chunkSize) {
+    memset(sender, 0, sizeof(*sender));
+    sender->fileId = fileId;
+    sender->chunkSize = chunkSize;
+
+    sender->chunks = breakFileIntoChunks(path, &sender->numChunks, chunkSize);
+    sender->parity = (unsigned char*)malloc(FEC_MAX_PARITY * chunkSize);
+    if ((sender->chunks == NULL && sender->numChunks > 0) || sender->parity == NULL) {
+        printf("Failed to load %s\n", path);
+        fileSenderClose(sender);
+        return 0;
+    }
+
+    const int groups = fileSenderGroupCount(sender);
+    sender->needed = (unsigned char*)malloc(sender->numChunks + 1);
+    sender->groupNeeded = (int*)malloc((groups + 1) * sizeof(int));
+    if (sender->needed == NULL || sender->groupNeeded == NULL) {
+        printf("Failed to allocate memory\n");
+        fileSenderClose(sender);
+        return 0;
+    }
+
+    // everything is needed until the receiver says otherwise
+    long size = 0;
+    sender->digest = DIGEST_BASIS;
+    for (int i = 0; i < sender->numChunks; i++) {
+        size += (long)sender->chunks[i].size;
+        memset(sender->chunks[i].data + sender->chunks[i].size, 0, chunkSize - sender->chunks[i].size);
+        sender->digest = digestUpdate(sender->digest, sender->chunks[i].data, sender->chunks[i].size);
+        sender->needed[i] = 1;
+    }
+    for (int g = 0; g < groups; g++) {
+        sender->groupNeeded[g] = sender->numChunks - g * FEC_MAX_DATA < FEC_MAX_DATA ? sender->numChunks - g * FEC_MAX_DATA : FEC_MAX_DATA;
+    }
+
+    // name:size:digest, the digest is what ties a receiver's checkpoint to this file
+    sender->metadata = (char*)malloc(strlen(name) + 40);
+    if (sender->metadata == NULL) {
+        printf("Failed to allocate memory\n");
+        fileSenderClose(sender);
+        return 0;
+    }
+    sprintf(sender->metadata, "%s:%ld:%016llx", name, size, sender->digest);
+    return 1;
+}
+
+/* Function: int fileSenderGroupCount(const FileSender* sender)
+         * Description: This function counts the fec groups in the file
+         * Parameters: const FileSender* sender
+         * Returns: the number of groups
+         */
+int fileSenderGroupCount(const FileSender* sender) {
+    return (sender->numChunks + FEC_MAX_DATA - 1) / FEC_MAX_DATA;
+}
+
+/* Function: int fileSenderNextGroup(const FileSender* sender, int group)
+         * Description: This function finds the next group, from group on and wrapping around,
+         *				that still has chunks the receiver needs
+         * Parameters: const FileSender* sender, int group
+         * Returns: the group, -1 if nothing is needed
+         */
+int fileSenderNextGroup(const FileSender* sender, int group) {
+    const int groups = fileSenderGroupCount(sender);
+    for (int i = 0; i < groups; i++) {
+        int g = (group + i) % groups;
+        if (sender->groupNeeded[g] > 0) {
+            return g;
+        }
+    }
+    return -1;
+}
+
+/* Function: int fileSenderBuildGroup(FileSender* sender, int group, int parityCount, unsigned char* packets, int* sizes)
+         * Description: This function writes the data packets of a group followed by its parity
+         *				packets, each packet takes FILE_HEADER_SIZE + chunkSize bytes of packets.
+         *				Chunks the receiver already has are left out, parity is still built over
+         *				the whole group but never more of it than there are chunks missing
+         * Parameters: FileSender* sender, int group, int parityCount, unsigned char* packets, int* sizes
+         * Returns: the number of packets written
+         */
+int fileSenderBuildGroup(FileSender* sender, int group, int parityCount, unsigned char* packets, int* sizes) {
+    const int stride = FILE_HEADER_SIZE + sender->chunkSize;
+    const int first = group * FEC_MAX_DATA;
+    int k = sender->numChunks - first;
+    if (k > FEC_MAX_DATA) {
+        k = FEC_MAX_DATA;
+    }
+    if (parityCount > FEC_MAX_PARITY) {
+        parityCount = FEC_MAX_PARITY;
+    }
+    if (k > 0 && parityCount > sender->groupNeeded[group]) {
+        parityCount = sender->groupNeeded[group];
+    }
+
+    if (sender->compressor != NULL && k > 0) {
+        compressWait(sender->compressor, group);
+    }
+
+    int count = 0;
+    unsigned char* data[FEC_MAX_DATA];
+    for (int j = 0; j < k; j++) {
+        const Chunk* chunk = &sender->chunks[first + j];
+        data[j] = chunk->data;
+        if (!sender->needed[first + j]) {
+            continue;
+        }
+
+        unsigned char* packet = packets + count * stride;
+        writeU16(packet + 1, (unsigned int)sender->fileId);
+        writeU32(packet + 3, (unsigned int)(first + j));
+        if (chunk->packed != NULL) {
+            packet[0] = FILE_PACKET_PACKED;
+            memcpy(packet + 7, chunk->packed, chunk->packedSize);
+            sizes[count++] = 7 + (int)chunk->packedSize;
+        }
+        else {
+            packet[0] = FILE_PACKET_DATA;
+            memcpy(packet + 7, chunk->data, chunk->size);
+            sizes[count++] = 7 + (int)chunk->size;
+        }
+    }
+
+    if (parityCount > 0 && k > 0) {
+        unsigned char* parity[FEC_MAX_PARITY];
+        for (int i = 0; i < parityCount; i++) {
+            parity[i] = sender->parity + i * sender->chunkSize;
+        }
+        fecEncode(data, k, parity, parityCount, sender->chunkSize);
+
+        for (int i = 0; i < parityCount; i++) {
+            unsigned char* packet = packets + count * stride;
+            packet[0] = FILE_PACKET_PARITY;
+            writeU16(packet + 1, (unsigned int)sender->fileId);
+            writeU32(packet + 3, (unsigned int)group);
+            packet[7] = (unsigned char)i;
+            packet[8] = (unsigned char)k;
+            memcpy(packet + FILE_HEADER_SIZE, parity[i], sender->chunkSize);
+            sizes[count++] = stride;
+        }
+    }
+
+    return count;
+}
+
+/* Function: int fileSenderMetadata(const FileSender* sender, unsigned char* packet)
+         * Description: This function writes the metadata packet, sent once per connection
+         * Parameters: const FileSender* sender, unsigned char* packet
+         * Returns: the packet size
+         */
+int fileSenderMetadata(const FileSender* sender, unsigned char* packet) {
+    size_t length = strlen(sender->metadata);
+    packet[0] = FILE_PACKET_METADATA;
+    writeU16(packet + 1, (unsigned int)sender->fileId);
+    memcpy(packet + 3, sender->metadata, length);
+    return 3 + (int)length;
+}
+
+/* Function: void fileSenderResume(FileSender* sender, const unsigned char* packet, int size)
+         * Description: This function reads a resume request, from then on only the chunks in
+         *				its missing ranges are sent
+         * Parameters: FileSender* sender, const unsigned char* packet, int size
+         * Returns: -
+         */
+void fileSenderResume(FileSender* sender, const unsigned char* packet, int size) {
+    if (size < 7 || packet[0] != FILE_PACKET_RESUME || sender->needed == NULL) {
+        return;
+    }
+    unsigned int ranges = readU32(packet + 3);
+    if (ranges > (unsigned int)(size - 7) / 8) {
+        return;
+    }
+
+    const int groups = fileSenderGroupCount(sender);
+    sender->resumed = 1;
+    memset(sender->needed, 0, sender->numChunks);
+    memset(sender->groupNeeded, 0, groups * sizeof(int));
+
+    int missing = 0;
+    for (unsigned int r = 0; r < ranges; r++) {
+        unsigned int first = readU32(packet + 7 + r * 8);
+        unsigned int count = readU32(packet + 11 + r * 8);
+        if (first >= (unsigned int)sender->numChunks) {
+            continue;
+        }
+        if (count > (unsigned int)sender->numChunks - first) {
+            count = (unsigned int)sender->numChunks - first;
+        }
+        for (unsigned int i = first; i < first + count; i++) {
+            if (!sender->needed[i]) {
+                sender->needed[i] = 1;
+                sender->groupNeeded[i / FEC_MAX_DATA]++;
+                missing++;
+            }
+        }
+    }
+    if (missing > 0) {
+        printf("receiver is missing %d of %d chunks of file %d in %u ranges\n", missing, sender->numChunks, sender->fileId, ranges);
+    }
+}
+
+/* Function: void fileSenderDelta(FileSender* sender, const unsigned char* packet, int size)
+         * Description: This function starts matching the receiver's signature of its old copy
+         *				against the file on a worker thread, the delta goes out once it is done.
+         *				Only the chunks the delta does not cover are asked for afterwards. A
+         *				signature sent again while the match is running is already answered.
+         *				A signature that can't be matched is answered with an empty delta, the
+         *				receiver is waiting on one before it asks for chunks
+         * Parameters: FileSender* sender, const unsigned char* packet, int size
+         * Returns: -
+         */
+void fileSenderDelta(FileSender* sender, const unsigned char* packet, int size) {
+    if (packet[0] != FILE_PACKET_SIGNATURE || sender->delta != NULL) {
+        return;
+    }
+    const unsigned int blockSize = size >= 11 ? readU32(packet + 3) : 0;
+    const unsigned int blocks = size >= 11 ? readU32(packet + 7) : 0;
+    if (sender->numChunks == 0 || blockSize == 0 || blockSize > (1u << 26) || blocks > FILE_SIGNATURE_BLOCKS ||
+        blocks > (unsigned int)(size - 11) / 12) {
+        sender->deltaEmpty = 1;
+        return;
+    }
+    sender->blockSize = (int)blockSize;
+    sender->delta = deltaStart(sender->chunks, sender->numChunks, sender->chunkSize, (int)blockSize, packet + 11, (int)blocks);
+}
+
+/* Function: int fileSenderDeltaPacket(FileSender* sender, unsigned char* packet)
+         * Description: This function writes the delta message once the worker has finished
+         *				the match, or an empty one (the whole file is sent) if there is no match
+         *				to wait for. packet must hold FILE_DELTA_SIZE bytes
+         * Parameters: FileSender* sender, unsigned char* packet
+         * Returns: the packet size, 0 if no delta is ready
+         */
+int fileSenderDeltaPacket(FileSender* sender, unsigned char* packet) {
+    int runs = 0;
+    if (sender->deltaEmpty) {
+        sender->deltaEmpty = 0;
+    }
+    else if (deltaReady(sender->delta)) {
+        runs = deltaFinish(sender->delta, packet + 7);
+        sender->delta = NULL;
+        if (runs < 0) {
+            printf("Failed to allocate memory\n");
+            runs = 0;
+        }
+    }
+    else {
+        return 0;
+    }
+
+    long fileSize = 0;
+    for (int i = 0; i < sender->numChunks; i++) {
+        fileSize += (long)sender->chunks[i].size;
+    }
+    long matched = 0;
+    for (int r = 0; r < runs; r++) {
+        matched += (long)readU32(packet + 7 + r * 16 + 12) * (long)sender->blockSize;
+    }
+    printf("delta for file %d: %ld of %ld bytes found in the receiver's old copy\n", sender->fileId, matched, fileSize);
+
+    packet[0] = FILE_PACKET_DELTA;
+    writeU16(packet + 1, (unsigned int)sender->fileId);
+    writeU32(packet + 3, (unsigned int)runs);
+    return 7 + runs * 16;
+}
+
+/* Function: void fileSenderClose(FileSender* sender)
+         * Description: This function frees everything the sender loaded
+         * Parameters: FileSender* sender
+         * Returns: -
+         */
+void fileSenderClose(FileSender* sender) {
+    compressFinish(sender->compressor);
+    deltaFinish(sender->delta, NULL);
+    freeChunks(sender->chunks, sender->numChunks);
+    free(sender->metadata);
+    free(sender->parity);
+    free(sender->needed);
+    free(sender->groupNeeded);
+
+    memset(sender, 0, sizeof(*sender));
+}
+
+/* Function: void fileReceiverInit(FileReceiver* receiver, int chunkSize)
+         * Description: This function sets up an idle receiver
+         * Parameters: FileReceiver* receiver, int chunkSize
+         * Returns: -
+         */
+void fileReceiverInit(FileReceiver* receiver, int chunkSize) {
+    memset(receiver, 0, sizeof(*receiver));
+    receiver->chunkSize = chunkSize;
+}
+
+// size of a chunk, only the last one is short
+static int chunkLength(const FileReceiver* receiver, int index) {
+    long remaining = receiver->size - (long)index * receiver->chunkSize;
+    return remaining < receiver->chunkSize ? (int)remaining : receiver->chunkSize;
+}
+
+// chunks in a group, only the last one is short
+static int groupLength(const FileReceiver* receiver, int group) {
+    int k = receiver->numChunks - group * FEC_MAX_DATA;
+    return k < FEC_MAX_DATA ? k : FEC_MAX_DATA;
+}
+
+// the checkpoint kept next to a partial file
+static void checkpointPath(const FileReceiver* receiver, char* path, size_t size) {
+    snprintf(path, size, "./output/%s.part", receiver->name);
+}
+
+// the old copy a delta is built against
+static void basePath(const FileReceiver* receiver, char* path, size_t size) {
+    snprintf(path, size, "./output/%s.base", receiver->name);
+}
+
+/* Function: static void verifyFile(FileReceiver* receiver)
+         * Description: This function reads the finished file back and checks it against the
+         *				digest in the metadata
+         * Parameters: FileReceiver* receiver
+         * Returns: -
+         */
+static void verifyFile(FileReceiver* receiver) {
+    if (receiver->digest == 0) {
+        return;
+    }
+
+    unsigned char buffer[4096];
+    unsigned long long digest = DIGEST_BASIS;
+    size_t bytes;
+    fseek(receiver->file, 0, SEEK_SET);
+    while ((bytes = fread(buffer, 1, sizeof(buffer), receiver->file)) > 0) {
+        digest = digestUpdate(digest, buffer, bytes);
+    }
+
+    if (digest == receiver->digest) {
+        printf("%s matches the sender's digest\n", receiver->name);
+    }
+    else {
+        printf("%s does NOT match the sender's digest (%016llx, expected %016llx)\n", receiver->name, digest, receiver->digest);
+    }
+}
+
+// counts a chunk as received, reporting when the file is whole
+static void chunkReceived(FileReceiver* receiver) {
+    receiver->received++;
+    receiver->dirty = 1;
+    if (receiver->received == receiver->numChunks) {
+        fflush(receiver->file);
+        printf("received %s, %d chunks (%d rebuilt from parity)\n", receiver->name, receiver->numChunks, receiver->recovered);
+        verifyFile(receiver);
+
+        char path[1024];
+        checkpointPath(receiver, path, sizeof(path));
+        remove(path);
+    }
+}
+
+/* Function: void fileReceiverCheckpoint(FileReceiver* receiver)
+         * Description: This function saves which chunks are in so a later run can resume the
+         *				file. The data is flushed first so the bitmap never claims chunks that
+         *				are not on disk, and the checkpoint is swapped in with a rename
+         * Parameters: FileReceiver* receiver
+         * Returns: -
+         */
+void fileReceiverCheckpoint(FileReceiver* receiver) {
+    if (receiver->file == NULL || !receiver->dirty || fileReceiverComplete(receiver)) {
+        return;
+    }
+    fflush(receiver->file);
+
+    // magic, file size, chunk size, digest, then one bit per chunk
+    const int bitmapSize = (receiver->numChunks + 7) / 8;
+    unsigned char* checkpoint = (unsigned char*)calloc(28 + bitmapSize, 1);
+    if (checkpoint == NULL) {
+        return;
+    }
+    memcpy(checkpoint, "RUDPCKP1", 8);
+    write64(checkpoint + 8, (unsigned long long)receiver->size);
+    writeU32(checkpoint + 16, (unsigned int)receiver->chunkSize);
+    write64(checkpoint + 20, receiver->digest);
+    for (int i = 0; i < receiver->numChunks; i++) {
+        if (receiver->have[i]) {
+            checkpoint[28 + i / 8] |= (unsigned char)(1 << (i % 8));
+        }
+    }
+
+    char path[1024];
+    char temp[1040];
+    checkpointPath(receiver, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    FILE* file = fopen(temp, "wb");
+    if (file == NULL) {
+        free(checkpoint);
+        return;
+    }
+    int ok = fwrite(checkpoint, 1, 28 + bitmapSize, file) == (size_t)(28 + bitmapSize);
+    ok = fclose(file) == 0 && ok;
+    free(checkpoint);
+
+    if (ok) {
+        remove(path);
+        if (rename(temp, path) == 0) {
+            receiver->dirty = 0;
+        }
+    }
+}
+
+/* Function: static int loadCheckpoint(FileReceiver* receiver)
+         * Description: This function picks up the chunk bitmap a previous run left for this file,
+         *				it only counts if the size, chunk size and digest all match
+         * Parameters: FileReceiver* receiver
+         * Returns: the number of chunks already on disk, -1 if there is no usable checkpoint
+         */
+static int loadCheckpoint(FileReceiver* receiver) {
+    if (receiver->digest == 0) {
+        return -1;
+    }
+
+    char path[1024];
+    checkpointPath(receiver, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    const int bitmapSize = (receiver->numChunks + 7) / 8;
+    unsigned char header[28];
+    unsigned char* bitmap = (unsigned char*)malloc(bitmapSize + 1);
+    int ok = bitmap != NULL && fread(header, 1, 28, file) == 28 && memcmp(header, "RUDPCKP1", 8) == 0 &&
+        read64(header + 8) == (unsigned long long)receiver->size && readU32(header + 16) == (unsigned int)receiver->chunkSize &&
+        read64(header + 20) == receiver->digest && fread(bitmap, 1, bitmapSize, file) == (size_t)bitmapSize;
+    fclose(file);
+
+    int present = -1;
+    if (ok) {
+        present = 0;
+        for (int i = 0; i < receiver->numChunks; i++) {
+            if (bitmap[i / 8] & (1 << (i % 8))) {
+                receiver->have[i] = 1;
+                receiver->groups[i / FEC_MAX_DATA].dataCount++;
+                present++;
+            }
+        }
+    }
+    free(bitmap);
+    return present;
+}
+
+/* Function: static void recoverGroup(FileReceiver* receiver, int group)
+         * Description: This function rebuilds a group's missing chunks once enough data and
+         *				parity is in, the chunks that did arrive are read back from the file.
+         *				The decode works on a copy of the parity, if it fails the group keeps
+         *				its parity and waits for more
+         * Parameters: FileReceiver* receiver, int group
+         * Returns: -
+         */
+static void recoverGroup(FileReceiver* receiver, int group) {
+    FecGroup* g = &receiver->groups[group];
+    const int k = groupLength(receiver, group);
+    const int chunkSize = receiver->chunkSize;
+
+    if (g->dataCount == k) {
+        free(g->parity);
+        g->parity = NULL;
+        return;
+    }
+
+    int parityIndex[FEC_MAX_PARITY];
+    int parityCount = 0;
+    for (int i = 0; i < FEC_MAX_PARITY; i++) {
+        if (g->parityMask & (1 << i)) {
+            parityIndex[parityCount++] = i;
+        }
+    }
+    if (g->dataCount + parityCount < k) {
+        return;
+    }
+
+    // fecDecode turns the parity into syndromes in place, it gets copies after the data
+    unsigned char* buffer = (unsigned char*)calloc(k + parityCount, chunkSize);
+    if (buffer == NULL) {
+        printf("Failed to allocate memory\n");
+        return;
+    }
+    unsigned char* parity[FEC_MAX_PARITY];
+    for (int i = 0; i < parityCount; i++) {
+        parity[i] = buffer + (k + i) * chunkSize;
+        memcpy(parity[i], g->parity + parityIndex[i] * chunkSize, chunkSize);
+    }
+
+    const int first = group * FEC_MAX_DATA;
+    unsigned char* data[FEC_MAX_DATA];
+    int present[FEC_MAX_DATA] = { 0 };
+    for (int j = 0; j < k; j++) {
+        data[j] = buffer + j * chunkSize;
+        present[j] = receiver->have[first + j];
+        if (present[j]) {
+            fseek(receiver->file, (long)(first + j) * chunkSize, SEEK_SET);
+            if (fread(data[j], 1, chunkLength(receiver, first + j), receiver->file) != (size_t)chunkLength(receiver, first + j)) {
+                printf("Failed to read back chunk %d\n", first + j);
+                free(buffer);
+                return;
+            }
+        }
+    }
+
+    if (fecDecode(data, present, k, parity, parityIndex, parityCount, chunkSize) < 0) {
+        free(buffer);
+        return;
+    }
+    for (int j = 0; j < k; j++) {
+        if (present[j]) {
+            continue;
+        }
+        fseek(receiver->file, (long)(first + j) * chunkSize, SEEK_SET);
+        fwrite(data[j], 1, chunkLength(receiver, first + j), receiver->file);
+        receiver->have[first + j] = 1;
+        receiver->recovered++;
+        chunkReceived(receiver);
+    }
+
+    g->dataCount = k;
+    free(g->parity);
+    g->parity = NULL;
+    free(buffer);
+}
+
+/* Function: static int safePath(char* path)
+         * Description: This function checks a relative path from the sender before anything is
+         *				written under ./output, backslashes become slashes and absolute paths,
+         *				drive letters and .. components are refused
+         * Parameters: char* path
+         * Returns: 1 if the path is safe, 0 if not
+         */
+static int safePath(char* path) {
+    if (path[0] == '\0' || path[0] == '/' || path[0] == '\\' || strchr(path, ':') != NULL) {
+        return 0;
+    }
+    for (char* p = path; *p != '\0'; p++) {
+        if (*p == '\\') {
+            *p = '/';
+        }
+    }
+
+    const char* component = path;
+    while (*component != '\0') {
+        const char* end = strchr(component, '/');
+        size_t length = end != NULL ? (size_t)(end - component) : strlen(component);
+        if (length == 0 || (length == 1 && component[0] == '.') || (length == 2 && component[0] == '.' && component[1] == '.')) {
+            return 0;
+        }
+        component += length + (end != NULL);
+    }
+    return path[strlen(path) - 1] != '/';
+}
+
+// creates the directories under ./output leading up to a file, existing ones are left alone
+static void makeParents(const char* name) {
+    char path[1024];
+    snprintf(path, sizeof(path), "./output/%s", name);
+    for (char* p = path + 9; *p != '\0'; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+#ifdef _WIN32
+        _mkdir(path);
+#else
+        mkdir(path, 0755);
+#endif
+        *p = '/';
+    }
+}
+
+/* Function: static int fileMatches(const char* path, long size, unsigned long long digest)
+         * Description: This function checks if a file already on disk is the one being sent,
+         *				so it is not sent a second time
+         * Parameters: const char* path, long size, unsigned long long digest
+         * Returns: 1 if the size and digest match, 0 if not
+         */
+static int fileMatches(const char* path, long size, unsigned long long digest) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    int match = digest != 0 && ftell(file) == size;
+    fseek(file, 0, SEEK_SET);
+    if (match) {
+        unsigned char buffer[4096];
+        unsigned long long hash = DIGEST_BASIS;
+        size_t bytes;
+        while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            hash = digestUpdate(hash, buffer, bytes);
+        }
+        match = hash == digest;
+    }
+    fclose(file);
+    return match;
+}
+
+/* Function: static void openBase(FileReceiver* receiver, const char* filePath)
+         * Description: This function keeps the old copy of a file that is about to be replaced
+         *				as the base of a delta, the block size is picked so its signature fits in
+         *				FILE_SIGNATURE_BLOCKS. A base left by an earlier connection is used as it is
+         * Parameters: FileReceiver* receiver, const char* filePath
+         * Returns: -
+         */
+static void openBase(FileReceiver* receiver, const char* filePath) {
+    char path[1024];
+    basePath(receiver, path, sizeof(path));
+    receiver->base = fopen(path, "rb");
+    if (receiver->base == NULL && rename(filePath, path) == 0) {
+        receiver->base = fopen(path, "rb");
+    }
+    if (receiver->base == NULL) {
+        return;
+    }
+
+    fseek(receiver->base, 0, SEEK_END);
+    long size = ftell(receiver->base);
+    long perBlock = (size + FILE_SIGNATURE_BLOCKS - 1) / FILE_SIGNATURE_BLOCKS;
+    receiver->blockSize = (int)((perBlock + receiver->chunkSize - 1) / receiver->chunkSize) * receiver->chunkSize;
+    if (receiver->blockSize < receiver->chunkSize) {
+        receiver->blockSize = receiver->chunkSize;
+    }
+    receiver->baseBlocks = (int)(size / receiver->blockSize);
+
+    if (receiver->baseBlocks == 0) {
+        fclose(receiver->base);
+        receiver->base = NULL;
+        remove(path);
+        return;
+    }
+    receiver->signaturePending = 1;
+    receiver->deltaPending = 1;
+}
+
+/* Function: static void applyDelta(FileReceiver* receiver, const unsigned char* packet, int size)
+         * Description: This function copies the runs of the sender's delta out of the old copy
+         *				into the new file. Chunks a run covers completely count as received, the
+         *				rest are left for the resume request that follows
+         * Parameters: FileReceiver* receiver, const unsigned char* packet, int size
+         * Returns: -
+         */
+static void applyDelta(FileReceiver* receiver, const unsigned char* packet, int size) {
+    unsigned int runs = readU32(packet + 3);
+    unsigned char* buffer = (unsigned char*)malloc(receiver->blockSize);
+    if (runs > (unsigned int)(size - 7) / 16 || buffer == NULL) {
+        runs = 0;       // nothing copied, the whole file is asked for
+    }
+
+    const int before = receiver->received;
+    long start = 0;
+    long end = 0;
+    for (unsigned int r = 0; r <= runs; r++) {
+        long offset = 0;
+        long length = 0;
+        if (r < runs) {
+            const unsigned char* run = packet + 7 + r * 16;
+            unsigned long long newOffset = read64(run);
+            unsigned int block = readU32(run + 8);
+            unsigned int count = readU32(run + 12);
+            if (block >= (unsigned int)receiver->baseBlocks || count > (unsigned int)receiver->baseBlocks - block ||
+                newOffset < (unsigned long long)end || newOffset + (unsigned long long)count * receiver->blockSize > (unsigned long long)receiver->size) {
+                continue;
+            }
+            offset = (long)newOffset;
+            length = (long)count * receiver->blockSize;
+
+            for (long done = 0; done < length; done += receiver->blockSize) {
+                fseek(receiver->base, (long)block * receiver->blockSize + done, SEEK_SET);
+                if (fread(buffer, 1, receiver->blockSize, receiver->base) != (size_t)receiver->blockSize) {
+                    length = done;
+                    break;
+                }
+                fseek(receiver->file, offset + done, SEEK_SET);
+                fwrite(buffer, 1, receiver->blockSize, receiver->file);
+            }
+            if (offset == end) {
+                end += length;
+                continue;
+            }
+        }
+
+        // a stretch of runs is over, the chunks inside it are in
+        for (int i = (int)((start + receiver->chunkSize - 1) / receiver->chunkSize); i < receiver->numChunks; i++) {
+            if ((long)i * receiver->chunkSize + chunkLength(receiver, i) > end) {
+                break;
+            }
+            if (!receiver->have[i]) {
+                receiver->have[i] = 1;
+                receiver->groups[i / FEC_MAX_DATA].dataCount++;
+                chunkReceived(receiver);
+            }
+        }
+        start = offset;
+        end = offset + length;
+    }
+    free(buffer);
+
+    char path[1024];
+    basePath(receiver, path, sizeof(path));
+    fclose(receiver->base);
+    receiver->base = NULL;
+    remove(path);
+    receiver->deltaPending = 0;
+    receiver->resumePending = 1;
+    printf("delta: %d of %d chunks of %s copied from the old copy\n", receiver->received - before, receiver->numChunks, receiver->name);
+}
+
+// a whole field of base 10 or 16 digits, no sign, no spaces and nothing after it, 0 if it overflows
+static int parseNumber(const char* text, unsigned int base, unsigned long long* value) {
+    unsigned long long result = 0;
+    if (*text == '\0') {
+        return 0;
+    }
+    for (const char* p = text; *p != '\0'; p++) {
+        unsigned int digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = (unsigned int)(*p - '0');
+        }
+        else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            digit = (unsigned int)(*p - 'a' + 10);
+        }
+        else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            digit = (unsigned int)(*p - 'A' + 10);
+        }
+        else {
+            return 0;
+        }
+        if (result > (~0ULL - digit) / base) {
+            return 0;
+        }
+        result = result * base + digit;
+    }
+    *value = result;
+    return 1;
+}
+
+/* Function: int fileParseMetadata(const unsigned char* packet, int size, char* name, long* fileSize, unsigned long long* digest)
+         * Description: This function reads a metadata packet, name:size:digest after the type
+         *				and file id, or name:size from a sender without digests (digest 0).
+         *				It touches nothing but its arguments, the bytes come from the peer.
+         *				name must hold FILE_MAX_PATH bytes
+         * Parameters: const unsigned char* packet, int size, char* name, long* fileSize, unsigned long long* digest
+         * Returns: 1 if it parsed, 0 if it is malformed, -1 if the path would leave ./output
+         */
+int fileParseMetadata(const unsigned char* packet, int size, char* name, long* fileSize, unsigned long long* digest) {
+    char text[256];
+    if (size < 3 || size - 3 >= (int)sizeof(text) || memchr(packet + 3, '\0', size - 3) != NULL) {
+        return 0;
+    }
+    memcpy(text, packet + 3, size - 3);
+    text[size - 3] = '\0';
+
+    // split from the right since the name may hold anything, the last field is the digest if the
+    // one before it is a size and the size otherwise
+    char* last = strrchr(text, ':');
+    if (last == NULL) {
+        return 0;
+    }
+    *last = '\0';
+    char* sizeField = strrchr(text, ':');
+    unsigned long long length = 0;
+    if (sizeField != NULL && parseNumber(sizeField + 1, 10, &length) && parseNumber(last + 1, 16, digest)) {
+        *sizeField = '\0';
+    }
+    else if (parseNumber(last + 1, 10, &length)) {
+        sizeField = last;
+        *digest = 0;
+    }
+    else {
+        return 0;
+    }
+    if (sizeField - text >= FILE_MAX_PATH || length > (unsigned long long)LONG_MAX) {
+        return 0;
+    }
+    *fileSize = (long)length;
+    strcpy(name, text);
+
+    // the sender's relative path is kept, as long as it stays inside ./output
+    return safePath(name) ? 1 : -1;
+}
+
+/* Function: static void startFile(FileReceiver* receiver, const unsigned char* packet, int size)
+         * Description: This function opens the output file for a metadata packet, repeats of
+         *				the metadata for the file already being received are ignored
+         * Parameters: FileReceiver* receiver, const unsigned char* packet, int size
+         * Returns: -
+         */
+static void startFile(FileReceiver* receiver, const unsigned char* packet, int size) {
+    char file_name[FILE_MAX_PATH];
+    long file_size = 0;
+    unsigned long long digest = 0;
+
+    const int parsed = fileParseMetadata(packet, size, file_name, &file_size, &digest);
+    if (parsed == 0) {
+        printf("Failed to parse metadata of %d bytes\n", size);
+        return;
+    }
+    if (parsed < 0) {
+        printf("Refused file %s, the path is not relative\n", file_name);
+        return;
+    }
+
+    // the chunk count and the group table are ints
+    if (file_size > LONG_MAX - receiver->chunkSize || file_size / receiver->chunkSize > (long)(INT_MAX - FEC_MAX_DATA)) {
+        printf("Refused file %s, %ld bytes is too big\n", file_name, file_size);
+        return;
+    }
+
+    const int fileId = (int)readU16(packet + 1);
+    if (receiver->file != NULL) {
+        if (receiver->fileId == fileId && strcmp(receiver->name, file_name) == 0 && receiver->size == file_size && receiver->digest == digest) {
+            return;
+        }
+        fileReceiverClose(receiver);
+    }
+
+    printf("Received metadata:\n");
+    printf("File name: %s\n", file_name);
+    printf("File size: %ld\n", file_size);
+
+    receiver->fileId = fileId;
+    strcpy(receiver->name, file_name);
+    receiver->size = file_size;
+    receiver->digest = digest;
+    receiver->numChunks = (int)((file_size + receiver->chunkSize - 1) / receiver->chunkSize);
+    receiver->received = 0;
+    receiver->recovered = 0;
+    receiver->have = (unsigned char*)calloc(receiver->numChunks + 1, 1);
+    receiver->groups = (FecGroup*)calloc((receiver->numChunks + FEC_MAX_DATA - 1) / FEC_MAX_DATA + 1, sizeof(FecGroup));
+    if (receiver->have == NULL || receiver->groups == NULL) {
+        printf("Failed to allocate memory\n");
+        fileReceiverClose(receiver);
+        return;
+    }
+
+    // carry on from a checkpoint when there is one for this exact file, a file that is already
+    // there whole is kept as it is, otherwise start clean
+    char filePath[1024];
+    snprintf(filePath, sizeof(filePath), "./output/%s", file_name);
+    makeParents(file_name);
+    int present = loadCheckpoint(receiver);
+    if (present < 0 && receiver->numChunks > 0 && fileMatches(filePath, file_size, digest)) {
+        memset(receiver->have, 1, receiver->numChunks);
+        present = receiver->numChunks;
+        printf("Already have %s\n", file_name);
+    }
+    if (present >= 0) {
+        receiver->file = fopen(filePath, "r+b");
+    }
+    if (receiver->file != NULL) {
+        receiver->received = present;
+        if (present < receiver->numChunks) {
+            printf("Resuming %s, %d of %d chunks already received\n", file_name, present, receiver->numChunks);
+        }
+    }
+    else {
+        memset(receiver->have, 0, receiver->numChunks + 1);
+        memset(receiver->groups, 0, ((receiver->numChunks + FEC_MAX_DATA - 1) / FEC_MAX_DATA + 1) * sizeof(FecGroup));
+        if (receiver->delta && receiver->numChunks > 0) {
+            openBase(receiver, filePath);
+        }
+        receiver->file = fopen(filePath, "w+b");
+    }
+    if (receiver->file == NULL) {
+        printf("Failed to open file %s\n", filePath);
+        fileReceiverClose(receiver);
+        return;
+    }
+    receiver->resumePending = 1;
+
+    if (receiver->numChunks == 0) {
+        printf("received %s, empty file\n", receiver->name);
+    }
+    else if (receiver->received == receiver->numChunks) {
+        // a previous run got everything but stopped before it could clean up
+        receiver->received--;
+        chunkReceived(receiver);
+    }
+}
+
+/* Function: void fileReceiverHandle(FileReceiver* receiver, const unsigned char* packet, int size)
+         * Description: This function handles one metadata, data or parity packet. Data is written
+         *				straight to its offset in the file, parity is held until its group is
+         *				whole or can be rebuilt
+         * Parameters: FileReceiver* receiver, const unsigned char* packet, int size
+         * Returns: -
+         */
+void fileReceiverHandle(FileReceiver* receiver, const unsigned char* packet, int size) {
+    if (size < 1) {
+        return;
+    }
+
+    if (packet[0] == FILE_PACKET_METADATA) {
+        startFile(receiver, packet, size);
+        return;
+    }
+
+    // data sent before the metadata got through is dropped, the sender comes back around to it
+    if (receiver->file == NULL) {
+        return;
+    }
+
+    if (packet[0] == FILE_PACKET_DELTA && size >= 7) {
+        if (receiver->deltaPending) {
+            applyDelta(receiver, packet, size);
+        }
+        return;
+    }
+
+    if ((packet[0] == FILE_PACKET_DATA || packet[0] == FILE_PACKET_PACKED) && size >= 7) {
+        unsigned int index = readU32(packet + 3);
+        if (index >= (unsigned int)receiver->numChunks || receiver->have[index]) {
+            return;
+        }
+        int length = chunkLength(receiver, (int)index);
+        const unsigned char* data = packet + 7;
+
+        // compressed chunks are expanded before they are written
+        unsigned char* expanded = NULL;
+        if (packet[0] == FILE_PACKET_PACKED) {
+            expanded = (unsigned char*)malloc(receiver->chunkSize);
+            if (expanded == NULL || lz4Decompress(packet + 7, size - 7, expanded, receiver->chunkSize) != length) {
+                printf("Dropped chunk %u, it did not decompress\n", index);
+                free(expanded);
+                return;
+            }
+            data = expanded;
+        }
+        else if (size - 7 < length) {
+            return;
+        }
+
+        fseek(receiver->file, (long)index * receiver->chunkSize, SEEK_SET);
+        fwrite(data, 1, length, receiver->file);
+        free(expanded);
+
+        receiver->have[index] = 1;
+        receiver->groups[index / FEC_MAX_DATA].dataCount++;
+        chunkReceived(receiver);
+        recoverGroup(receiver, (int)index / FEC_MAX_DATA);
+    }
+    else if (packet[0] == FILE_PACKET_PARITY && size >= FILE_HEADER_SIZE + receiver->chunkSize) {
+        unsigned int group = readU32(packet + 3);
+        int index = packet[7];
+        if (group >= (unsigned int)((receiver->numChunks + FEC_MAX_DATA - 1) / FEC_MAX_DATA) || index >= FEC_MAX_PARITY ||
+            packet[8] != groupLength(receiver, (int)group)) {
+            return;
+        }
+
+        FecGroup* g = &receiver->groups[group];
+        if (g->dataCount == packet[8] || (g->parityMask & (1 << index))) {
+            return;
+        }
+        if (g->parity == NULL) {
+            g->parity = (unsigned char*)malloc(FEC_MAX_PARITY * receiver->chunkSize);
+            if (g->parity == NULL) {
+                return;
+            }
+        }
+
+        memcpy(g->parity + index * receiver->chunkSize, packet + FILE_HEADER_SIZE, receiver->chunkSize);
+        g->parityMask |= 1 << index;
+        recoverGroup(receiver, (int)group);
+    }
+}
+
+/* Function: int fileReceiverResume(FileReceiver* receiver, unsigned char* packet)
+         * Description: This function writes the resume request, the ranges of chunks still
+         *				missing. packet must hold FILE_RESUME_SIZE bytes, past FILE_RESUME_RANGES
+         *				ranges the last one runs to the end of the file
+         * Parameters: FileReceiver* receiver, unsigned char* packet
+         * Returns: the packet size, 0 if there is no file
+         */
+int fileReceiverResume(FileReceiver* receiver, unsigned char* packet) {
+    if (receiver->file == NULL || receiver->deltaPending) {
+        return 0;
+    }
+    receiver->resumePending = 0;
+
+    int ranges = 0;
+    int i = 0;
+    packet[0] = FILE_PACKET_RESUME;
+    writeU16(packet + 1, (unsigned int)receiver->fileId);
+    while (i < receiver->numChunks && ranges < FILE_RESUME_RANGES) {
+        if (receiver->have[i]) {
+            i++;
+            continue;
+        }
+        int first = i;
+        while (i < receiver->numChunks && !receiver->have[i]) {
+            i++;
+        }
+        if (ranges == FILE_RESUME_RANGES - 1) {
+            i = receiver->numChunks;
+        }
+        writeU32(packet + 7 + ranges * 8, (unsigned int)first);
+        writeU32(packet + 11 + ranges * 8, (unsigned int)(i - first));
+        ranges++;
+    }
+    writeU32(packet + 3, (unsigned int)ranges);
+    return 7 + ranges * 8;
+}
+
+/* Function: int fileReceiverSignature(FileReceiver* receiver, unsigned char* packet)
+         * Description: This function writes the signature of the old copy for the sender to
+         *				build a delta against. packet must hold FILE_SIGNATURE_SIZE bytes
+         * Parameters: FileReceiver* receiver, unsigned char* packet
+         * Returns: the packet size, 0 if there is no old copy
+         */
+int fileReceiverSignature(FileReceiver* receiver, unsigned char* packet) {
+    if (receiver->base == NULL) {
+        return 0;
+    }
+    receiver->signaturePending = 0;
+
+    int blocks = deltaSignature(receiver->base, receiver->blockSize, receiver->baseBlocks, packet + 11);
+    packet[0] = FILE_PACKET_SIGNATURE;
+    writeU16(packet + 1, (unsigned int)receiver->fileId);
+    writeU32(packet + 3, (unsigned int)receiver->blockSize);
+    writeU32(packet + 7, (unsigned int)blocks);
+    return 11 + blocks * 12;
+}
+
+/* Function: int fileReceiverComplete(const FileReceiver* receiver)
+         * Description: This function checks if every chunk of the file is in
+         * Parameters: const FileReceiver* receiver
+         * Returns: 1 if complete, 0 if not
+         */
+int fileReceiverComplete(const FileReceiver* receiver) {
+    return receiver->file != NULL && receiver->received == receiver->numChunks;
+}
+
+/* Function: void fileReceiverClose(FileReceiver* receiver)
+         * Description: This function closes the output file and frees the group buffers
+         * Parameters: FileReceiver* receiver
+         * Returns: -
+         */
+void fileReceiverClose(FileReceiver* receiver) {
+    fileReceiverCheckpoint(receiver);
+    if (receiver->file != NULL) {
+        fclose(receiver->file);
+    }
+    if (receiver->base != NULL) {
+        fclose(receiver->base);
+    }
+    if (receiver->groups != NULL) {
+        int groups = (receiver->numChunks + FEC_MAX_DATA - 1) / FEC_MAX_DATA;
+        for (int i = 0; i < groups; i++) {
+            free(receiver->groups[i].parity);
+        }
+    }
+    free(receiver->groups);
+    free(receiver->have);
+    fileReceiverInit(receiver, receiver->chunkSize);
+}
+
+/* Function: void transferReceiverInit(TransferReceiver* transfer, int chunkSize)
+         * Description: This function sets up a receiver with every file slot idle
+         * Parameters: TransferReceiver* transfer, int chunkSize
+         * Returns: -
+         */
+void transferReceiverInit(TransferReceiver* transfer, int chunkSize) {
+    memset(transfer, 0, sizeof(*transfer));
+    transfer->chunkSize = chunkSize;
+    for (int i = 0; i < FILE_MAX_ACTIVE; i++) {
+        fileReceiverInit(&transfer->files[i], chunkSize);
+    }
+}
+
+/* Function: static void readManifest(TransferReceiver* transfer, const unsigned char* packet, int size)
+         * Description: This function reads one batch of the manifest, the totals are kept and
+         *				the directories for the listed files are made ahead of their data. The
+         *				manifest starts over on every connection, ahead of the metadata, so the
+         *				files still open from before are checkpointed and closed to be picked up
+         *				again from their metadata
+         * Parameters: TransferReceiver* transfer, const unsigned char* packet, int size
+         * Returns: -
+         */
+static void readManifest(TransferReceiver* transfer, const unsigned char* packet, int size) {
+    if (size < 15) {
+        return;
+    }
+    if (size >= 17 && readU16(packet + 15) == 0) {
+        transferReceiverClose(transfer);
+
+        const int files = (int)readU32(packet + 3);
+        const long long bytes = (long long)read64(packet + 7);
+        if (files != transfer->filesExpected || bytes != transfer->bytesExpected) {
+            transfer->filesExpected = files;
+            transfer->bytesExpected = bytes;
+            transfer->filesDone = 0;
+            printf("Receiving %d files, %lld bytes\n", files, bytes);
+        }
+    }
+
+    int offset = 15;
+    while (offset + 11 <= size) {
+        int length = packet[offset + 10];
+        if (offset + 11 + length > size || length >= FILE_MAX_PATH) {
+            return;
+        }
+        char name[FILE_MAX_PATH];
+        memcpy(name, packet + offset + 11, length);
+        name[length] = '\0';
+        if (safePath(name)) {
+            makeParents(name);
+        }
+        offset += 11 + length;
+    }
+}
+
+/* Function: int transferReceiverHandle(TransferReceiver* transfer, const unsigned char* packet, int size)
+         * Description: This function hands a packet to the slot of the file it belongs to, a
+         *				new file's metadata takes a free slot. A file that is complete after the
+         *				packet gives up its slot
+         * Parameters: TransferReceiver* transfer, const unsigned char* packet, int size
+         * Returns: the id of the file the packet completed, -1 if none
+         */
+int transferReceiverHandle(TransferReceiver* transfer, const unsigned char* packet, int size) {
+    if (size < 3) {
+        return -1;
+    }
+    const int fileId = (int)readU16(packet + 1);
+    if (packet[0] == FILE_PACKET_MANIFEST) {
+        readManifest(transfer, packet, size);
+        return -1;
+    }
+
+    FileReceiver* slot = NULL;
+    FileReceiver* idle = NULL;
+    for (int i = 0; i < FILE_MAX_ACTIVE; i++) {
+        if (transfer->files[i].file == NULL) {
+            idle = idle != NULL ? idle : &transfer->files[i];
+        }
+        else if (transfer->files[i].fileId == fileId) {
+            slot = &transfer->files[i];
+        }
+    }
+
+    // data for a file with no slot is from before its metadata or after it completed
+    if (slot == NULL && packet[0] == FILE_PACKET_METADATA) {
+        if (idle == NULL) {
+            printf("No free slot for file %d\n", fileId);
+            return -1;
+        }
+        slot = idle;
+    }
+    if (slot == NULL) {
+        return -1;
+    }
+
+    slot->delta = transfer->delta;
+    fileReceiverHandle(slot, packet, size);
+    if (!fileReceiverComplete(slot)) {
+        return -1;
+    }
+    fileReceiverClose(slot);
+    transfer->filesDone++;
+    return fileId;
+}
+
+/* Function: int transferReceiverStatus(const TransferReceiver* transfer, unsigned char* packet)
+         * Description: This function writes the status packet the receiver sends back, which
+         *				also carries the acks for the reliability system
+         * Parameters: const TransferReceiver* transfer, unsigned char* packet
+         * Returns: the packet size
+         */
+int transferReceiverStatus(const TransferReceiver* transfer, unsigned char* packet) {
+    packet[0] = FILE_PACKET_STATUS;
+    writeU16(packet + 1, FILE_ID_NONE);
+    writeU32(packet + 3, (unsigned int)transfer->filesDone);
+    packet[7] = (unsigned char)(transfer->filesExpected > 0 && transfer->filesDone >= transfer->filesExpected);
+    return 8;
+}
+
+/* Function: void transferReceiverCheckpoint(TransferReceiver* transfer)
+         * Description: This function checkpoints every file in flight
+         * Parameters: TransferReceiver* transfer
+         * Returns: -
+         */
+void transferReceiverCheckpoint(TransferReceiver* transfer) {
+    for (int i = 0; i < FILE_MAX_ACTIVE; i++) {
+        fileReceiverCheckpoint(&transfer->files[i]);
+    }
+}
+
+/* Function: void transferReceiverClose(TransferReceiver* transfer)
+         * Description: This function closes every file in flight, each is checkpointed first so
+         *				the next connection or run picks it up where it stopped
+         * Parameters: TransferReceiver* transfer
+         * Returns: -
+         */
+void transferReceiverClose(TransferReceiver* transfer) {
+    for (int i = 0; i < FILE_MAX_ACTIVE; i++) {
+        fileReceiverClose(&transfer->files[i]);
+    }
+}
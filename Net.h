@@ -26,13 +26,18 @@
 #if PLATFORM == PLATFORM_WINDOWS
 
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #pragma comment( lib, "wsock32.lib" )
 
 #elif PLATFORM == PLATFORM_MAC || PLATFORM == PLATFORM_UNIX
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 
 #else
 
@@ -43,10 +48,27 @@
 #include <assert.h>
 #include <vector>
 #include <map>
+#include <set>
 #include <stack>
 #include <list>
+#include <deque>
 #include <algorithm>
 #include <functional>
+#include <chrono>
+#include <stdint.h>
+#include <time.h>
+
+#include "NetChannels.h"
+#include "NetCrypto.h"
+#include "NetGso.h"
+#include "NetMetrics.h"
+#include "NetTrace.h"
+#include "NetUring.h"
+#include "NetXdp.h"
+
+#ifdef NET_UNIT_TEST
+#include "ReliablePrototypes.h"		// fileParseMetadata, for its fuzz target
+#endif
 
 const int PacketSizeHack = 256 + 128;
 namespace net
@@ -67,7 +89,19 @@ namespace net
 
 #endif
 
+	// monotonic time in microseconds, steady_clock is CLOCK_MONOTONIC on linux and QueryPerformanceCounter on windows
+	//  + frame times, packet send and receive times and round trip samples all come from it
+
+	inline uint64_t GetTime()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 	// internet address
+	//  + IPv4 and IPv6 are held the same way, IPv4 as an IPv4-mapped IPv6 address (::ffff:a.b.c.d)
+	//  + the hash is worked out once when the address is made, so compares and map lookups look at
+	//    one word before they touch the 16 address bytes
 
 	class Address
 	{
@@ -75,45 +109,114 @@ namespace net
 
 		Address()
 		{
-			address = 0;
+			memset(bytes, 0, sizeof(bytes));
+			scope = 0;
 			port = 0;
+			hash = 0;
 		}
 
 		Address(unsigned char a, unsigned char b, unsigned char c, unsigned char d, unsigned short port)
 		{
-			this->address = (a << 24) | (b << 16) | (c << 8) | d;
-			this->port = port;
+			SetIPv4((a << 24) | (b << 16) | (c << 8) | d, port);
 		}
 
 		Address(unsigned int address, unsigned short port)
 		{
-			this->address = address;
+			SetIPv4(address, port);
+		}
+
+		Address(const unsigned char ipv6[16], unsigned short port, unsigned int scope = 0)
+		{
+			memcpy(bytes, ipv6, sizeof(bytes));
+			this->scope = scope;
 			this->port = port;
+			Rehash();
+		}
+
+		// a dotted IPv4 or an IPv6 literal, with an optional %scope (an interface name or number)
+		static bool Parse(const char* text, unsigned short port, Address& address)
+		{
+			char host[64];
+			const char* percent = strchr(text, '%');
+			size_t length = percent != NULL ? (size_t)(percent - text) : strlen(text);
+			if (length == 0 || length >= sizeof(host))
+				return false;
+			memcpy(host, text, length);
+			host[length] = '\0';
+
+			in_addr ipv4;
+			in6_addr ipv6;
+			if (percent == NULL && inet_pton(AF_INET, host, &ipv4) == 1)
+			{
+				address = Address(ntohl(ipv4.s_addr), port);
+				return true;
+			}
+			if (inet_pton(AF_INET6, host, &ipv6) != 1)
+				return false;
+			unsigned int scope = 0;
+			if (percent != NULL)
+			{
+				scope = (unsigned int)strtoul(percent + 1, NULL, 10);
+#if PLATFORM != PLATFORM_WINDOWS
+				if (scope == 0)
+					scope = if_nametoindex(percent + 1);
+#endif
+				if (scope == 0)
+					return false;
+			}
+			address = Address((const unsigned char*)&ipv6, port, scope);
+			return true;
+		}
+
+		bool IsIPv4() const
+		{
+			static const unsigned char prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+			return memcmp(bytes, prefix, sizeof(prefix)) == 0;
 		}
 
+		// false for the unspecified address, an Address nobody has set
+		bool IsValid() const
+		{
+			static const unsigned char zero[16] = { 0 };
+			return memcmp(bytes, zero, sizeof(zero)) != 0 && !(IsIPv4() && GetAddress() == 0);
+		}
+
+		// the IPv4 address, 0 for IPv6
 		unsigned int GetAddress() const
 		{
-			return address;
+			if (!IsIPv4())
+				return 0;
+			return ((unsigned int)bytes[12] << 24) | ((unsigned int)bytes[13] << 16) | ((unsigned int)bytes[14] << 8) | bytes[15];
 		}
 
 		unsigned char GetA() const
 		{
-			return (unsigned char)(address >> 24);
+			return bytes[12];
 		}
 
 		unsigned char GetB() const
 		{
-			return (unsigned char)(address >> 16);
+			return bytes[13];
 		}
 
 		unsigned char GetC() const
 		{
-			return (unsigned char)(address >> 8);
+			return bytes[14];
 		}
 
 		unsigned char GetD() const
 		{
-			return (unsigned char)(address);
+			return bytes[15];
+		}
+
+		const unsigned char* GetIPv6() const
+		{
+			return bytes;
+		}
+
+		unsigned int GetScope() const
+		{
+			return scope;
 		}
 
 		unsigned short GetPort() const
@@ -121,9 +224,63 @@ namespace net
 			return port;
 		}
 
+		unsigned long long GetHash() const
+		{
+			return hash;
+		}
+
+		// a.b.c.d:port or [ipv6%scope]:port
+		const char* ToString(char* buffer, int size) const
+		{
+			char host[INET6_ADDRSTRLEN];
+			if (IsIPv4())
+				snprintf(buffer, size, "%d.%d.%d.%d:%d", GetA(), GetB(), GetC(), GetD(), port);
+			else if (inet_ntop(AF_INET6, (void*)bytes, host, sizeof(host)) == NULL)
+				snprintf(buffer, size, "[?]:%d", port);
+			else if (scope != 0)
+				snprintf(buffer, size, "[%s%%%u]:%d", host, scope, port);
+			else
+				snprintf(buffer, size, "[%s]:%d", host, port);
+			return buffer;
+		}
+
+		// fills a socket address for an IPv6 socket (IPv4 stays mapped) or an IPv4 one, 0 if it cannot be reached from it
+		int ToSockaddr(sockaddr_storage& storage, bool ipv6) const
+		{
+			memset(&storage, 0, sizeof(storage));
+			if (ipv6)
+			{
+				sockaddr_in6& address = (sockaddr_in6&)storage;
+				address.sin6_family = AF_INET6;
+				memcpy(&address.sin6_addr, bytes, sizeof(bytes));
+				address.sin6_port = htons(port);
+				address.sin6_scope_id = scope;
+				return sizeof(sockaddr_in6);
+			}
+			if (!IsIPv4())
+				return 0;
+			sockaddr_in& address = (sockaddr_in&)storage;
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(GetAddress());
+			address.sin_port = htons(port);
+			return sizeof(sockaddr_in);
+		}
+
+		static Address FromSockaddr(const sockaddr_storage& storage)
+		{
+			if (storage.ss_family == AF_INET6)
+			{
+				const sockaddr_in6& address = (const sockaddr_in6&)storage;
+				return Address((const unsigned char*)&address.sin6_addr, ntohs(address.sin6_port), address.sin6_scope_id);
+			}
+			const sockaddr_in& address = (const sockaddr_in&)storage;
+			return Address(ntohl(address.sin_addr.s_addr), ntohs(address.sin_port));
+		}
+
 		bool operator == (const Address& other) const
 		{
-			return address == other.address && port == other.port;
+			return hash == other.hash && port == other.port && scope == other.scope &&
+				memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
 		}
 
 		bool operator != (const Address& other) const
@@ -133,19 +290,63 @@ namespace net
 
 		bool operator < (const Address& other) const
 		{
-			// note: this is so we can use address as a key in std::map
-			if (address < other.address)
-				return true;
-			if (address > other.address)
-				return false;
-			else
+			// note: this is so we can use address as a key in std::map, the order is by hash first
+			if (hash != other.hash)
+				return hash < other.hash;
+			int compare = memcmp(bytes, other.bytes, sizeof(bytes));
+			if (compare != 0)
+				return compare < 0;
+			if (port != other.port)
 				return port < other.port;
+			return scope < other.scope;
 		}
 
 	private:
 
-		unsigned int address;
+		void SetIPv4(unsigned int address, unsigned short port)
+		{
+			memset(bytes, 0, 10);
+			bytes[10] = 0xFF;
+			bytes[11] = 0xFF;
+			bytes[12] = (unsigned char)(address >> 24);
+			bytes[13] = (unsigned char)(address >> 16);
+			bytes[14] = (unsigned char)(address >> 8);
+			bytes[15] = (unsigned char)address;
+			this->scope = 0;
+			this->port = port;
+			Rehash();
+		}
+
+		// the two halves of the address folded with the port and scope, then the murmur3 finalizer
+		void Rehash()
+		{
+			unsigned long long high;
+			unsigned long long low;
+			memcpy(&high, bytes, 8);
+			memcpy(&low, bytes + 8, 8);
+			unsigned long long h = high * 0x9E3779B97F4A7C15ULL ^ low * 0xC2B2AE3D27D4EB4FULL ^
+				(((unsigned long long)scope << 16) | port);
+			h ^= h >> 33;
+			h *= 0xFF51AFD7ED558CCDULL;
+			h ^= h >> 33;
+			h *= 0xC4CEB9FE1A85EC53ULL;
+			h ^= h >> 33;
+			hash = h;
+		}
+
+		unsigned char bytes[16];
+		unsigned int scope;
 		unsigned short port;
+		unsigned long long hash;
+	};
+
+	// for std::unordered_map keyed by address
+	struct AddressHash
+	{
+		size_t operator()(const Address& address) const
+		{
+			return (size_t)address.GetHash();
+		}
 	};
 
 	// sockets
@@ -167,6 +368,14 @@ namespace net
 #endif
 	}
 
+	// socket buffers are sized to the bandwidth-delay product: much bigger and the kernel queue only adds delay
+	// in front of the path (buffer bloat), much smaller and a burst overflows it
+
+	const int MinSocketBuffer = 64 * 1024;			// bytes, floor for a frame's burst of full packets
+	const int MaxSocketBuffer = 4 * 1024 * 1024;	// bytes
+	const double InitialBandwidth = 12500000.0;		// bytes per second (100 Mbit/s) assumed until the path is measured
+	const double InitialDelay = 0.02;				// seconds of round trip assumed until the path is measured
+
 	class Socket
 	{
 	public:
@@ -174,6 +383,9 @@ namespace net
 		Socket()
 		{
 			socket = 0;
+			ipv6 = false;
+			receiveTime = 0;
+			ClearCounts();
 		}
 
 		~Socket()
@@ -185,9 +397,24 @@ namespace net
 		{
 			assert(!IsOpen());
 
-			// create socket
+			// create socket, dual stack IPv6 where the host has it so IPv4 peers arrive as mapped addresses
 
-			socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			ipv6 = true;
+			socket = ::socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+			if (socket > 0)
+			{
+				int only = 0;
+				if (setsockopt(socket, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&only, sizeof(only)) != 0)
+				{
+					Close();
+					socket = 0;
+				}
+			}
+			if (socket <= 0)
+			{
+				ipv6 = false;
+				socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			}
 
 			if (socket <= 0)
 			{
@@ -198,12 +425,12 @@ namespace net
 
 			// bind to port
 
-			sockaddr_in address;
-			address.sin_family = AF_INET;
-			address.sin_addr.s_addr = INADDR_ANY;
-			address.sin_port = htons((unsigned short)port);
+			static const unsigned char any[16] = { 0 };
+			sockaddr_storage address;
+			const Address local = ipv6 ? Address(any, port) : Address((unsigned int)INADDR_ANY, port);
+			int addressLength = local.ToSockaddr(address, ipv6);
 
-			if (::bind(socket, (const sockaddr*)&address, sizeof(sockaddr_in)) < 0)
+			if (::bind(socket, (const sockaddr*)&address, addressLength) < 0)
 			{
 				printf("failed to bind socket\n");
 				Close();
@@ -234,6 +461,54 @@ namespace net
 
 #endif
 
+#ifdef SO_TIMESTAMPNS
+			// the kernel stamps each datagram as it arrives, so time spent waiting in the socket is not counted in rtt
+			int stamps = 1;
+			setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, &stamps, sizeof(stamps));
+#endif
+
+#ifdef SO_RXQ_OVFL
+			// the kernel counts datagrams it dropped on a full receive buffer and hands the count over with
+			// the next datagram, so those drops are not taken for loss on the path
+			int overflow = 1;
+			setsockopt(socket, SOL_SOCKET, SO_RXQ_OVFL, &overflow, sizeof(overflow));
+#endif
+
+			ClearCounts();
+			SetBuffer(SO_RCVBUF, receiveBufferSize, receiveBufferLimit, InitialBandwidth * InitialDelay * 2.0);
+			SetBuffer(SO_SNDBUF, sendBufferSize, sendBufferLimit, InitialBandwidth * InitialDelay * 2.0);
+
+#ifdef NET_URING
+			// io_uring when the kernel has multishot receives, NET_NO_URING=1 in the environment turns it off
+			if (getenv("NET_NO_URING") == NULL && uring.Open(socket))
+				printf("socket using io_uring\n");
+#endif
+
+#ifdef NET_GSO
+			// segmentation offload for sends, GRO only without the ring since its buffers hold one datagram each
+			//  + NET_NO_GSO=1 in the environment turns it off
+#ifdef NET_URING
+			const bool gro = !uring.IsOpen();
+#else
+			const bool gro = true;
+#endif
+			if (getenv("NET_NO_GSO") == NULL && gso.Open(socket, gro))
+				printf("socket using UDP %s%s%s\n", gso.IsSending() ? "GSO" : "", gso.IsSending() && gso.IsReceiving() ? " and " : "", gso.IsReceiving() ? "GRO" : "");
+#endif
+
+#ifdef NET_XDP
+			// kernel bypass for one queue of an interface, NET_XDP=<interface>[:<queue>] in the environment
+			//  + the kernel socket stays bound for other interfaces and for peers whose MAC is not known yet
+			const char* xdpSpec = getenv("NET_XDP");
+			if (xdpSpec != NULL)
+			{
+				if (xdp.Open(port, xdpSpec))
+					printf("socket using AF_XDP on %s\n", xdpSpec);
+				else
+					printf("failed to open AF_XDP on %s\n", xdpSpec);
+			}
+#endif
+
 			return true;
 		}
 
@@ -241,6 +516,15 @@ namespace net
 		{
 			if (socket != 0)
 			{
+#ifdef NET_XDP
+				xdp.Close();
+#endif
+#ifdef NET_GSO
+				gso.Close();
+#endif
+#ifdef NET_URING
+				uring.Close();
+#endif
 #if PLATFORM == PLATFORM_MAC || PLATFORM == PLATFORM_UNIX
 				close(socket);
 #elif PLATFORM == PLATFORM_WINDOWS
@@ -263,19 +547,132 @@ namespace net
 			if (socket == 0)
 				return false;
 
-			assert(destination.GetAddress() != 0);
+			assert(destination.IsValid());
 			assert(destination.GetPort() != 0);
 
-			sockaddr_in address;
-			address.sin_family = AF_INET;
-			address.sin_addr.s_addr = htonl(destination.GetAddress());
-			address.sin_port = htons((unsigned short)destination.GetPort());
+#ifdef NET_XDP
+			// the frames the backend builds are IPv4 only
+			if (xdp.IsOpen() && destination.IsIPv4())
+			{
+				sockaddr_storage frame;
+				destination.ToSockaddr(frame, false);
+				if (xdp.Send((const sockaddr_in&)frame, data, size))
+					return true;
+			}
+#endif
+
+			sockaddr_storage address;
+			int addressLength = destination.ToSockaddr(address, ipv6);
+			if (addressLength == 0)
+				return false;	// IPv6 peer on a host without IPv6
+
+#ifdef NET_GSO
+			if (gso.IsSending())
+			{
+				if (gso.Send(address, addressLength, data, size))
+					return true;
+				sendDrops++;
+				return false;
+			}
+#endif
+
+#ifdef NET_URING
+			if (uring.IsOpen() && uring.Send((sockaddr*)&address, addressLength, data, size))
+				return true;
+#endif
 
-			int sent_bytes = sendto(socket, (const char*)data, size, 0, (sockaddr*)&address, sizeof(sockaddr_in));
+			int sent_bytes = sendto(socket, (const char*)data, size, 0, (sockaddr*)&address, addressLength);
+			GetProcessMetrics().send_syscalls.Add();
+
+			if (sent_bytes < 0 && SendRefused())
+			{
+				// out of buffer space, IsBlocked holds the caller back until the socket drains
+				blocked = true;
+				sendDrops++;
+			}
 
 			return sent_bytes == size;
 		}
 
+		// true while the kernel has no room for sends, the caller keeps its data queued rather than lose it
+		//  + a held segmented batch is offered again first, after a refused send the socket is polled for room
+		bool IsBlocked()
+		{
+			TakeRefused();
+#ifdef NET_GSO
+			if (gso.IsBlocked())
+			{
+				gso.Flush();
+				if (gso.IsBlocked())
+					return true;
+			}
+#endif
+			if (blocked)
+			{
+#if PLATFORM == PLATFORM_WINDOWS
+				WSAPOLLFD entry;
+				entry.fd = socket;
+				entry.events = POLLWRNORM;
+				entry.revents = 0;
+				blocked = WSAPoll(&entry, 1, 0) <= 0;
+#else
+				pollfd entry;
+				entry.fd = socket;
+				entry.events = POLLOUT;
+				entry.revents = 0;
+				blocked = poll(&entry, 1, 0) <= 0;
+#endif
+			}
+			return blocked;
+		}
+
+		// sizes the send buffer to twice the bandwidth-delay product, bytes per second times seconds
+		//  + the kernel is only asked again once the size halves or doubles, it may cap it (wmem_max)
+		//  + the receive buffer is not sized this way, it grows whenever the kernel reports a drop
+		void SizeSendBuffer(double bandwidth, double delay)
+		{
+			const double size = bandwidth * delay * 2.0;
+			if (size * 2.0 > sendBufferSize && size < sendBufferSize * 2.0)
+				return;
+			SetBuffer(SO_SNDBUF, sendBufferSize, sendBufferLimit, size);
+		}
+
+		// datagrams lost at this end since the last call, apart from loss on the path
+		//  + received: dropped by the kernel on a full receive buffer
+		//  + sent: refused by the kernel for lack of buffer space
+		void TakeDrops(uint64_t& received, uint64_t& sent)
+		{
+			TakeRefused();
+			received = receiveDrops;
+			sent = sendDrops;
+			receiveDrops = 0;
+			sendDrops = 0;
+		}
+
+		// submits sends the backend has queued, the plain path sends straight away
+		void Flush()
+		{
+#ifdef NET_XDP
+			xdp.Flush();
+#endif
+#ifdef NET_GSO
+			gso.Flush();
+#endif
+#ifdef NET_URING
+			uring.Flush();
+#endif
+		}
+
+		// size of the datagrams being gathered for one segmented send, 0 if there is no batch open
+		int GetSegmentSize() const
+		{
+#ifdef NET_GSO
+			return gso.GetSegmentSize();
+#else
+			return 0;
+#endif
+		}
+
 		int Receive(Address& sender, void* data, int size)
 		{
 			assert(data);
@@ -284,32 +681,220 @@ namespace net
 			if (socket == 0)
 				return false;
 
-#if PLATFORM == PLATFORM_WINDOWS
-			typedef int socklen_t;
+			sockaddr_storage from;
+			int received_bytes = -1;
+			timespec stamp;
+			stamp.tv_sec = 0;
+			stamp.tv_nsec = 0;
+			uint32_t overflow = kernelDrops;
+
+#ifdef NET_XDP
+			if (xdp.IsOpen() && (received_bytes = xdp.Receive((sockaddr_in&)from, data, size)) == 0)
+				received_bytes = -1;
+#endif
+
+#ifdef NET_GSO
+			if (received_bytes < 0 && gso.IsReceiving())
+				received_bytes = gso.Receive(from, data, size, stamp, overflow);
+#endif
+
+#ifdef NET_URING
+			if (received_bytes < 0 && uring.IsOpen())
+				received_bytes = uring.Receive(from, data, size, stamp, overflow);
 #endif
 
-			sockaddr_in from;
-			socklen_t fromLength = sizeof(from);
+			if (received_bytes < 0)
+			{
+#ifdef SO_TIMESTAMPNS
+				received_bytes = ReceiveStamped(from, data, size, stamp, overflow);
+#else
+#if PLATFORM == PLATFORM_WINDOWS
+				typedef int socklen_t;
+#endif
+				socklen_t fromLength = sizeof(from);
+				received_bytes = recvfrom(socket, (char*)data, size, 0, (sockaddr*)&from, &fromLength);
+#endif
+				GetProcessMetrics().recv_syscalls.Add();
+			}
 
-			int received_bytes = recvfrom(socket, (char*)data, size, 0, (sockaddr*)&from, &fromLength);
+			// the kernel's count only goes up, a backend still holding an older value is ignored
+			if ((int32_t)(overflow - kernelDrops) > 0)
+			{
+				receiveDrops += overflow - kernelDrops;
+				kernelDrops = overflow;
+				SetBuffer(SO_RCVBUF, receiveBufferSize, receiveBufferLimit, receiveBufferSize * 2.0);
+			}
 
 			if (received_bytes <= 0)
 				return 0;
 
-			unsigned int address = ntohl(from.sin_addr.s_addr);
-			unsigned short port = ntohs(from.sin_port);
-
-			sender = Address(address, port);
+			sender = Address::FromSockaddr(from);
+			receiveTime = stamp.tv_sec != 0 || stamp.tv_nsec != 0 ? FromKernelTime(stamp) : GetTime();
 
 			return received_bytes;
 		}
 
+		// when the last packet Receive returned arrived, on the GetTime clock
+		uint64_t GetReceiveTime() const
+		{
+			return receiveTime;
+		}
+
 	private:
 
+		void ClearCounts()
+		{
+			blocked = false;
+			kernelDrops = 0;
+			receiveDrops = 0;
+			sendDrops = 0;
+			receiveBufferSize = 0;
+			sendBufferSize = 0;
+			receiveBufferLimit = MaxSocketBuffer;
+			sendBufferLimit = MaxSocketBuffer;
+		}
+
+		// clamped to [MinSocketBuffer, limit], current is what the kernel actually gave
+		//  + the privileged FORCE options go past rmem_max / wmem_max when the process may use them
+		//  + a size the kernel capped becomes the limit, so a drop or a faster path doesn't ask again
+		void SetBuffer(int option, int& current, int& limit, double size)
+		{
+			int bytes = size < MinSocketBuffer ? MinSocketBuffer : size > MaxSocketBuffer ? MaxSocketBuffer : (int)size;
+			if (bytes > limit)
+				bytes = limit;
+			if (bytes == current)
+				return;
+			bool set = false;
+#if defined(SO_RCVBUFFORCE) && defined(SO_SNDBUFFORCE)
+			const int force = option == SO_RCVBUF ? SO_RCVBUFFORCE : SO_SNDBUFFORCE;
+			set = setsockopt(socket, SOL_SOCKET, force, (const char*)&bytes, sizeof(bytes)) == 0;
+#endif
+			if (!set)
+				setsockopt(socket, SOL_SOCKET, option, (const char*)&bytes, sizeof(bytes));
+
+#if PLATFORM == PLATFORM_WINDOWS
+			typedef int socklen_t;
+#endif
+			int effective = 0;
+			socklen_t length = sizeof(effective);
+			if (getsockopt(socket, SOL_SOCKET, option, (char*)&effective, &length) != 0 || effective <= 0)
+				effective = bytes;
+#ifdef __linux__
+			else
+				effective /= 2;		// linux doubles it for its own bookkeeping and reports the doubled size
+#endif
+			if (effective < bytes)
+				limit = effective;
+			current = effective;
+		}
+
+		// sends the io_uring backend found refused when they completed
+		void TakeRefused()
+		{
+#ifdef NET_URING
+			const unsigned int refused = uring.TakeRefused();
+			if (refused > 0)
+			{
+				sendDrops += refused;
+				blocked = true;
+			}
+#endif
+		}
+
+		// the kernel is out of buffer space, as opposed to a send that can never work
+		static bool SendRefused()
+		{
+#if PLATFORM == PLATFORM_WINDOWS
+			const int error = WSAGetLastError();
+			return error == WSAEWOULDBLOCK || error == WSAENOBUFS;
+#else
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+#endif
+		}
+
+#ifdef SO_TIMESTAMPNS
+		int ReceiveStamped(sockaddr_storage& from, void* data, int size, timespec& stamp, uint32_t& overflow)
+		{
+			iovec vector;
+			vector.iov_base = data;
+			vector.iov_len = size;
+			char control[CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+			msghdr header;
+			memset(&header, 0, sizeof(header));
+			header.msg_name = &from;
+			header.msg_namelen = sizeof(from);
+			header.msg_iov = &vector;
+			header.msg_iovlen = 1;
+			header.msg_control = control;
+			header.msg_controllen = sizeof(control);
+			int bytes = (int)recvmsg(socket, &header, 0);
+			for (cmsghdr* message = bytes > 0 ? CMSG_FIRSTHDR(&header) : NULL; message != NULL; message = CMSG_NXTHDR(&header, message))
+			{
+				if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS)
+					memcpy(&stamp, CMSG_DATA(message), sizeof(stamp));
+#ifdef SO_RXQ_OVFL
+				if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL)
+					memcpy(&overflow, CMSG_DATA(message), sizeof(overflow));
+#endif
+			}
+			return bytes;
+		}
+
+		// kernel stamps are wall clock time, they are moved onto the monotonic clock by their age
+		static uint64_t FromKernelTime(const timespec& stamp)
+		{
+			timespec wall;
+			clock_gettime(CLOCK_REALTIME, &wall);
+			const uint64_t now = GetTime();
+			int64_t age = ((int64_t)wall.tv_sec - stamp.tv_sec) * 1000000 + (wall.tv_nsec - stamp.tv_nsec) / 1000;
+			if (age < 0)
+				age = 0;
+			return (uint64_t)age < now ? now - (uint64_t)age : now;
+		}
+#else
+		static uint64_t FromKernelTime(const timespec& stamp)
+		{
+			return GetTime();
+		}
+#endif
+
 		int socket;
+		bool ipv6;				// dual stack AF_INET6 socket, false if the host only has IPv4
+		uint64_t receiveTime;
+		bool blocked;			// a plain send was refused, cleared once the socket polls writable
+		uint32_t kernelDrops;	// last SO_RXQ_OVFL count the kernel reported
+		uint64_t receiveDrops;	// see TakeDrops
+		uint64_t sendDrops;
+		int receiveBufferSize;	// as the kernel reports it, see SetBuffer
+		int sendBufferSize;
+		int receiveBufferLimit;	// the most the kernel gave when asked for more
+		int sendBufferLimit;
+#ifdef NET_URING
+		UringSocket uring;
+#endif
+#ifdef NET_GSO
+		GsoSocket gso;
+#endif
+#ifdef NET_XDP
+		XdpSocket xdp;
+#endif
 	};
 
 	// connection
+	//  + a client proves it owns its address by echoing a stateless challenge cookie, the server keeps nothing until then
+	//  + the cookie exchange carries x25519 public keys, every packet after it is sealed with chacha20-poly1305
+	//  + once connected the server hands out a session ticket, a client holding one reconnects with 0-RTT data (resume)
+	//  + a resume carries a fresh client random mixed into its keys, and a client uses each ticket once, so no two
+	//    resumes seal under the same key and nonces
+	//  + without a pre-shared key the key exchange is unauthenticated: it stops eavesdroppers, not a man in the middle
+	//  + sealed packets carry a connection id derived from the session, not the address, so a peer whose address changes
+	//    (NAT rebinding, a new network) keeps its session once it answers a path challenge from the new address
+	//  + the challenge moves both ends to the next id in the session's sequence, so past the peer's first packets from
+	//    the new address nothing on the wire links it to the old one
+
+	const float HandshakeResendTime = 0.1f;		// seconds between client handshake packets while connecting
+	const float CookieLifetime = 10.0f;			// seconds a challenge cookie stays valid
+	const float TicketLifetime = 600.0f;		// seconds a session ticket stays valid
 
 	class Connection
 	{
@@ -328,6 +913,18 @@ namespace net
 			this->timeout = timeout;
 			mode = None;
 			running = false;
+			port = 0;
+			state = Disconnected;
+			time = 0.0f;
+			hasTicket = false;
+			usedTicketIndex = 0;
+			memset(usedTickets, 0, sizeof(usedTickets));
+			memset(preSharedKey, 0, sizeof(preSharedKey));
+			random_bytes(secret, sizeof(secret));
+			random_bytes(ticketKey, sizeof(ticketKey));
+			random_bytes(serverPrivate, sizeof(serverPrivate));
+			x25519_public_key(serverPublic, serverPrivate);
+			random_bytes((unsigned char*)&nextSessionId, sizeof(nextSessionId));
 			ClearData();
 		}
 
@@ -343,6 +940,7 @@ namespace net
 			printf("start connection on port %d\n", port);
 			if (!socket.Open(port))
 				return false;
+			this->port = port;
 			running = true;
 			OnStart();
 			return true;
@@ -366,6 +964,12 @@ namespace net
 			return running;
 		}
 
+		// both ends must set the same key: it is mixed into the key exchange, authenticating it
+		void SetPreSharedKey(const unsigned char key[32])
+		{
+			memcpy(preSharedKey, key, sizeof(preSharedKey));
+		}
+
 		void Listen()
 		{
 			printf("server listening for connection\n");
@@ -375,19 +979,37 @@ namespace net
 				OnDisconnect();
 			mode = Server;
 			state = Listening;
+			NET_TRACE_EVENT(TraceStateChange, port, state);
 		}
 
 		void Connect(const Address& address)
 		{
-			printf("client connecting to %d.%d.%d.%d:%d\n",
-				address.GetA(), address.GetB(), address.GetC(), address.GetD(), address.GetPort());
+			char text[80];
+			printf("client connecting to %s%s\n", address.ToString(text, sizeof(text)),
+				hasTicket && ticketAddress == address ? " (resuming session)" : "");
 			bool connected = IsConnected();
 			ClearData();
 			if (connected)
 				OnDisconnect();
 			mode = Client;
 			state = Connecting;
+			NET_TRACE_EVENT(TraceStateChange, port, state);
 			this->address = address;
+			random_bytes(clientPrivate, sizeof(clientPrivate));
+			x25519_public_key(clientPublic, clientPrivate);
+			if (ticketAddress != address)
+				hasTicket = false;
+			if (hasTicket)
+			{
+				// this attempt spends the ticket, the next connect waits for the one the server sends back
+				memcpy(resumePrefix, ticket, TicketSize);
+				random_bytes(resumePrefix + TicketSize, ResumeRandomSize);
+				unsigned char resume[KeySize];
+				derive_secret(ticketSecret, resumePrefix + TicketSize, ResumeRandomSize, resume);
+				StartSession(resume);
+				ticketAddress = Address();
+			}
+			handshakeAccumulator = HandshakeResendTime;
 		}
 
 		bool IsConnecting() const
@@ -410,14 +1032,35 @@ namespace net
 			return state == Listening;
 		}
 
+		// true when SendPacket will deliver: connected, or resuming with a session ticket (0-RTT)
+		bool CanSend() const
+		{
+			return state == Connected || (state == Connecting && mode == Client && hasTicket);
+		}
+
 		Mode GetMode() const
 		{
 			return mode;
 		}
 
+		int GetPort() const
+		{
+			return port;
+		}
+
 		virtual void Update(float deltaTime)
 		{
 			assert(running);
+			time += deltaTime;
+			if (state == Connecting && mode == Client)
+			{
+				handshakeAccumulator += deltaTime;
+				if (handshakeAccumulator >= HandshakeResendTime)
+				{
+					SendHandshake();
+					handshakeAccumulator = 0.0f;
+				}
+			}
 			timeoutAccumulator += deltaTime;
 			if (timeoutAccumulator > timeout)
 			{
@@ -426,6 +1069,7 @@ namespace net
 					printf("connect timed out\n");
 					ClearData();
 					state = ConnectFail;
+					NET_TRACE_EVENT(TraceStateChange, port, state);
 					OnDisconnect();
 				}
 				else if (state == Connected)
@@ -437,81 +1081,593 @@ namespace net
 					OnDisconnect();
 				}
 			}
+			socket.Flush();
 		}
 
 		virtual bool SendPacket(const unsigned char data[], int size)
 		{
 			assert(running);
-			if (address.GetAddress() == 0)
+			if (!address.IsValid())
 				return false;
-			unsigned char packet[PacketSizeHack + 4];
-			packet[0] = (unsigned char)(protocolId >> 24);
-			packet[1] = (unsigned char)((protocolId >> 16) & 0xFF);
-			packet[2] = (unsigned char)((protocolId >> 8) & 0xFF);
-			packet[3] = (unsigned char)((protocolId) & 0xFF);
-			std::memcpy(&packet[4], data, size);
-			return socket.Send(address, packet, size + 4);
+			if (state == Connected)
+				return SendEncrypted(PayloadPacket, connectionId, ConnectionIdSize, data, size);
+			if (state == Connecting && mode == Client && hasTicket)
+				return SendEncrypted(ResumePacket, resumePrefix, ResumePrefixSize, data, size);
+			return false;
 		}
 
 		virtual int ReceivePacket(unsigned char data[], int size)
 		{
 			assert(running);
-			unsigned char packet[PacketSizeHack + 4];
-			Address sender;
-			int bytes_read = socket.Receive(sender, packet, size + 4);
-			if (bytes_read == 0)
-				return 0;
-			if (bytes_read <= 4)
-				return 0;
-			if (packet[0] != (unsigned char)(protocolId >> 24) ||
-				packet[1] != (unsigned char)((protocolId >> 16) & 0xFF) ||
-				packet[2] != (unsigned char)((protocolId >> 8) & 0xFF) ||
-				packet[3] != (unsigned char)(protocolId & 0xFF))
-				return 0;
-			if (mode == Server && !IsConnected())
-			{
-				printf("server accepts connection from client %d.%d.%d.%d:%d\n",
-					sender.GetA(), sender.GetB(), sender.GetC(), sender.GetD(), sender.GetPort());
-				state = Connected;
-				address = sender;
-				OnConnect();
-			}
-			if (sender == address)
+			unsigned char packet[PacketSizeHack + MaxHeaderSize];
+			while (true)
 			{
-				if (mode == Client && state == Connecting)
+				Address sender;
+				int bytes_read = socket.Receive(sender, packet, sizeof(packet));
+				if (bytes_read == 0)
+					return 0;
+				if (bytes_read < HeaderSize)
+					continue;
+				if (packet[0] != (unsigned char)(protocolId >> 24) ||
+					packet[1] != (unsigned char)((protocolId >> 16) & 0xFF) ||
+					packet[2] != (unsigned char)((protocolId >> 8) & 0xFF) ||
+					packet[3] != (unsigned char)(protocolId & 0xFF))
+					continue;
+
+				const unsigned char type = packet[4];
+				int prefix_size = 0;
+				bool resuming = false;
+				bool nextPath = false;
+
+				if (type == PayloadPacket || type == PathChallengePacket || type == PathResponsePacket)
 				{
-					printf("client completes connection with server\n");
-					state = Connected;
-					OnConnect();
+					// matched on the connection id, the sender may be the peer at a new address
+					if (!hasSession || bytes_read < HeaderSize + ConnectionIdSize)
+						continue;
+					nextPath = memcmp(packet + HeaderSize, nextConnectionId, ConnectionIdSize) == 0;
+					if (!nextPath && memcmp(packet + HeaderSize, connectionId, ConnectionIdSize) != 0 &&
+						memcmp(packet + HeaderSize, previousConnectionId, ConnectionIdSize) != 0)
+						continue;
+					prefix_size = ConnectionIdSize;
+				}
+				else if (type == ResumePacket && mode == Server)
+				{
+					if (bytes_read < HeaderSize + ResumePrefixSize || (IsConnected() && sender != address))
+						continue;
+					prefix_size = ResumePrefixSize;
+					if (!IsConnected())
+					{
+						if (!OpenTicket(packet + HeaderSize))
+						{
+							SendChallenge(sender, packet + HeaderSize);
+							continue;
+						}
+						resuming = true;
+					}
+				}
+				else
+				{
+					ProcessHandshake(sender, type, packet, bytes_read);
+					continue;
 				}
-				timeoutAccumulator = 0.0f;
-				memcpy(data, &packet[4], bytes_read - 4);
-				return bytes_read - 4;
-			}
-			return 0;
-		}
-
-		int GetHeaderSize() const
-		{
-			return 4;
-		}
 
-	protected:
+				const uint64_t newest = receiveNonce;
+				int payload_size = OpenPacket(packet, HeaderSize + prefix_size, bytes_read, data, size);
+				if (payload_size < 0)
+				{
+					if (resuming)
+						hasSession = false;
+					continue;
+				}
+				if (nextPath)
+					AdvanceConnectionId();
 
-		virtual void OnStart() {}
+				if (type == PathChallengePacket)
+				{
+					if (payload_size == PathDataSize)
+						SendEncrypted(sender, PathResponsePacket, connectionId, ConnectionIdSize, data, PathDataSize);
+					continue;
+				}
+				if (type == PathResponsePacket)
+				{
+					if (pathPending && sender == pathAddress && payload_size == PathDataSize && secure_equal(data, pathData, PathDataSize))
+						Migrate();
+					continue;
+				}
+				if (type == PayloadPacket && sender != address && receiveNonce > newest)
+					ValidatePath(sender);
+
+				if (resuming)
+				{
+					RedeemTicket(packet + HeaderSize);
+					address = sender;
+					Accept("server resumes session with client");
+				}
+				else if (state == Connecting && mode == Client)
+				{
+					CompleteConnect("client completes connection with server");
+				}
+
+				timeoutAccumulator = 0.0f;
+				if (payload_size > 0)
+					return payload_size;
+			}
+		}
+
+		int GetHeaderSize() const
+		{
+			return HeaderSize + ConnectionIdSize + NonceSize + AeadTagSize;
+		}
+
+	protected:
+
+		// size of the batch the socket is gathering, a payload sealed to this size joins it
+		int GetSegmentSize() const
+		{
+			return socket.GetSegmentSize();
+		}
+
+		// when the packet ReceivePacket last returned arrived, kernel time where the socket has it
+		uint64_t GetReceiveTime() const
+		{
+			return socket.GetReceiveTime();
+		}
+
+		void FlushSocket()
+		{
+			socket.Flush();
+		}
+
+		// the kernel has no room for sends right now, data is better kept queued than handed over
+		bool IsSendBlocked()
+		{
+			return socket.IsBlocked();
+		}
+
+		void TakeSocketDrops(uint64_t& received, uint64_t& sent)
+		{
+			socket.TakeDrops(received, sent);
+		}
+
+		void SizeSendBuffer(double bandwidth, double delay)
+		{
+			socket.SizeSendBuffer(bandwidth, delay);
+		}
+
+		virtual void OnStart() {}
 		virtual void OnStop() {}
 		virtual void OnConnect() {}
 		virtual void OnDisconnect() {}
 
+		void WriteInteger(unsigned char* data, unsigned int value)
+		{
+			data[0] = (unsigned char)(value >> 24);
+			data[1] = (unsigned char)((value >> 16) & 0xFF);
+			data[2] = (unsigned char)((value >> 8) & 0xFF);
+			data[3] = (unsigned char)(value & 0xFF);
+		}
+
+		void ReadInteger(const unsigned char* data, unsigned int& value)
+		{
+			value = (((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) |
+				((unsigned int)data[2] << 8) | ((unsigned int)data[3]));
+		}
+
 	private:
 
+		enum PacketType
+		{
+			PayloadPacket,				// connection id + nonce + sealed application data
+			RequestPacket,				// client -> server: client public key, padded so the challenge is no amplification
+			ChallengePacket,			// server -> client: cookie (timestamp + mac of client address and key), server public key
+			ResponsePacket,				// client -> server: cookie echoed back with the client public key
+			AcceptedPacket,				// server -> client: nonce + sealed session ticket
+			ResumePacket,				// client -> server: session ticket + client random, then nonce + sealed 0-RTT application data
+			PathChallengePacket,		// connection id + nonce + sealed random data, to the peer's new address
+			PathResponsePacket			// connection id + nonce + the challenge's data sealed again, from the new address
+		};
+
+		enum
+		{
+			HeaderSize = 5,				// protocol id + packet type
+			KeySize = 32,
+			NonceSize = 8,
+			CookieSize = 12,			// timestamp + mac
+			ConnectionIdSize = 8,
+			PathDataSize = 8,
+			TicketSize = 8 + 4 + KeySize + AeadTagSize,		// session id + expiry + sealed resumption secret
+			ResumeRandomSize = 16,
+			ResumePrefixSize = TicketSize + ResumeRandomSize,
+			MaxHeaderSize = HeaderSize + ResumePrefixSize + NonceSize + AeadTagSize,
+			RequestSize = 96,
+			UsedTicketCount = 64,
+			ReplayWindow = 64
+		};
+
 		void ClearData()
 		{
+			if (state != Disconnected)
+				NET_TRACE_EVENT(TraceStateChange, port, Disconnected);
 			state = Disconnected;
 			timeoutAccumulator = 0.0f;
+			handshakeAccumulator = 0.0f;
+			hasCookie = false;
+			hasSession = false;
+			pathPending = false;
 			address = Address();
 		}
 
+		// session keys: one direction each, nonces restart because every session has a fresh master secret
+		void StartSession(const unsigned char master[KeySize])
+		{
+			unsigned char keys[64];
+			derive_keys(master, 0, keys);
+			memcpy(this->master, master, KeySize);
+			memcpy(sendKey, mode == Client ? keys : keys + 32, KeySize);
+			memcpy(receiveKey, mode == Client ? keys + 32 : keys, KeySize);
+			sendNonce = 0;
+			receiveNonce = 0;
+			receiveWindow = 0;
+			pathEpoch = 0;
+			DeriveConnectionId(0, connectionId);
+			memcpy(previousConnectionId, connectionId, ConnectionIdSize);
+			DeriveConnectionId(1, nextConnectionId);
+			pathPending = false;
+			hasSession = true;
+		}
+
+		// connection ids are a sequence derived from the session, a path challenge goes out under the next one
+		void DeriveConnectionId(uint64_t epoch, unsigned char out[ConnectionIdSize])
+		{
+			unsigned char keys[64];
+			derive_keys(master, 2 + epoch, keys);
+			memcpy(out, keys, ConnectionIdSize);
+		}
+
+		// the peer sent under the next id: it has seen a path challenge (or sent one), move along with it
+		//  + the previous id is still taken, for packets already on their way
+		void AdvanceConnectionId()
+		{
+			pathEpoch++;
+			memcpy(previousConnectionId, connectionId, ConnectionIdSize);
+			memcpy(connectionId, nextConnectionId, ConnectionIdSize);
+			DeriveConnectionId(pathEpoch + 1, nextConnectionId);
+		}
+
+		// the master secret is a keyed hash of the transcript (client key, server key, cookie) under the shared
+		// secret, so the session is bound to the exchange that made it and not just to its x25519 output
+		bool StartSessionFromKeyExchange(const unsigned char private_key[KeySize], const unsigned char peer_public[KeySize],
+			const unsigned char cookie[CookieSize])
+		{
+			unsigned char shared[KeySize];
+			x25519(shared, private_key, peer_public);
+			unsigned char zero = 0;
+			for (int i = 0; i < KeySize; ++i)
+			{
+				zero |= shared[i];
+				shared[i] ^= preSharedKey[i];
+			}
+			if (zero == 0)
+				return false;				// low order peer key
+			unsigned char transcript[KeySize * 2 + CookieSize];
+			memcpy(transcript, mode == Client ? clientPublic : peer_public, KeySize);
+			memcpy(transcript + KeySize, mode == Client ? peer_public : serverPublic, KeySize);
+			memcpy(transcript + KeySize * 2, cookie, CookieSize);
+			unsigned char keys[64];
+			derive_keys(shared, 1, keys);
+			derive_secret(keys, transcript, sizeof(transcript), keys);
+			StartSession(keys);
+			return true;
+		}
+
+		// the secret a ticket for this session resumes with, known to both ends and sealed inside the ticket
+		void DeriveTicketSecret(uint64_t session, unsigned char out[KeySize])
+		{
+			unsigned char keys[64];
+			derive_keys(master, session | 0x8000000000000000ULL, keys);
+			memcpy(out, keys, KeySize);
+		}
+
+		bool SendRaw(const Address& destination, PacketType type, const unsigned char* data, int size)
+		{
+			unsigned char packet[PacketSizeHack + MaxHeaderSize];
+			if (size > PacketSizeHack + MaxHeaderSize - HeaderSize)
+				return false;
+			WriteInteger(packet, protocolId);
+			packet[4] = (unsigned char)type;
+			if (size > 0)
+				memcpy(packet + HeaderSize, data, size);
+			return socket.Send(destination, packet, HeaderSize + size);
+		}
+
+		bool SendEncrypted(PacketType type, const unsigned char* prefix, int prefix_size, const unsigned char* data, int size)
+		{
+			return SendEncrypted(address, type, prefix, prefix_size, data, size);
+		}
+
+		// header | prefix | nonce are the associated data, data is sealed after them
+		bool SendEncrypted(const Address& destination, PacketType type, const unsigned char* prefix, int prefix_size, const unsigned char* data, int size)
+		{
+			unsigned char packet[PacketSizeHack + MaxHeaderSize];
+			if (!hasSession || size > PacketSizeHack || prefix_size > ResumePrefixSize)
+				return false;
+			WriteInteger(packet, protocolId);
+			packet[4] = (unsigned char)type;
+			if (prefix_size > 0)
+				memcpy(packet + HeaderSize, prefix, prefix_size);
+			const int ad_size = HeaderSize + prefix_size + NonceSize;
+			for (int i = 0; i < NonceSize; ++i)
+				packet[HeaderSize + prefix_size + i] = (unsigned char)(sendNonce >> (i * 8));
+
+			AeadPacket sealed;
+			sealed.nonce = sendNonce++;
+			sealed.ad = packet;
+			sealed.ad_size = ad_size;
+			sealed.in = data;
+			sealed.size = size;
+			sealed.out = packet + ad_size;
+			aead_seal(sendKey, sealed);
+			return socket.Send(destination, packet, ad_size + size + AeadTagSize);
+		}
+
+		// returns payload bytes written to data, or -1 if the packet is malformed, replayed or forged
+		int OpenPacket(const unsigned char* packet, int prefix_end, int bytes_read, unsigned char data[], int size)
+		{
+			const int ad_size = prefix_end + NonceSize;
+			const int payload_size = bytes_read - ad_size - AeadTagSize;
+			if (!hasSession || payload_size < 0 || payload_size > size)
+				return -1;
+			uint64_t nonce = 0;
+			for (int i = 0; i < NonceSize; ++i)
+				nonce |= (uint64_t)packet[prefix_end + i] << (i * 8);
+			if (nonce <= receiveNonce && (receiveNonce - nonce >= ReplayWindow || ((receiveWindow >> (receiveNonce - nonce)) & 1)))
+				return -1;
+
+			AeadPacket sealed;
+			sealed.nonce = nonce;
+			sealed.ad = packet;
+			sealed.ad_size = ad_size;
+			sealed.in = packet + ad_size;
+			sealed.size = payload_size;
+			sealed.out = data;
+			if (!aead_open(receiveKey, sealed))
+				return -1;
+
+			if (nonce > receiveNonce)
+			{
+				uint64_t shift = nonce - receiveNonce;
+				receiveWindow = shift >= ReplayWindow ? 0 : receiveWindow << shift;
+				receiveNonce = nonce;
+			}
+			receiveWindow |= (uint64_t)1 << (receiveNonce - nonce);
+			return payload_size;
+		}
+
+		void SendHandshake()
+		{
+			unsigned char body[RequestSize - HeaderSize];
+			if (hasTicket)
+			{
+				SendEncrypted(ResumePacket, resumePrefix, ResumePrefixSize, NULL, 0);
+			}
+			else if (hasCookie)
+			{
+				memcpy(body, cookie, CookieSize);
+				memcpy(body + CookieSize, clientPublic, KeySize);
+				SendRaw(address, ResponsePacket, body, CookieSize + KeySize);
+			}
+			else
+			{
+				memset(body, 0, sizeof(body));
+				memcpy(body, clientPublic, KeySize);
+				SendRaw(address, RequestPacket, body, sizeof(body));
+			}
+		}
+
+		void ProcessHandshake(const Address& sender, unsigned char type, const unsigned char* packet, int bytes_read)
+		{
+			const unsigned char* body = packet + HeaderSize;
+			const int body_size = bytes_read - HeaderSize;
+			if (mode == Server)
+			{
+				if (IsConnected() && sender != address)
+					return;
+				if (type == RequestPacket && body_size >= RequestSize - HeaderSize)
+				{
+					SendChallenge(sender, body);
+				}
+				else if (type == ResponsePacket && body_size >= CookieSize + KeySize && CheckCookie(sender, body, body + CookieSize))
+				{
+					if (!IsConnected())
+					{
+						if (!StartSessionFromKeyExchange(serverPrivate, body + CookieSize, body))
+							return;
+						address = sender;
+						Accept("server accepts connection from client");
+					}
+					else
+					{
+						SendAccepted();
+					}
+					timeoutAccumulator = 0.0f;
+				}
+			}
+			else if (mode == Client && sender == address)
+			{
+				if (type == ChallengePacket && body_size >= CookieSize + KeySize && state == Connecting)
+				{
+					if (hasTicket)
+					{
+						// the ticket was refused: forget it and start a full handshake
+						hasTicket = false;
+						hasSession = false;
+						SendHandshake();
+						return;
+					}
+					if (!StartSessionFromKeyExchange(clientPrivate, body + CookieSize, body))
+						return;
+					memcpy(cookie, body, CookieSize);
+					hasCookie = true;
+					SendHandshake();
+				}
+				else if (type == AcceptedPacket)
+				{
+					unsigned char issued[TicketSize];
+					if (OpenPacket(packet, HeaderSize, bytes_read, issued, TicketSize) != TicketSize)
+						return;
+					uint64_t session;
+					memcpy(&session, issued, 8);
+					memcpy(ticket, issued, TicketSize);
+					DeriveTicketSecret(session, ticketSecret);
+					hasTicket = true;
+					ticketAddress = address;
+					timeoutAccumulator = 0.0f;
+					if (state == Connecting)
+						CompleteConnect("client completes connection with server");
+				}
+			}
+		}
+
+		// the newest packet came from somewhere else, challenge that address before sending there
+		//  + a packet captured and replayed from another address can't move the connection, it can't answer
+		//  + packets keep going to the old address until the answer comes back
+		void ValidatePath(const Address& sender)
+		{
+			if (pathPending && sender == pathAddress && time - pathTime < HandshakeResendTime)
+				return;
+			if (!pathPending || sender != pathAddress)
+			{
+				pathAddress = sender;
+				random_bytes(pathData, PathDataSize);
+				pathPending = true;
+			}
+			pathTime = time;
+			SendEncrypted(sender, PathChallengePacket, nextConnectionId, ConnectionIdSize, pathData, PathDataSize);
+		}
+
+		void Migrate()
+		{
+			char text[80];
+			printf("peer moved to %s\n", pathAddress.ToString(text, sizeof(text)));
+			address = pathAddress;
+			pathPending = false;
+			timeoutAccumulator = 0.0f;
+		}
+
+		void Accept(const char* message)
+		{
+			char text[80];
+			printf("%s %s\n", message, address.ToString(text, sizeof(text)));
+			state = Connected;
+			timeoutAccumulator = 0.0f;
+			NET_TRACE_EVENT(TraceStateChange, port, state);
+			SendAccepted();
+			OnConnect();
+		}
+
+		void CompleteConnect(const char* message)
+		{
+			printf("%s\n", message);
+			state = Connected;
+			timeoutAccumulator = 0.0f;
+			NET_TRACE_EVENT(TraceStateChange, port, state);
+			OnConnect();
+		}
+
+		// cookie = timestamp | mac( secret, protocol id | client address | scope | port | timestamp | client public key )
+		void MakeCookie(const Address& sender, unsigned int timestamp, const unsigned char client_public[KeySize], unsigned char cookie[CookieSize])
+		{
+			unsigned char input[30 + KeySize];
+			WriteInteger(input, protocolId);
+			memcpy(input + 4, sender.GetIPv6(), 16);
+			WriteInteger(input + 20, sender.GetScope());
+			input[24] = (unsigned char)(sender.GetPort() >> 8);
+			input[25] = (unsigned char)(sender.GetPort() & 0xFF);
+			WriteInteger(input + 26, timestamp);
+			memcpy(input + 30, client_public, KeySize);
+			uint64_t mac = siphash(secret, input, sizeof(input));
+			WriteInteger(cookie, timestamp);
+			memcpy(cookie + 4, &mac, 8);
+		}
+
+		bool CheckCookie(const Address& sender, const unsigned char* received, const unsigned char client_public[KeySize])
+		{
+			unsigned int timestamp;
+			ReadInteger(received, timestamp);
+			if ((float)timestamp > time || time - (float)timestamp > CookieLifetime)
+				return false;
+			unsigned char expected[CookieSize];
+			MakeCookie(sender, timestamp, client_public, expected);
+			return secure_equal(expected, received, CookieSize);
+		}
+
+		// a refused resume carries no client key: that challenge only tells the client to drop its ticket
+		void SendChallenge(const Address& sender, const unsigned char* client_public)
+		{
+			unsigned char body[CookieSize + KeySize];
+			MakeCookie(sender, (unsigned int)time, client_public, body);
+			memcpy(body + CookieSize, serverPublic, KeySize);
+			SendRaw(sender, ChallengePacket, body, sizeof(body));
+		}
+
+		// ticket = session id | expiry | seal( ticket key, nonce = session id, ad = session id | expiry, resumption secret )
+		void SendAccepted()
+		{
+			unsigned char issued[TicketSize];
+			unsigned char resume[KeySize];
+			uint64_t session = ++nextSessionId;
+			memcpy(issued, &session, 8);
+			WriteInteger(issued + 8, (unsigned int)(time + TicketLifetime));
+			DeriveTicketSecret(session, resume);
+
+			AeadPacket sealed;
+			sealed.nonce = session;
+			sealed.ad = issued;
+			sealed.ad_size = 12;
+			sealed.in = resume;
+			sealed.size = KeySize;
+			sealed.out = issued + 12;
+			aead_seal(ticketKey, sealed);
+
+			SendEncrypted(AcceptedPacket, NULL, 0, issued, TicketSize);
+		}
+
+		// recover the resumption secret from a ticket and start its session, the ticket is redeemed once the payload checks out
+		//  + the session keys come from the secret and the client random after the ticket, never the secret alone
+		bool OpenTicket(const unsigned char* received)
+		{
+			unsigned int expiry;
+			ReadInteger(received + 8, expiry);
+			if (time > (float)expiry)
+				return false;
+			uint64_t session;
+			memcpy(&session, received, 8);
+			for (int i = 0; i < UsedTicketCount; ++i)
+				if (usedTickets[i] == session)
+					return false;
+
+			unsigned char resume[KeySize];
+			AeadPacket sealed;
+			sealed.nonce = session;
+			sealed.ad = received;
+			sealed.ad_size = 12;
+			sealed.in = received + 12;
+			sealed.size = KeySize;
+			sealed.out = resume;
+			if (!aead_open(ticketKey, sealed))
+				return false;
+			derive_secret(resume, received + TicketSize, ResumeRandomSize, resume);
+			StartSession(resume);
+			return true;
+		}
+
+		// tickets are single use: remember recently redeemed session ids so 0-RTT data can't be replayed into a new session
+		void RedeemTicket(const unsigned char* received)
+		{
+			memcpy(&usedTickets[usedTicketIndex], received, 8);
+			usedTicketIndex = (usedTicketIndex + 1) % UsedTicketCount;
+		}
+
 		enum State
 		{
 			Disconnected,
@@ -525,11 +1681,50 @@ namespace net
 		float timeout;
 
 		bool running;
+		int port;
 		Mode mode;
 		State state;
 		Socket socket;
 		float timeoutAccumulator;
+		float handshakeAccumulator;
+		float time;							// seconds since construction, timestamps cookies and tickets
 		Address address;
+
+		unsigned char secret[16];			// server key for cookies, never leaves the process
+		unsigned char ticketKey[KeySize];	// server key sealing session tickets
+		unsigned char serverPrivate[KeySize];
+		unsigned char serverPublic[KeySize];
+		unsigned char preSharedKey[KeySize];
+		uint64_t nextSessionId;
+		uint64_t usedTickets[UsedTicketCount];
+		int usedTicketIndex;
+
+		bool hasSession;					// keys agreed (or resumed), packets can be sealed and opened
+		unsigned char master[KeySize];
+		unsigned char sendKey[KeySize];
+		unsigned char receiveKey[KeySize];
+		uint64_t sendNonce;
+		uint64_t receiveNonce;				// highest nonce opened
+		uint64_t receiveWindow;				// bit n set: receiveNonce - n was opened (replay protection)
+		unsigned char connectionId[ConnectionIdSize];	// derived from the session, names it whatever address it comes from
+		unsigned char previousConnectionId[ConnectionIdSize];
+		unsigned char nextConnectionId[ConnectionIdSize];
+		uint64_t pathEpoch;					// position of connectionId in the session's sequence of ids
+
+		bool pathPending;					// a challenge is out to pathAddress, the peer's new address
+		Address pathAddress;
+		unsigned char pathData[PathDataSize];
+		float pathTime;						// when the challenge was last sent
+
+		unsigned char clientPrivate[KeySize];
+		unsigned char clientPublic[KeySize];
+		bool hasCookie;						// client: challenge received, echoing it back
+		unsigned char cookie[CookieSize];
+		bool hasTicket;						// client: session ticket from the last connection to ticketAddress
+		unsigned char ticket[TicketSize];
+		unsigned char ticketSecret[KeySize];
+		Address ticketAddress;				// cleared once the ticket is used, a new ticket sets it again
+		unsigned char resumePrefix[ResumePrefixSize];	// client: ticket + this attempt's random, ahead of every resume packet
 	};
 
 	// packet queue to store information about sent and received packets sorted in sequence order
@@ -540,6 +1735,19 @@ namespace net
 		unsigned int sequence;			// packet sequence number
 		float time;					    // time offset since packet was sent or received (depending on context)
 		int size;						// packet size in bytes
+		uint64_t timestamp;				// GetTime() when it was sent, 0 if not known
+		uint64_t token;					// caller's token for the packet, 0 if no notice is wanted
+		uint64_t delivered;				// bytes delivered (acked) when it was sent
+		uint64_t delivered_time;		// GetTime() of the last ack before it was sent
+		uint64_t first_sent_time;		// send time of the packet that last ack was for
+	};
+
+	// a packet sent with a token, acked or declared lost (timed out, or dropped on reset)
+	struct PacketNotice
+	{
+		unsigned int sequence;
+		uint64_t token;
+		bool acked;
 	};
 
 	inline bool sequence_more_recent(unsigned int s1, unsigned int s2, unsigned int max_sequence)
@@ -602,16 +1810,296 @@ namespace net
 			{
 				assert(itor->sequence <= max_sequence);
 				if (prev != end())
-				{
 					assert(sequence_more_recent(itor->sequence, prev->sequence, max_sequence));
-					prev = itor;
+				prev = itor;
+			}
+		}
+	};
+
+	// sent packets still waiting for an ack, kept by sequence alongside the pending ack queue
+	//  + one bit per slot, so the packets an incoming ack covers come out of a shift and a mask and
+	//    the work done per ack is per packet newly acked, not per packet in flight
+	//  + slots run in reverse sequence order, the 33 sequences one ack covers (ack, ack - 1, ... ack - 32)
+	//    are then bits 0-32 of a single word
+	//  + a packet whose slot is reused while it is still in flight can no longer be acked, it times out
+
+	class AckWindow
+	{
+	public:
+
+		enum { Size = 4096, Words = Size / 64 };
+
+		void clear(unsigned int max_sequence)
+		{
+			// slots only line up with the sequences when the sequence space is a whole number of windows
+			contiguous = max_sequence == 0xFFFFFFFF || (max_sequence + 1) % Size == 0;
+			for (int i = 0; i < Words; ++i)
+				bits[i] = 0;
+		}
+
+		void add(unsigned int sequence, PacketQueue::iterator entry)
+		{
+			const unsigned int index = slot(sequence);
+			slots[index].sequence = sequence;
+			slots[index].entry = entry;
+			bits[index >> 6] |= (uint64_t)1 << (index & 63);
+		}
+
+		// the packet left the pending ack queue some other way (it timed out)
+		void remove(unsigned int sequence, PacketQueue::iterator entry)
+		{
+			const unsigned int index = slot(sequence);
+			if (test(index) && slots[index].entry == entry)
+				bits[index >> 6] &= ~((uint64_t)1 << (index & 63));
+		}
+
+		// bit k set: ack - k is acked by ack and ack_bits and has not been acked before
+		//  + without contiguous slots every sequence the ack covers is a candidate, take() sorts them out
+		uint64_t pending(unsigned int ack, unsigned int ack_bits) const
+		{
+			const uint64_t acked = ((uint64_t)ack_bits << 1) | 1;
+			if (!contiguous)
+				return acked;
+			const unsigned int index = slot(ack);
+			const unsigned int shift = index & 63;
+			uint64_t window = bits[index >> 6] >> shift;
+			if (shift != 0)
+				window |= bits[((index >> 6) + 1) & (Words - 1)] << (64 - shift);
+			return acked & window;
+		}
+
+		// clears the packet with this sequence and hands back its queue entry, false if it is not pending
+		bool take(unsigned int sequence, PacketQueue::iterator& entry)
+		{
+			const unsigned int index = slot(sequence);
+			if (!test(index) || slots[index].sequence != sequence)
+				return false;
+			bits[index >> 6] &= ~((uint64_t)1 << (index & 63));
+			entry = slots[index].entry;
+			return true;
+		}
+
+	private:
+
+		static unsigned int slot(unsigned int sequence)
+		{
+			return (Size - 1) - (sequence & (Size - 1));
+		}
+
+		bool test(unsigned int index) const
+		{
+			return (bits[index >> 6] >> (index & 63)) & 1;
+		}
+
+		struct Slot
+		{
+			unsigned int sequence;
+			PacketQueue::iterator entry;
+		};
+
+		uint64_t bits[Words];
+		Slot slots[Size];
+		bool contiguous;
+	};
+
+	// best value (max or min) seen over a sliding window, as the best three samples at different times
+	//  + the kernel's minmax filter: a newer sample that is as good replaces everything older, the
+	//    second and third best keep something in hand for when the best ages out of the window
+
+	class WindowedFilter
+	{
+	public:
+
+		explicit WindowedFilter(bool maximum = true)
+		{
+			this->maximum = maximum;
+			Reset();
+		}
+
+		void Reset()
+		{
+			empty = true;
+			for (int i = 0; i < 3; ++i)
+			{
+				samples[i].time = 0;
+				samples[i].value = 0.0f;
+			}
+		}
+
+		bool IsEmpty() const
+		{
+			return empty;
+		}
+
+		float Get() const
+		{
+			return samples[0].value;
+		}
+
+		// time and window are in any one unit (microseconds, round trips), time never goes back
+		float Update(uint64_t time, uint64_t window, float value)
+		{
+			const Sample sample = { time, value };
+			if (empty || Better(value, samples[0].value) || time - samples[2].time > window)
+			{
+				samples[0] = samples[1] = samples[2] = sample;
+				empty = false;
+				return value;
+			}
+			if (Better(value, samples[1].value))
+				samples[1] = samples[2] = sample;
+			else if (Better(value, samples[2].value))
+				samples[2] = sample;
+
+			const uint64_t age = time - samples[0].time;
+			if (age > window)
+			{
+				samples[0] = samples[1];
+				samples[1] = samples[2];
+				samples[2] = sample;
+				if (time - samples[0].time > window)
+				{
+					samples[0] = samples[1];
+					samples[1] = samples[2];
+					samples[2] = sample;
 				}
 			}
+			else if (samples[1].time == samples[0].time && age > window / 4)
+			{
+				samples[1] = samples[2] = sample;
+			}
+			else if (samples[2].time == samples[1].time && age > window / 2)
+			{
+				samples[2] = sample;
+			}
+			return samples[0].value;
+		}
+
+	private:
+
+		bool Better(float a, float b) const
+		{
+			return maximum ? a >= b : a <= b;
 		}
+
+		struct Sample
+		{
+			uint64_t time;
+			float value;
+		};
+
+		Sample samples[3];
+		bool maximum;
+		bool empty;
+	};
+
+	// delivery rate sampling as BBR does it
+	//  + each packet remembers how much had been delivered when it went out, its ack gives a sample of
+	//    bytes delivered since over the longer of the send and the ack intervals (so neither ack
+	//    compression nor a burst of sends can make the path look faster than it is)
+	//  + the bottleneck bandwidth is the max sample over the last BandwidthWindow round trips, the
+	//    min rtt the smallest rtt sample over the last MinRttWindow microseconds
+
+	class DeliveryRate
+	{
+	public:
+
+		enum { BandwidthWindow = 10 };
+		static const uint64_t MinRttWindow = 10000000;
+
+		DeliveryRate() : bandwidth(true), min_rtt(false)
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			delivered = 0;
+			delivered_time = 0;
+			first_sent_time = 0;
+			round_count = 0;
+			next_round_delivered = 0;
+			rate = 0.0f;
+			bandwidth.Reset();
+			min_rtt.Reset();
+		}
+
+		// nothing in flight: the intervals start over from this send
+		void PacketSent(PacketData& packet, bool idle)
+		{
+			if (idle || delivered_time == 0)
+			{
+				delivered_time = packet.timestamp;
+				first_sent_time = packet.timestamp;
+			}
+			packet.delivered = delivered;
+			packet.delivered_time = delivered_time;
+			packet.first_sent_time = first_sent_time;
+		}
+
+		void PacketAcked(const PacketData& packet, uint64_t now)
+		{
+			delivered += packet.size;
+			if (packet.timestamp == 0 || now < packet.timestamp)
+				return;
+			delivered_time = now;
+			first_sent_time = packet.timestamp;
+
+			// a round trip ends when a packet sent after the last one ended is acked
+			if (packet.delivered >= next_round_delivered)
+			{
+				next_round_delivered = delivered;
+				round_count++;
+			}
+
+			const float rtt = (float)(now - packet.timestamp) / 1000000.0f;
+			min_rtt.Update(now, MinRttWindow, rtt);
+
+			const uint64_t send_elapsed = packet.timestamp - packet.first_sent_time;
+			const uint64_t ack_elapsed = now - packet.delivered_time;
+			const uint64_t interval = send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed;
+			if (packet.delivered_time == 0 || interval == 0 || interval < (uint64_t)(min_rtt.Get() * 1000000.0f))
+				return;	// shorter than a round trip, the acks came in a clump
+			rate = (float)(delivered - packet.delivered) * 1000000.0f / (float)interval;
+			bandwidth.Update(round_count, BandwidthWindow, rate);
+		}
+
+		// bytes per second
+		float GetRate() const
+		{
+			return rate;
+		}
+
+		float GetBandwidth() const
+		{
+			return bandwidth.Get();
+		}
+
+		// seconds, 0 before the first sample
+		float GetMinRtt() const
+		{
+			return min_rtt.Get();
+		}
+
+		uint64_t GetRoundCount() const
+		{
+			return round_count;
+		}
+
+	private:
+
+		uint64_t delivered;					// bytes acked
+		uint64_t delivered_time;			// GetTime() of the last ack
+		uint64_t first_sent_time;			// send time of the packet last acked
+		uint64_t round_count;
+		uint64_t next_round_delivered;		// delivered that ends the current round trip
+		float rate;							// last sample
+		WindowedFilter bandwidth;			// max rate, over round trips
+		WindowedFilter min_rtt;				// min rtt, over time
 	};
 
 	// reliability system to support reliable connection
-	//  + manages sent, received, pending ack and acked packet queues
+	//  + manages sent, pending ack and acked packet queues, received packets are a bitset behind the newest
 	//  + separated out from reliable connection because it is quite complex and i want to unit test it!
 
 	class ReliabilitySystem
@@ -625,41 +2113,51 @@ namespace net
 			Reset();
 		}
 
+		// packets still waiting on their notice are declared lost, the notices themselves are kept
 		void Reset()
 		{
+			for (PacketQueue::iterator itor = pendingAckQueue.begin(); itor != pendingAckQueue.end(); ++itor)
+				Notify(notices, *itor, false);
 			local_sequence = 0;
 			remote_sequence = 0;
 			sentQueue.clear();
-			receivedQueue.clear();
 			pendingAckQueue.clear();
 			ackedQueue.clear();
-			sent_packets = 0;
-			recv_packets = 0;
-			lost_packets = 0;
-			acked_packets = 0;
+			ackWindow.clear(max_sequence);
+			deliveryRate.Reset();
+			received_bits = 0;
+			any_received = false;
+			metrics.Reset();
 			sent_bandwidth = 0.0f;
 			acked_bandwidth = 0.0f;
 			rtt = 0.0f;
 			rtt_maximum = 1.0f;
 		}
 
-		void PacketSent(int size)
+		// a non zero token comes back from PopNotice once the packet is acked or declared lost
+		void PacketSent(int size, uint64_t timestamp = 0, uint64_t token = 0)
 		{
-			if (sentQueue.exists(local_sequence))
-			{
-				printf("local sequence %d exists\n", local_sequence);
-				for (PacketQueue::iterator itor = sentQueue.begin(); itor != sentQueue.end(); ++itor)
-					printf(" + %d\n", itor->sequence);
-			}
-			assert(!sentQueue.exists(local_sequence));
-			assert(!pendingAckQueue.exists(local_sequence));
+			// the sent queue holds every sequence from its front up to the last one sent, so local_sequence
+			// is only still in it once the whole sequence space is, and then it is at the front of both queues
+#ifndef NDEBUG
+			if (sentQueue.size() > max_sequence)
+				NET_TRACE_EVENT(TraceDuplicate, local_sequence, (unsigned int)sentQueue.size());
+#endif
+			assert(sentQueue.size() <= max_sequence);
+			assert(pendingAckQueue.empty() || pendingAckQueue.front().sequence != local_sequence);
 			PacketData data;
 			data.sequence = local_sequence;
 			data.time = 0.0f;
 			data.size = size;
+			data.timestamp = timestamp;
+			data.token = token;
+			deliveryRate.PacketSent(data, pendingAckQueue.empty());
 			sentQueue.push_back(data);
 			pendingAckQueue.push_back(data);
-			sent_packets++;
+			ackWindow.add(local_sequence, --pendingAckQueue.end());
+			NET_TRACE_EVENT(TraceSend, local_sequence, size);
+			RecordSent(metrics, size, pendingAckQueue.size());
+			RecordSent(GetProcessMetrics().totals, size, pendingAckQueue.size());
 			local_sequence++;
 			if (local_sequence > max_sequence)
 				local_sequence = 0;
@@ -667,26 +2165,35 @@ namespace net
 
 		void PacketReceived(unsigned int sequence, int size)
 		{
-			recv_packets++;
-			if (receivedQueue.exists(sequence))
-				return;
-			PacketData data;
-			data.sequence = sequence;
-			data.time = 0.0f;
-			data.size = size;
-			receivedQueue.push_back(data);
-			if (sequence_more_recent(sequence, remote_sequence, max_sequence))
+			RecordReceived(metrics, size);
+			RecordReceived(GetProcessMetrics().totals, size);
+			NET_TRACE_EVENT(TraceReceive, sequence, size);
+			received_bits = record_received(sequence, remote_sequence, received_bits, any_received, max_sequence);
+			if (!any_received || sequence_more_recent(sequence, remote_sequence, max_sequence))
 				remote_sequence = sequence;
+			any_received = true;
 		}
 
-		unsigned int GenerateAckBits()
+		unsigned int GenerateAckBits() const
 		{
-			return generate_ack_bits(GetRemoteSequence(), receivedQueue, max_sequence);
+			return (unsigned int)received_bits;
 		}
 
-		void ProcessAck(unsigned int ack, unsigned int ack_bits)
+		// receive_time is when the packet carrying the ack arrived, rtt and delivery rate samples come from it
+		// and the send timestamps, without it the time now stands in
+		void ProcessAck(unsigned int ack, unsigned int ack_bits, uint64_t receive_time = 0)
 		{
-			process_ack(ack, ack_bits, pendingAckQueue, ackedQueue, acks, acked_packets, rtt, max_sequence);
+			process_ack(ack, ack_bits, pendingAckQueue, ackWindow, ackedQueue, acks, notices, deliveryRate, metrics, rtt, max_sequence,
+				receive_time != 0 ? receive_time : GetTime());
+		}
+
+		bool PopNotice(PacketNotice& notice)
+		{
+			if (notices.empty())
+				return false;
+			notice = notices.front();
+			notices.pop_front();
+			return true;
 		}
 
 		void Update(float deltaTime)
@@ -703,11 +2210,18 @@ namespace net
 		void Validate()
 		{
 			sentQueue.verify_sorted(max_sequence);
-			receivedQueue.verify_sorted(max_sequence);
 			pendingAckQueue.verify_sorted(max_sequence);
-			ackedQueue.verify_sorted(max_sequence);
 		}
 
+#ifdef NET_UNIT_TEST
+		// a test reaches the wrap without sending the whole space first, only before anything is sent
+		void SetLocalSequence(unsigned int sequence)
+		{
+			assert(sentQueue.empty() && pendingAckQueue.empty() && sequence <= max_sequence);
+			local_sequence = sequence;
+		}
+#endif
+
 		// utility functions
 
 	/*
@@ -717,73 +2231,174 @@ namespace net
 		}
 	*/
 
-		static int bit_index_for_sequence(unsigned int sequence, unsigned int ack, unsigned int max_sequence)
+		// how far older is behind newer, counting the wrap after max_sequence
+		static unsigned int sequence_distance(unsigned int newer, unsigned int older, unsigned int max_sequence)
+		{
+			return newer >= older ? newer - older : newer + (max_sequence - older) + 1;
+		}
+
+		// the sequence count before sequence, counting the wrap after max_sequence
+		static unsigned int sequence_before(unsigned int sequence, unsigned int count, unsigned int max_sequence)
+		{
+			return sequence >= count ? sequence - count : max_sequence - (count - sequence) + 1;
+		}
+
+		// received packets as bits behind the newest one, bit n set: newest - 1 - n was received
+		//  + the low 32 bits are the ack bits, a newer packet shifts them along
+		static uint64_t record_received(unsigned int sequence, unsigned int newest, uint64_t received_bits, bool any_received, unsigned int max_sequence)
+		{
+			if (!any_received || sequence == newest)
+				return any_received ? received_bits : 0;
+			if (sequence_more_recent(sequence, newest, max_sequence))
+			{
+				const unsigned int distance = sequence_distance(sequence, newest, max_sequence);
+				if (distance > 64)
+					return 0;
+				return (distance == 64 ? 0 : received_bits << distance) | ((uint64_t)1 << (distance - 1));
+			}
+			const unsigned int distance = sequence_distance(newest, sequence, max_sequence);
+			return distance <= 64 ? received_bits | ((uint64_t)1 << (distance - 1)) : received_bits;
+		}
+
+		// packet header: prefix | sequence | ack | ack bits
+		//  + sequence and ack go as their low 16 bits and are widened again against what the receiver
+		//    last saw, the ack as one byte of distance back from the sequence when it is that close
+		//  + an ack bits byte that is all ones (everything in it received) is left out
+		//  + prefix bits 0-3 say which ack bits bytes are there, bit 4 that the ack is one byte, bit 5 that
+		//    nothing has been received yet: the ack itself would otherwise always count as received
+		//  + a max_sequence that does not fit 16 bits and is not 2^32 - 1 can't be widened that way,
+		//    sequence and ack go whole
+
+		enum { MaxHeaderSize = 1 + 4 + 4 + 4, NoAck = 0x20 };
+
+		static bool wide_sequence(unsigned int max_sequence)
+		{
+			return max_sequence > 0xFFFF && max_sequence != 0xFFFFFFFF;
+		}
+
+		static int write_header(unsigned char* header, unsigned int sequence, unsigned int ack, unsigned int ack_bits, unsigned int max_sequence)
+		{
+			int bytes = 1;
+			unsigned char prefix = 0;
+			if (wide_sequence(max_sequence))
+			{
+				for (int i = 3; i >= 0; --i)
+					header[bytes++] = (unsigned char)(sequence >> (i * 8));
+				for (int i = 3; i >= 0; --i)
+					header[bytes++] = (unsigned char)(ack >> (i * 8));
+			}
+			else
+			{
+				const unsigned int distance = (sequence - ack) & 0xFFFF;
+				const int small = distance <= 0xFF;
+				header[1] = (unsigned char)(sequence >> 8);
+				header[2] = (unsigned char)sequence;
+				header[3] = (unsigned char)(small ? distance : distance >> 8);
+				header[4] = (unsigned char)distance;
+				prefix = (unsigned char)(small << 4);
+				bytes = 5 - small;
+			}
+			for (int i = 0; i < 4; ++i)
+			{
+				const unsigned char byte = (unsigned char)(ack_bits >> (i * 8));
+				header[bytes] = byte;
+				const int present = byte != 0xFF;
+				prefix |= (unsigned char)(present << i);
+				bytes += present;
+			}
+			header[0] = prefix;
+			return bytes;
+		}
+
+		// widens a 16 bit value to the sequence nearest base, the same value for a max_sequence that fits 16 bits
+		static unsigned int widen_sequence(unsigned int value, unsigned int base, unsigned int max_sequence)
+		{
+			if (max_sequence <= 0xFFFF)
+				return value;
+			return base + (unsigned int)(int)(short)(unsigned short)(value - base);
+		}
+
+		// returns the header size, -1 if it runs past size or a sequence is out of range
+		//  + sequence_base is the newest remote sequence, ack_base our next local sequence
+		//  + a header with NoAck reads as an ack of ack_base alone, a sequence not sent yet
+		static int read_header(const unsigned char* header, int size, unsigned int& sequence, unsigned int& ack, unsigned int& ack_bits,
+			unsigned int sequence_base, unsigned int ack_base, unsigned int max_sequence)
 		{
-			assert(sequence != ack);
-			assert(!sequence_more_recent(sequence, ack, max_sequence));
-			if (sequence > ack)
+			static const unsigned char present_bytes[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+			if (size < 1)
+				return -1;
+			const unsigned char prefix = header[0];
+			const bool wide = wide_sequence(max_sequence);
+			const int bytes = 1 + (wide ? 8 : (prefix & 0x10) ? 3 : 4) + present_bytes[prefix & 0x0F];
+			if (size < bytes || (prefix & 0xC0) != 0 || (wide && (prefix & 0x10) != 0))
+				return -1;
+
+			int offset = 1;
+			if (wide)
 			{
-				assert(ack < 33);
-				assert(max_sequence >= sequence);
-				return ack + (max_sequence - sequence);
+				sequence = ((unsigned int)header[1] << 24) | ((unsigned int)header[2] << 16) | ((unsigned int)header[3] << 8) | header[4];
+				ack = ((unsigned int)header[5] << 24) | ((unsigned int)header[6] << 16) | ((unsigned int)header[7] << 8) | header[8];
+				offset = 9;
 			}
 			else
 			{
-				assert(ack >= 1);
-				assert(sequence <= ack - 1);
-				return ack - 1 - sequence;
+				const unsigned int low = ((unsigned int)header[1] << 8) | header[2];
+				unsigned int distance = header[3];
+				offset = 4;
+				if (!(prefix & 0x10))
+					distance = (distance << 8) | header[offset++];
+				sequence = widen_sequence(low, sequence_base, max_sequence);
+				ack = widen_sequence((low - distance) & 0xFFFF, ack_base, max_sequence);
 			}
-		}
+			if (sequence > max_sequence || ack > max_sequence)
+				return -1;
 
-		static unsigned int generate_ack_bits(unsigned int ack, const PacketQueue& received_queue, unsigned int max_sequence)
-		{
-			unsigned int ack_bits = 0;
-			for (PacketQueue::const_iterator itor = received_queue.begin(); itor != received_queue.end(); itor++)
+			ack_bits = 0;
+			for (int i = 0; i < 4; ++i)
 			{
-				if (itor->sequence == ack || sequence_more_recent(itor->sequence, ack, max_sequence))
-					break;
-				int bit_index = bit_index_for_sequence(itor->sequence, ack, max_sequence);
-				if (bit_index <= 31)
-					ack_bits |= 1 << bit_index;
+				unsigned int byte = 0xFF;
+				if (prefix & (1 << i))
+					byte = header[offset++];
+				ack_bits |= byte << (i * 8);
+			}
+			if (prefix & NoAck)
+			{
+				ack = ack_base;
+				ack_bits = 0;
 			}
-			return ack_bits;
+			return offset;
 		}
 
+		// only the packets the ack newly covers are visited, oldest first (the highest bit is the oldest)
 		static void process_ack(unsigned int ack, unsigned int ack_bits,
-			PacketQueue& pending_ack_queue, PacketQueue& acked_queue,
-			std::vector<unsigned int>& acks, unsigned int& acked_packets,
-			float& rtt, unsigned int max_sequence)
+			PacketQueue& pending_ack_queue, AckWindow& ack_window, PacketQueue& acked_queue,
+			std::vector<unsigned int>& acks, std::deque<PacketNotice>& notices, DeliveryRate& delivery_rate, ConnectionMetrics& metrics,
+			float& rtt, unsigned int max_sequence, uint64_t receive_time = 0)
 		{
 			if (pending_ack_queue.empty())
 				return;
 
-			PacketQueue::iterator itor = pending_ack_queue.begin();
-			while (itor != pending_ack_queue.end())
+			uint64_t newly_acked = ack_window.pending(ack, ack_bits);
+			while (newly_acked != 0)
 			{
-				bool acked = false;
-
-				if (itor->sequence == ack)
-				{
-					acked = true;
-				}
-				else if (!sequence_more_recent(itor->sequence, ack, max_sequence))
-				{
-					int bit_index = bit_index_for_sequence(itor->sequence, ack, max_sequence);
-					if (bit_index <= 31)
-						acked = (ack_bits >> bit_index) & 1;
-				}
-
-				if (acked)
-				{
-					rtt += (itor->time - rtt) * 0.1f;
-
-					acked_queue.insert_sorted(*itor, max_sequence);
-					acks.push_back(itor->sequence);
-					acked_packets++;
-					itor = pending_ack_queue.erase(itor);
-				}
-				else
-					++itor;
+				const int back = 63 - CountLeadingZeros(newly_acked);
+				newly_acked &= ~((uint64_t)1 << back);
+				PacketQueue::iterator itor;
+				if (!ack_window.take(sequence_before(ack, back, max_sequence), itor))
+					continue;
+
+				const float sample = receive_time != 0 && itor->timestamp != 0 && receive_time >= itor->timestamp ?
+					(float)(receive_time - itor->timestamp) / 1000000.0f : itor->time;
+				rtt += (sample - rtt) * 0.1f;
+
+				acked_queue.push_back(*itor);
+				acks.push_back(itor->sequence);
+				Notify(notices, *itor, true);
+				delivery_rate.PacketAcked(*itor, receive_time);
+				NET_TRACE_EVENT(TraceAck, itor->sequence, (unsigned int)(sample * 1000000.0f));
+				RecordAcked(metrics, sample);
+				RecordAcked(GetProcessMetrics().totals, sample);
+				pending_ack_queue.erase(itor);
 			}
 		}
 
@@ -806,28 +2421,49 @@ namespace net
 
 		void GetAcks(unsigned int** acks, int& count)
 		{
-			*acks = &this->acks[0];
+			*acks = this->acks.empty() ? NULL : &this->acks[0];
 			count = (int)this->acks.size();
 		}
 
-		unsigned int GetSentPackets() const
+		uint64_t GetSentPackets() const
+		{
+			return metrics.packets_sent.Get();
+		}
+
+		uint64_t GetReceivedPackets() const
+		{
+			return metrics.packets_received.Get();
+		}
+
+		uint64_t GetLostPackets() const
+		{
+			return metrics.packets_lost.Get();
+		}
+
+		uint64_t GetAckedPackets() const
 		{
-			return sent_packets;
+			return metrics.packets_acked.Get();
 		}
 
-		unsigned int GetReceivedPackets() const
+		// datagrams lost at this end, in the socket buffers, kept apart from the lost packets on the path
+		void LocalDrops(uint64_t received, uint64_t sent)
 		{
-			return recv_packets;
+			metrics.receive_drops.Add(received);
+			metrics.send_drops.Add(sent);
+			GetProcessMetrics().totals.receive_drops.Add(received);
+			GetProcessMetrics().totals.send_drops.Add(sent);
 		}
 
-		unsigned int GetLostPackets() const
+		// reliable channel messages queued to be sent again after going unacked too long
+		void Retransmitted(int messages)
 		{
-			return lost_packets;
+			metrics.retransmits.Add(messages);
+			GetProcessMetrics().totals.retransmits.Add(messages);
 		}
 
-		unsigned int GetAckedPackets() const
+		uint64_t GetLocalDrops() const
 		{
-			return acked_packets;
+			return metrics.receive_drops.Get() + metrics.send_drops.Get();
 		}
 
 		float GetSentBandwidth() const
@@ -845,21 +2481,103 @@ namespace net
 			return rtt;
 		}
 
+		// smallest rtt sample over the last ten seconds, the path's delay without queueing
+		float GetMinRoundTripTime() const
+		{
+			return deliveryRate.GetMinRtt();
+		}
+
+		// last delivery rate sample and the windowed max of them (the bottleneck), kbps like the other bandwidths
+		float GetDeliveryRate() const
+		{
+			return deliveryRate.GetRate() * (8 / 1000.0f);
+		}
+
+		float GetBottleneckBandwidth() const
+		{
+			return deliveryRate.GetBandwidth() * (8 / 1000.0f);
+		}
+
+		// bytes the header of the next packet takes
 		int GetHeaderSize() const
 		{
-			return 12;
+			unsigned char header[MaxHeaderSize];
+			return WriteHeader(header);
+		}
+
+		// the header for the next packet, local sequence and the acks for what we have received
+		int WriteHeader(unsigned char* header) const
+		{
+			if (!any_received)
+			{
+				const int bytes = write_header(header, local_sequence, local_sequence, 0xFFFFFFFF, max_sequence);
+				header[0] |= NoAck;
+				return bytes;
+			}
+			return write_header(header, local_sequence, remote_sequence,
+				GenerateAckBits(), max_sequence);
+		}
+
+		int ReadHeader(const unsigned char* header, int size, unsigned int& sequence, unsigned int& ack, unsigned int& ack_bits) const
+		{
+			return read_header(header, size, sequence, ack, ack_bits, remote_sequence, local_sequence, max_sequence);
+		}
+
+		// counters and histograms, safe to read from any thread
+		const ConnectionMetrics& GetMetrics() const
+		{
+			return metrics;
 		}
 
 	protected:
 
+		static void RecordSent(ConnectionMetrics& m, int size, size_t queue_depth)
+		{
+			m.packets_sent.Add();
+			m.bytes_sent.Add(size);
+			m.packet_size.Record(size);
+			m.queue_depth.Record(queue_depth);
+		}
+
+		static void RecordReceived(ConnectionMetrics& m, int size)
+		{
+			m.packets_received.Add();
+			m.bytes_received.Add(size);
+		}
+
+		static void RecordAcked(ConnectionMetrics& m, float time)
+		{
+			m.packets_acked.Add();
+			m.rtt_us.Record((uint64_t)(time * 1000000.0f));
+		}
+
+		static void Notify(std::deque<PacketNotice>& notices, const PacketData& packet, bool acked)
+		{
+			if (packet.token == 0)
+				return;
+			PacketNotice notice;
+			notice.sequence = packet.sequence;
+			notice.token = packet.token;
+			notice.acked = acked;
+			notices.push_back(notice);
+		}
+
+		static int CountLeadingZeros(uint64_t v)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanReverse64(&index, v);
+			return 63 - (int)index;
+#else
+			return __builtin_clzll(v);
+#endif
+		}
+
 		void AdvanceQueueTime(float deltaTime)
 		{
 			for (PacketQueue::iterator itor = sentQueue.begin(); itor != sentQueue.end(); itor++)
 				itor->time += deltaTime;
 
-			for (PacketQueue::iterator itor = receivedQueue.begin(); itor != receivedQueue.end(); itor++)
-				itor->time += deltaTime;
-
 			for (PacketQueue::iterator itor = pendingAckQueue.begin(); itor != pendingAckQueue.end(); itor++)
 				itor->time += deltaTime;
 
@@ -874,21 +2592,19 @@ namespace net
 			while (sentQueue.size() && sentQueue.front().time > rtt_maximum + epsilon)
 				sentQueue.pop_front();
 
-			if (receivedQueue.size())
-			{
-				const unsigned int latest_sequence = receivedQueue.back().sequence;
-				const unsigned int minimum_sequence = latest_sequence >= 34 ? (latest_sequence - 34) : max_sequence - (34 - latest_sequence);
-				while (receivedQueue.size() && !sequence_more_recent(receivedQueue.front().sequence, minimum_sequence, max_sequence))
-					receivedQueue.pop_front();
-			}
-
+			// in ack order rather than sequence order, so a peer acking out of order costs nothing to keep up
+			// with, an entry acked out of order outlives its time by at most rtt_maximum
 			while (ackedQueue.size() && ackedQueue.front().time > rtt_maximum * 2 - epsilon)
 				ackedQueue.pop_front();
 
 			while (pendingAckQueue.size() && pendingAckQueue.front().time > rtt_maximum + epsilon)
 			{
+				NET_TRACE_EVENT(TraceLoss, pendingAckQueue.front().sequence, pendingAckQueue.front().size);
+				ackWindow.remove(pendingAckQueue.front().sequence, pendingAckQueue.begin());
+				Notify(notices, pendingAckQueue.front(), false);
 				pendingAckQueue.pop_front();
-				lost_packets++;
+				metrics.packets_lost.Add();
+				GetProcessMetrics().totals.packets_lost.Add();
 			}
 		}
 
@@ -911,6 +2627,11 @@ namespace net
 			acked_bytes_per_second /= rtt_maximum;
 			sent_bandwidth = sent_bytes_per_second * (8 / 1000.0f);
 			acked_bandwidth = acked_bytes_per_second * (8 / 1000.0f);
+			metrics.rtt.Set(rtt);
+			metrics.sent_bandwidth.Set(sent_bandwidth);
+			metrics.acked_bandwidth.Set(acked_bandwidth);
+			metrics.bottleneck_bandwidth.Set(GetBottleneckBandwidth());
+			metrics.min_rtt.Set(GetMinRoundTripTime());
 		}
 
 	private:
@@ -919,10 +2640,7 @@ namespace net
 		unsigned int local_sequence;		// local sequence number for most recently sent packet
 		unsigned int remote_sequence;		// remote sequence number for most recently received packet
 
-		unsigned int sent_packets;			// total number of packets sent
-		unsigned int recv_packets;			// total number of packets received
-		unsigned int lost_packets;			// total number of packets lost
-		unsigned int acked_packets;			// total number of packets acked
+		ConnectionMetrics metrics;			// packets sent, received, lost and acked, rtt and size histograms (64 bit, atomic)
 
 		float sent_bandwidth;				// approximate sent bandwidth over the last second
 		float acked_bandwidth;				// approximate acked bandwidth over the last second
@@ -930,11 +2648,16 @@ namespace net
 		float rtt_maximum;					// maximum expected round trip time (hard coded to one second for the moment)
 
 		std::vector<unsigned int> acks;		// acked packets from last set of packet receives. cleared each update!
+		std::deque<PacketNotice> notices;	// packets sent with a token that were acked or lost, kept until popped
 
 		PacketQueue sentQueue;				// sent packets used to calculate sent bandwidth (kept until rtt_maximum)
 		PacketQueue pendingAckQueue;		// sent packets which have not been acked yet (kept until rtt_maximum * 2 )
-		PacketQueue receivedQueue;			// received packets for determining acks to send (kept up to most recent recv sequence - 32)
-		PacketQueue ackedQueue;				// acked packets (kept until rtt_maximum * 2)
+		PacketQueue ackedQueue;				// acked packets in ack order (kept until rtt_maximum * 2)
+		AckWindow ackWindow;				// the pending ack queue by sequence, one bit per packet still in flight
+		DeliveryRate deliveryRate;			// delivery rate samples, bottleneck bandwidth and min rtt
+
+		uint64_t received_bits;				// received packets behind remote_sequence, bit n is remote_sequence - 1 - n
+		bool any_received;					// remote_sequence is a packet we have received, not just the starting 0
 	};
 
 	// connection with reliability (seq/ack)
@@ -943,6 +2666,8 @@ namespace net
 	{
 	public:
 
+		static const uint64_t ChannelToken = 0xFFFFFFFFFFFFFFFFULL;	// packet token of the channel system's packets
+
 		ReliableConnection(unsigned int protocolId, float timeout, unsigned int max_sequence = 0xFFFFFFFF)
 			: Connection(protocolId, timeout), reliabilitySystem(max_sequence)
 		{
@@ -962,51 +2687,76 @@ namespace net
 
 		bool SendPacket(const unsigned char data[], int size)
 		{
+			return SendPacket(data, size, 0);
+		}
+
+		// a token other than 0 comes back from PopNotice once the packet is acked or declared lost
+		//  + ChannelToken is taken, it marks the packets FlushMessages sends for the channels
+		bool SendPacket(const unsigned char data[], int size, uint64_t token)
+		{
 #ifdef NET_UNIT_TEST
 			if (reliabilitySystem.GetLocalSequence() & packet_loss_mask)
 			{
-				reliabilitySystem.PacketSent(size);
+				reliabilitySystem.PacketSent(size, 0, token);
 				return true;
 			}
 #endif
-			const int header = 12;
-			unsigned char packet[header + PacketSizeHack];
-			unsigned int seq = reliabilitySystem.GetLocalSequence();
-			unsigned int ack = reliabilitySystem.GetRemoteSequence();
-			unsigned int ack_bits = reliabilitySystem.GenerateAckBits();
-			WriteHeader(packet, seq, ack, ack_bits);
+			unsigned char packet[ReliabilitySystem::MaxHeaderSize + PacketSizeHack];
+			const int header = reliabilitySystem.WriteHeader(packet);
+			if (size < 0 || size > PacketSizeHack - header)
+				return false;	// the connection seals header + data into one PacketSizeHack packet, bigger messages go through the channels
 			std::memcpy(packet + header, data, size);
 			if (!Connection::SendPacket(packet, size + header))
 				return false;
-			reliabilitySystem.PacketSent(size);
+			reliabilitySystem.PacketSent(size, GetTime(), token);
 			return true;
 		}
 
+		// the header is variable length, a packet that does not parse or carries nothing is skipped
 		int ReceivePacket(unsigned char data[], int size)
 		{
-			const int header = 12;
-			if (size <= header)
-				return false;
-			unsigned char packet[header + PacketSizeHack];
-			int received_bytes = Connection::ReceivePacket(packet, size + header);
-			if (received_bytes == 0)
-				return false;
-			if (received_bytes <= header)
+			if (size <= 0)
 				return false;
-			unsigned int packet_sequence = 0;
-			unsigned int packet_ack = 0;
-			unsigned int packet_ack_bits = 0;
-			ReadHeader(packet, packet_sequence, packet_ack, packet_ack_bits);
-			reliabilitySystem.PacketReceived(packet_sequence, received_bytes - header);
-			reliabilitySystem.ProcessAck(packet_ack, packet_ack_bits);
-			std::memcpy(data, packet + header, received_bytes - header);
-			return received_bytes - header;
+			unsigned char packet[ReliabilitySystem::MaxHeaderSize + PacketSizeHack];
+			if (size > PacketSizeHack)
+				size = PacketSizeHack;
+			while (true)
+			{
+				int received_bytes = Connection::ReceivePacket(packet, size + ReliabilitySystem::MaxHeaderSize);
+				if (received_bytes == 0)
+					return false;
+				unsigned int packet_sequence = 0;
+				unsigned int packet_ack = 0;
+				unsigned int packet_ack_bits = 0;
+				const int header = reliabilitySystem.ReadHeader(packet, received_bytes, packet_sequence, packet_ack, packet_ack_bits);
+				if (header < 0 || received_bytes <= header || received_bytes - header > size)
+					continue;
+				reliabilitySystem.PacketReceived(packet_sequence, received_bytes - header);
+				reliabilitySystem.ProcessAck(packet_ack, packet_ack_bits, GetReceiveTime());
+				Notify();
+				std::memcpy(data, packet + header, received_bytes - header);
+				return received_bytes - header;
+			}
 		}
 
 		void Update(float deltaTime)
 		{
 			Connection::Update(deltaTime);
+			reliabilitySystem.Retransmitted(channelSystem.Update(deltaTime, reliabilitySystem.GetRoundTripTime()));
 			reliabilitySystem.Update(deltaTime);
+			Notify();
+
+			// drops in the socket buffers go to their own counters, not to the lost packets
+			uint64_t received_drops = 0;
+			uint64_t sent_drops = 0;
+			TakeSocketDrops(received_drops, sent_drops);
+			reliabilitySystem.LocalDrops(received_drops, sent_drops);
+
+			// the send buffer follows the measured path, it holds a frame's burst at the least
+			const float bandwidth = reliabilitySystem.GetBottleneckBandwidth() * (1000 / 8.0f);
+			const float delay = reliabilitySystem.GetMinRoundTripTime();
+			if (bandwidth > 0.0f && delay > 0.0f)
+				SizeSendBuffer(bandwidth, delay > deltaTime ? delay : deltaTime);
 		}
 
 		int GetHeaderSize() const
@@ -1019,47 +2769,107 @@ namespace net
 			return reliabilitySystem;
 		}
 
-		// unit test controls
+		// message channels, once a channel is added every packet payload belongs to the channel system
+		//  + messages up to MaxMessageSize are split into fragments and put back together on receive
 
-#ifdef NET_UNIT_TEST
-		void SetPacketLossMask(unsigned int mask)
+		int AddChannel(ChannelType type, int weight = 1)
 		{
-			packet_loss_mask = mask;
+			return channelSystem.AddChannel(type, weight);
 		}
-#endif
 
-	protected:
+		// a token other than 0 comes back from PopNotice once the whole message is acked or declared lost
+		//  + higher priority messages go first, an unreliable message unsent after deadline seconds is dropped
+		bool QueueMessage(int channel, const unsigned char data[], int size, uint64_t token = 0, int priority = 0, float deadline = 0.0f)
+		{
+			return channelSystem.Send(channel, data, size, token, priority, deadline);
+		}
 
-		void WriteInteger(unsigned char* data, unsigned int value)
+		// the next message or packet sent with a token that was acked or lost, messages first
+		bool PopNotice(DeliveryNotice& notice)
 		{
-			data[0] = (unsigned char)(value >> 24);
-			data[1] = (unsigned char)((value >> 16) & 0xFF);
-			data[2] = (unsigned char)((value >> 8) & 0xFF);
-			data[3] = (unsigned char)(value & 0xFF);
+			if (channelSystem.PopNotice(notice))
+				return true;
+			if (notices.empty())
+				return false;
+			notice = notices.front();
+			notices.pop_front();
+			return true;
 		}
 
-		void WriteHeader(unsigned char* header, unsigned int sequence, unsigned int ack, unsigned int ack_bits)
+		// send up to max_packets packets of queued messages, returns how many went out
+		//  + a packet a little short of the socket's segment size is padded up to it so the run goes out
+		//    as one segmented send, the channel reader stops at the 0xFF filler
+		//  + while the socket is out of buffer space the messages stay queued, unreliable ones until their deadline
+		int FlushMessages(int max_packets)
 		{
-			WriteInteger(header, sequence);
-			WriteInteger(header + 4, ack);
-			WriteInteger(header + 8, ack_bits);
+			const int MaxPad = 32;
+			unsigned char packet[PacketSizeHack];
+			int sent = 0;
+			while (sent < max_packets && CanSend() && !IsSendBlocked())
+			{
+				const int capacity = PacketSizeHack - reliabilitySystem.GetHeaderSize();
+				int bytes = channelSystem.WritePacket(packet, capacity, reliabilitySystem.GetLocalSequence());
+				const int segment = GetSegmentSize() - GetHeaderSize();
+				if (bytes > 0 && bytes < segment && segment - bytes <= MaxPad && segment <= capacity)
+				{
+					memset(packet + bytes, 0xFF, segment - bytes);
+					bytes = segment;
+				}
+				if (bytes == 0)
+					break;
+				if (!SendPacket(packet, bytes, ChannelToken))
+				{
+					// never sent, the messages in it are settled as lost right away
+					channelSystem.PacketDelivered(reliabilitySystem.GetLocalSequence(), false);
+					break;
+				}
+				sent++;
+			}
+			// out now rather than at the end of the update, the send timestamps are taken above
+			FlushSocket();
+			return sent;
 		}
 
-		void ReadInteger(const unsigned char* data, unsigned int& value)
+		// next message from any channel, 0 when nothing is left this update
+		int ReceiveMessage(int& channel, unsigned char data[], int size)
 		{
-			value = (((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) |
-				((unsigned int)data[2] << 8) | ((unsigned int)data[3]));
+			while (!channelSystem.HasReceived())
+			{
+				unsigned char packet[PacketSizeHack];
+				int bytes = ReceivePacket(packet, sizeof(packet));
+				if (bytes == 0)
+					return 0;
+				channelSystem.ReadPacket(packet, bytes);
+			}
+			return channelSystem.Receive(channel, data, size);
+		}
+
+		ChannelSystem& GetChannelSystem()
+		{
+			return channelSystem;
 		}
 
-		void ReadHeader(const unsigned char* header, unsigned int& sequence, unsigned int& ack, unsigned int& ack_bits)
+		// unit test controls
+
+#ifdef NET_UNIT_TEST
+		void SetPacketLossMask(unsigned int mask)
+		{
+			packet_loss_mask = mask;
+		}
+#endif
+
+	protected:
+
+		virtual void OnStart()
 		{
-			ReadInteger(header, sequence);
-			ReadInteger(header + 4, ack);
-			ReadInteger(header + 8, ack_bits);
+			char name[32];
+			snprintf(name, sizeof(name), "port%d", GetPort());
+			GetMetricsRegistry().Register(name, &reliabilitySystem.GetMetrics());
 		}
 
 		virtual void OnStop()
 		{
+			GetMetricsRegistry().Unregister(&reliabilitySystem.GetMetrics());
 			ClearData();
 		}
 
@@ -1073,6 +2883,27 @@ namespace net
 		void ClearData()
 		{
 			reliabilitySystem.Reset();
+			Notify();
+			channelSystem.Reset();
+		}
+
+		// answered packets go on as they come in, the channels' to the channel system and the rest to PopNotice
+		void Notify()
+		{
+			PacketNotice packet;
+			while (reliabilitySystem.PopNotice(packet))
+			{
+				if (packet.token == ChannelToken)
+				{
+					channelSystem.PacketDelivered(packet.sequence, packet.acked);
+					continue;
+				}
+				DeliveryNotice notice;
+				notice.channel = -1;
+				notice.token = packet.token;
+				notice.acked = packet.acked;
+				notices.push_back(notice);
+			}
 		}
 
 #ifdef NET_UNIT_TEST
@@ -1080,7 +2911,428 @@ namespace net
 #endif
 
 		ReliabilitySystem reliabilitySystem;	// reliability system: manages sequence numbers and acks, tracks network stats etc.
+		ChannelSystem channelSystem;			// message channels multiplexed over the packets
+		std::deque<DeliveryNotice> notices;		// packets sent with a token (not the channels') that were answered
+
+	};
+
+#ifdef NET_UNIT_TEST
+
+	// fuzz targets, each runs one input through code that reads bytes off the wire, in process and without
+	// sockets. NetFuzz.cpp is the libFuzzer entry point, built once per target (its header has the line)
+	//  + each returns the microseconds the input took, an input over the budget is an algorithmic blowup
+	//    (a queue walked per packet, a buffer sized from a field) even though nothing crashed
+	//  + asserts stay on, and under NET_UNIT_TEST the reliability system checks its queues every update
+
+	const uint64_t FuzzTimeBudget = 20000;		// microseconds one input may take
+
+	// sequence spaces the targets pick from, the small ones wrap within an input
+	inline unsigned int FuzzMaxSequence(unsigned char selector)
+	{
+		static const unsigned int max_sequences[4] = { 0xFF, 0xFFFF, 0xFFFFF, 0xFFFFFFFF };
+		return max_sequences[selector & 3];
+	}
+
+	inline unsigned int FuzzRead32(const unsigned char* data)
+	{
+		return ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) | ((unsigned int)data[2] << 8) | data[3];
+	}
+
+	// [max sequence 1][sequence base 4][ack base 4][header...]: the header is read against the bases,
+	// what it decodes to must be in range and must write and read back the same
+	inline uint64_t FuzzHeader(const unsigned char* data, size_t size)
+	{
+		const uint64_t start = GetTime();
+		if (size < 9)
+			return 0;
+		const unsigned int max_sequence = FuzzMaxSequence(data[0]);
+		const unsigned int sequence_base = FuzzRead32(data + 1) & max_sequence;
+		const unsigned int ack_base = FuzzRead32(data + 5) & max_sequence;
+		const int length = size - 9 > 1024 ? 1024 : (int)(size - 9);
+
+		unsigned int sequence = 0;
+		unsigned int ack = 0;
+		unsigned int ack_bits = 0;
+		const int bytes = ReliabilitySystem::read_header(data + 9, length, sequence, ack, ack_bits, sequence_base, ack_base, max_sequence);
+		if (bytes >= 0)
+		{
+			assert(bytes <= length && bytes <= ReliabilitySystem::MaxHeaderSize);
+			assert(sequence <= max_sequence && ack <= max_sequence);
+			unsigned char header[ReliabilitySystem::MaxHeaderSize];
+			const int written = ReliabilitySystem::write_header(header, sequence, ack, ack_bits, max_sequence);
+			unsigned int sequence_again = 0;
+			unsigned int ack_again = 0;
+			unsigned int ack_bits_again = 0;
+			const int read = ReliabilitySystem::read_header(header, written, sequence_again, ack_again, ack_bits_again,
+				sequence_base, ack_base, max_sequence);
+			assert(read == written && sequence_again == sequence && ack_again == ack && ack_bits_again == ack_bits);
+			(void)read;
+		}
+		return GetTime() - start;
+	}
+
+	// [max sequence 1][op 1, operands]...: drives one reliability system the way ReliableConnection does
+	//  + op & 3 == 0: (op >> 2) + 1 packets sent, no more than a quarter of the sequence space per two
+	//    seconds so the space covers what is in flight and acked (the caller's side of the contract)
+	//  + op & 3 == 1: a received packet, its header read off the input, then PacketReceived and ProcessAck
+	//  + op & 3 == 2: (op >> 2) * 10ms go by
+	//  + op & 3 == 3: the notices are drained and the next header is written
+	inline uint64_t FuzzReliability(const unsigned char* data, size_t size)
+	{
+		const uint64_t start = GetTime();
+		if (size < 1)
+			return 0;
+		ReliabilitySystem reliability(FuzzMaxSequence(data[0]));
+		const unsigned int send_limit = reliability.GetMaxSequence() / 4 < 100000 ? reliability.GetMaxSequence() / 4 : 100000;
+		unsigned int sent = 0;
+		float window = 0.0f;
+		uint64_t now = start;
+		size_t offset = 1;
+		while (offset < size)
+		{
+			const unsigned char op = data[offset++];
+			if ((op & 3) == 0)
+			{
+				for (int i = (op >> 2) + 1; i > 0 && sent < send_limit; --i, ++sent)
+					reliability.PacketSent(100, now, sent + 1);
+			}
+			else if ((op & 3) == 1)
+			{
+				unsigned int sequence = 0;
+				unsigned int ack = 0;
+				unsigned int ack_bits = 0;
+				const int bytes = reliability.ReadHeader(data + offset, (int)(size - offset), sequence, ack, ack_bits);
+				if (bytes < 0)
+					break;
+				offset += bytes;
+				reliability.PacketReceived(sequence, 100);
+				reliability.ProcessAck(ack, ack_bits, now);
+			}
+			else if ((op & 3) == 2)
+			{
+				const float deltaTime = (op >> 2) * 0.01f;
+				now += (uint64_t)((op >> 2) * 10000);
+				reliability.Update(deltaTime);
+				window += deltaTime;
+				if (window >= 2.0f)
+				{
+					window = 0.0f;
+					sent = 0;
+				}
+			}
+			else
+			{
+				PacketNotice notice;
+				while (reliability.PopNotice(notice))
+					assert(notice.token != 0);
+				unsigned char header[ReliabilitySystem::MaxHeaderSize];
+				reliability.WriteHeader(header);
+			}
+		}
+		return GetTime() - start;
+	}
+
+	// [channel types 1][packet...]: one received packet split into messages on four channels whose types
+	// come from the first byte, with the fragments put back together and everything delivered drained
+	inline uint64_t FuzzChannels(const unsigned char* data, size_t size)
+	{
+		const uint64_t start = GetTime();
+		if (size < 1)
+			return 0;
+		ChannelSystem channels;
+		for (int i = 0; i < 4; ++i)
+			channels.AddChannel((ChannelType)(((data[0] >> (i * 2)) & 3) % 3), 1);
+		channels.ReadPacket(data + 1, size - 1 > 65535 ? 65535 : (int)(size - 1));
+		int channel = 0;
+		unsigned char message[1024];
+		while (channels.HasReceived())
+			channels.Receive(channel, message, sizeof(message));
+		channels.Update(ReassemblyTimeout + 1.0f, 0.1f);
+		return GetTime() - start;
+	}
+
+	// [metadata packet...]: the file metadata parser, given the packet as a channel hands it over
+	//  + a name it accepts fits the buffer and can't leave ./output
+	inline uint64_t FuzzMetadata(const unsigned char* data, size_t size)
+	{
+		const uint64_t start = GetTime();
+		char name[FILE_MAX_PATH];
+		long fileSize = 0;
+		unsigned long long digest = 0;
+		const int parsed = fileParseMetadata(data, size > 65535 ? 65535 : (int)size, name, &fileSize, &digest);
+		if (parsed != 0)
+			assert(strlen(name) < FILE_MAX_PATH && fileSize >= 0);
+		if (parsed > 0)
+			assert(name[0] != '/' && strchr(name, ':') == NULL && strchr(name, '\\') == NULL);
+		return GetTime() - start;
+	}
+
+	// property check of the reliability system against a reference model, for reworks of the sequence
+	// and ack code to be run against. NetCheck.cpp runs 50 seeds over five sequence spaces (five million
+	// steps, seconds), its header holds the build line
+	//
+	//  + two systems swap header only packets over a network that drops, duplicates and reorders them,
+	//    the model keeps every sequence unwrapped (64 bits) in plain maps and sets
+	//  + after each step: headers read back as written, the remote sequence and ack bits are what was
+	//    received, each packet gets its acked or lost notice exactly when the model says, counters agree
+	//  + the sequences start short of the wrap, so the full 32 bit space wraps too, early in each run
+	//    (many short seeds cross it more often than one long run)
+	//  + the network keeps to the caller's side of the contract: no more than a quarter of the space
+	//    (or 1024) sent a second, nothing delivered with a sequence or an ack older than that
+	//  + false at the first disagreement, which is printed with the seed and step
+
+	class ReliabilityCheck
+	{
+	public:
+
+		ReliabilityCheck(uint64_t seed, unsigned int max_sequence) : a(max_sequence), b(max_sequence)
+		{
+			this->seed = seed;
+			this->max_sequence = max_sequence;
+			space = (uint64_t)max_sequence + 1;
+			limit = space / 4 < 1024 ? space / 4 : 1024;
+			random = seed * 0x9E3779B97F4A7C15ULL + 1;
+			time = 0.0;
+			now = 1000000;
+			step = 0;
+			endpoints[0] = &a;
+			endpoints[1] = &b;
+			start = space > 1000 ? space - 300 : 0;
+			for (int i = 0; i < 2; ++i)
+			{
+				endpoints[i]->next = start;
+				endpoints[i]->system.SetLocalSequence(Wrap(start));
+			}
+		}
+
+		bool Run(int steps)
+		{
+			for (step = 0; step < steps; ++step)
+			{
+				const unsigned int op = Random() % 100;
+				const bool ok = op < 40 ? Send(op & 1) : op < 80 ? Deliver() : Update((Random() % 4) * 0.01f);
+				if (!ok)
+					return false;
+			}
+			return true;
+		}
+
+	private:
+
+		struct Endpoint
+		{
+			explicit Endpoint(unsigned int max_sequence) : system(max_sequence)
+			{
+				next = 0;
+				any_received = false;
+				newest = 0;
+				acked = 0;
+				lost = 0;
+			}
+
+			ReliabilitySystem system;
+			uint64_t next;							// unwrapped sequence of the next packet sent
+			std::map<uint64_t, float> pending;		// sent and neither acked nor lost, with its age
+			std::map<unsigned int, uint64_t> slots;	// the last packet sent into each ack window slot
+			std::deque<double> sends;				// times of the sends in the last second
+			std::set<uint64_t> received;			// from the peer, down to 64 behind the newest
+			bool any_received;
+			uint64_t newest;
+			uint64_t acked;
+			uint64_t lost;
+		};
+
+		struct Packet
+		{
+			int from;
+			uint64_t sequence;
+			std::vector<uint64_t> acks;				// the receiver's packets it acks, as the model has it
+			unsigned char header[ReliabilitySystem::MaxHeaderSize];
+			int size;
+		};
+
+		bool Send(int index)
+		{
+			Endpoint& e = *endpoints[index];
+			while (!e.sends.empty() && time - e.sends.front() > 1.1)
+				e.sends.pop_front();
+			if (e.sends.size() >= limit)
+				return true;
+
+			Packet packet;
+			packet.from = index;
+			packet.sequence = e.next;
+			packet.size = e.system.WriteHeader(packet.header);
+			if (e.any_received)
+			{
+				packet.acks.push_back(e.newest);
+				for (uint64_t n = 1; n <= 32 && n <= e.newest; ++n)
+				{
+					if (e.received.count(e.newest - n))
+						packet.acks.push_back(e.newest - n);
+				}
+			}
+			network.push_back(packet);
+
+			e.system.PacketSent(100, now, e.next + 1);
+			e.pending[e.next] = 0.0f;
+			e.slots[Wrap(e.next) & (AckWindow::Size - 1)] = e.next;
+			e.sends.push_back(time);
+			e.next++;
+			return Expect(e.system.GetLocalSequence() == Wrap(e.next), "local sequence") && Counters(e);
+		}
+
+		// one of the oldest few packets in the network arrives, is lost or arrives and stays to come again
+		bool Deliver()
+		{
+			if (network.empty())
+				return true;
+			const size_t index = Random() % (network.size() < 8 ? network.size() : 8);
+			const Packet packet = network[index];
+			const unsigned int fate = Random() % 10;
+			if (fate != 0)
+				network.erase(network.begin() + index);
+			Endpoint& e = *endpoints[1 - packet.from];
+			if (fate == 1 || packet.sequence + limit < endpoints[packet.from]->next ||
+				(!packet.acks.empty() && packet.acks[0] + limit < e.next))
+				return true;
+
+			unsigned int sequence = 0;
+			unsigned int ack = 0;
+			unsigned int ack_bits = 0;
+			const int bytes = e.system.ReadHeader(packet.header, packet.size, sequence, ack, ack_bits);
+			if (!Expect(bytes == packet.size && sequence == Wrap(packet.sequence), "header read back"))
+				return false;
+
+			e.system.PacketReceived(sequence, 100);
+			if (!e.any_received || packet.sequence > e.newest)
+				e.newest = packet.sequence;
+			e.any_received = true;
+			e.received.insert(packet.sequence);
+			while (*e.received.begin() + 64 < e.newest)
+				e.received.erase(e.received.begin());
+			unsigned int ack_bits_expected = 0;
+			for (int n = 0; n < 32; ++n)
+			{
+				if (e.received.count(e.newest - 1 - n))
+					ack_bits_expected |= 1u << n;
+			}
+			if (!Expect(e.system.GetRemoteSequence() == Wrap(e.newest), "remote sequence") ||
+				!Expect(e.system.GenerateAckBits() == ack_bits_expected, "ack bits"))
+				return false;
+
+			// a packet is acked if it is still pending and nothing sent since has taken its ack window slot
+			std::vector<uint64_t> expected;
+			for (size_t i = 0; i < packet.acks.size(); ++i)
+			{
+				std::map<uint64_t, float>::iterator itor = e.pending.find(packet.acks[i]);
+				if (itor != e.pending.end() && e.slots[Wrap(itor->first) & (AckWindow::Size - 1)] == itor->first)
+				{
+					expected.push_back(itor->first);
+					e.pending.erase(itor);
+					e.acked++;
+				}
+			}
+			e.system.ProcessAck(ack, ack_bits, now);
+			return Notices(e, expected, true);
+		}
+
+		// ages add up in floats the way the system's do, so a packet times out on the same update
+		bool Update(float deltaTime)
+		{
+			time += deltaTime;
+			now += (uint64_t)(deltaTime * 1000000.0f);
+			for (int i = 0; i < 2; ++i)
+			{
+				Endpoint& e = *endpoints[i];
+				std::vector<uint64_t> expected;
+				for (std::map<uint64_t, float>::iterator itor = e.pending.begin(); itor != e.pending.end(); )
+				{
+					itor->second += deltaTime;
+					if (itor->second > 1.0f + 0.001f)
+					{
+						expected.push_back(itor->first);
+						e.pending.erase(itor++);
+						e.lost++;
+					}
+					else
+						++itor;
+				}
+				e.system.Update(deltaTime);
+				if (!Notices(e, expected, false))
+					return false;
+			}
+			return true;
+		}
+
+		bool Notices(Endpoint& e, std::vector<uint64_t>& expected, bool acked)
+		{
+			std::vector<uint64_t> notified;
+			PacketNotice notice;
+			while (e.system.PopNotice(notice))
+			{
+				if (!Expect(notice.acked == acked && notice.sequence == Wrap(notice.token - 1), "notice"))
+					return false;
+				notified.push_back(notice.token - 1);
+			}
+			std::sort(notified.begin(), notified.end());
+			std::sort(expected.begin(), expected.end());
+			return Expect(notified == expected, acked ? "packets acked" : "packets lost") && Counters(e);
+		}
+
+		bool Counters(Endpoint& e)
+		{
+			return Expect(e.system.GetSentPackets() == e.next - start && e.system.GetAckedPackets() == e.acked &&
+				e.system.GetLostPackets() == e.lost, "counters");
+		}
+
+		bool Expect(bool ok, const char* what)
+		{
+			if (!ok)
+				printf("reliability check: %s disagrees with the model (seed %llu, max sequence %u, step %d)\n",
+					what, (unsigned long long)seed, max_sequence, step);
+			return ok;
+		}
+
+		unsigned int Wrap(uint64_t sequence) const
+		{
+			return (unsigned int)(sequence % space);
+		}
+
+		// xorshift64*, the same seed gives the same run everywhere
+		unsigned int Random()
+		{
+			random ^= random >> 12;
+			random ^= random << 25;
+			random ^= random >> 27;
+			return (unsigned int)((random * 0x2545F4914F6CDD1DULL) >> 32);
+		}
+
+		Endpoint a;
+		Endpoint b;
+		Endpoint* endpoints[2];
+		std::deque<Packet> network;
+		uint64_t seed;
+		uint64_t random;
+		unsigned int max_sequence;
+		uint64_t space;
+		uint64_t limit;
+		uint64_t start;
+		double time;
+		uint64_t now;
+		int step;
 	};
+
+	// runs steps of the check above, the check is too big for the stack
+	inline bool CheckReliability(uint64_t seed, int steps, unsigned int max_sequence)
+	{
+		ReliabilityCheck* check = new ReliabilityCheck(seed, max_sequence);
+		const bool ok = check->Run(steps);
+		delete check;
+		return ok;
+	}
+
+#endif
 }
 
 #endif
\ No newline at end of file
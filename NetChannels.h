@@ -0,0 +1,711 @@
+/* Filename: NetChannels.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains the message channels multiplexed over one
+*				reliable connection. Each channel is unreliable, reliable unordered or
+*				reliable ordered with its own message ids, and a weighted fair scheduler
+*				decides which queued messages fill each packet, higher priority messages
+*				first. Unreliable messages can carry a deadline and are dropped unsent once
+*				it passes. Messages too big for a packet are split into fragments and
+*				reassembled on the other side.
+*/
+
+#ifndef NETCHANNELS_H
+#define NETCHANNELS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "NetTrace.h"
+
+namespace net
+{
+	enum ChannelType
+	{
+		ChannelUnreliable,				// sent once, delivered as it arrives
+		ChannelReliableUnordered,		// resent until acked, delivered as it arrives
+		ChannelReliableOrdered			// resent until acked, delivered in send order
+	};
+
+	const int MaxChannels = 8;
+	const int MessageHeaderSize = 5;			// channel (high bit set for a fragment), message id (16 bits), size (16 bits)
+	const int MessageWindow = 1024;				// reliable messages a channel may have outstanding
+	const int PacketHistory = 256;				// sent packets remembered for matching acks to messages
+
+	const int FragmentSize = 320;				// payload of every fragment but the last
+	const int FragmentHeaderSize = 4;			// fragment index, fragment count (16 bits each)
+	const int MaxMessageSize = 4 * 1024 * 1024;
+	const int MaxReassemblies = 8;				// messages being put back together at once
+	const float ReassemblyTimeout = 5.0f;		// seconds without a new fragment before a partial message is dropped
+
+	// what became of a message (or a packet sent around the channels) given a token, handed back once
+	struct DeliveryNotice
+	{
+		int channel;				// -1 for a packet sent without the channels
+		uint64_t token;
+		bool acked;					// false: declared lost, an unreliable message's packet was lost or the connection went down
+	};
+
+	class ChannelSystem
+	{
+	public:
+
+		ChannelSystem()
+		{
+			numChannels = 0;
+			Reset();
+		}
+
+		// channels are configured once, a reset keeps them but drops everything queued
+		int AddChannel(ChannelType type, int weight)
+		{
+			if (numChannels == MaxChannels || weight <= 0)
+				return -1;
+			channels[numChannels].type = type;
+			channels[numChannels].weight = weight;
+			channels[numChannels].Reset();
+			return numChannels++;
+		}
+
+		int GetChannelCount() const
+		{
+			return numChannels;
+		}
+
+		// messages still waiting on their notice are declared lost, the notices themselves are kept
+		void Reset()
+		{
+			for (int i = 0; i < numChannels; ++i)
+			{
+				for (std::map<uint32_t, Notice>::iterator itor = channels[i].waiting.begin(); itor != channels[i].waiting.end(); ++itor)
+					Notify(i, itor->second.token, false);
+				channels[i].Reset();
+			}
+			for (int i = 0; i < PacketHistory; ++i)
+			{
+				history[i].sequence = 0xFFFFFFFF;
+				history[i].messages.clear();
+			}
+			for (int i = 0; i < MaxReassemblies; ++i)
+				reassembly[i].Release();
+			delivered.clear();
+			virtual_time = 0.0;
+			time = 0.0;
+		}
+
+		// messages bigger than a fragment wait in the channel's backlog and are split as the window allows
+		//  + a non zero token comes back from PopNotice once every fragment of the message is acked,
+		//    or once it is declared lost
+		//  + a higher priority message goes out ahead of every lower one, whatever the channel weights
+		//  + an unreliable message still unsent deadline seconds from now is dropped (0: no deadline),
+		//    stale real time data then never takes bandwidth from fresh data
+		bool Send(int channel, const unsigned char data[], int size, uint64_t token = 0, int priority = 0, float deadline = 0.0f)
+		{
+			if (channel < 0 || channel >= numChannels || size < 0 || size > MaxMessageSize)
+				return false;
+			Channel& c = channels[channel];
+			c.backlog.push_back(Outgoing());
+			Outgoing& outgoing = c.backlog.back();
+			outgoing.data.assign(data, data + size);
+			outgoing.next_fragment = 0;
+			outgoing.fragments = size > FragmentSize ? (size + FragmentSize - 1) / FragmentSize : 0;
+			outgoing.token = token;
+			outgoing.first_id = 0;
+			outgoing.priority = priority;
+			outgoing.expiry = c.type == ChannelUnreliable && deadline > 0.0f ? time + deadline : 0.0;
+			Admit(c);
+			return true;
+		}
+
+		// messages waiting to go out (new or due for resend) plus reliable ones not yet acked
+		int GetQueuedMessages(int channel) const
+		{
+			if (channel < 0 || channel >= numChannels)
+				return 0;
+			return (int)(channels[channel].messages.size() + channels[channel].backlog.size());
+		}
+
+		// fill a packet with queued messages, the channel with the highest priority message at its front goes
+		// next, between equal priorities the one with the lowest virtual time
+		//  + a channel's virtual time advances by bytes / weight, so under load each gets its weighted share
+		//  + a message that does not fit in what is left is skipped for this packet, not split
+		//  + expired messages are dropped here, before they take any room
+		int WritePacket(unsigned char packet[], int capacity, unsigned int sequence)
+		{
+			// a packet this far back that never got an answer is taken as lost
+			SentPacket& sent = history[sequence % PacketHistory];
+			Settle(sent, false);
+			sent.sequence = sequence;
+
+			for (int i = 0; i < numChannels; ++i)
+				Admit(channels[i]);
+
+			int bytes = 0;
+			while (true)
+			{
+				int best = -1;
+				int best_priority = 0;
+				for (int i = 0; i < numChannels; ++i)
+				{
+					Message* message = Front(i);
+					if (message == NULL || bytes + MessageHeaderSize + (int)message->data.size() > capacity)
+						continue;
+					if (best < 0 || message->priority > best_priority ||
+						(message->priority == best_priority && channels[i].virtual_time < channels[best].virtual_time))
+					{
+						best = i;
+						best_priority = message->priority;
+					}
+				}
+				if (best < 0)
+					break;
+
+				Channel& c = channels[best];
+				uint32_t id = c.pending.front();
+				c.pending.pop_front();
+				Message& message = c.messages[id];
+				const int size = (int)message.data.size();
+
+				packet[bytes] = (unsigned char)(best | (message.fragment ? 0x80 : 0));
+				packet[bytes + 1] = (unsigned char)(id >> 8);
+				packet[bytes + 2] = (unsigned char)id;
+				packet[bytes + 3] = (unsigned char)(size >> 8);
+				packet[bytes + 4] = (unsigned char)size;
+				if (size > 0)
+					memcpy(packet + bytes + MessageHeaderSize, &message.data[0], size);
+				bytes += MessageHeaderSize + size;
+
+				virtual_time = c.virtual_time;
+				c.virtual_time += (double)(MessageHeaderSize + size) / c.weight;
+
+				if (c.type == ChannelUnreliable)
+				{
+					if (message.tracked)
+						sent.messages.push_back(MessageRef(best, id, message));
+					c.messages.erase(id);
+				}
+				else
+				{
+					message.age = 0.0f;
+					message.queued = false;
+					sent.messages.push_back(MessageRef(best, id, message));
+				}
+			}
+			return bytes;
+		}
+
+		// split a received packet into messages, drop duplicates and hold ordered messages that arrive early
+		void ReadPacket(const unsigned char packet[], int size)
+		{
+			int offset = 0;
+			while (size - offset >= MessageHeaderSize)
+			{
+				const int channel = packet[offset] & 0x7F;
+				const bool fragment = (packet[offset] & 0x80) != 0;
+				const uint16_t wire_id = (uint16_t)((packet[offset + 1] << 8) | packet[offset + 2]);
+				const int length = (packet[offset + 3] << 8) | packet[offset + 4];
+				offset += MessageHeaderSize;
+				if (channel >= numChannels || length > size - offset)
+					return;
+				Receive(channels[channel], channel, wire_id, fragment, packet + offset, length);
+				offset += length;
+			}
+		}
+
+		// pop the next delivered message, 0 when there is none, -1 if it does not fit (it is dropped)
+		int Receive(int& channel, unsigned char data[], int size)
+		{
+			if (delivered.empty())
+				return 0;
+			Delivered& message = delivered.front();
+			int bytes = (int)message.data.size();
+			channel = message.channel;
+			if (bytes > size)
+				bytes = -1;
+			else if (bytes > 0)
+				memcpy(data, &message.data[0], bytes);
+			delivered.pop_front();
+			return bytes;
+		}
+
+		bool HasReceived() const
+		{
+			return !delivered.empty();
+		}
+
+		bool PopNotice(DeliveryNotice& notice)
+		{
+			if (notices.empty())
+				return false;
+			notice = notices.front();
+			notices.pop_front();
+			return true;
+		}
+
+		// messages in acked packets are done, a lost packet only loses its unreliable messages
+		//  (the reliable ones are sent again when their resend time comes)
+		void PacketDelivered(unsigned int sequence, bool acked)
+		{
+			SentPacket& sent = history[sequence % PacketHistory];
+			if (sent.sequence == sequence)
+				Settle(sent, acked);
+		}
+
+		// queue reliable messages that have gone too long without an ack to be sent again, drop unreliable
+		// messages past their deadline, and give up on partial messages that have stopped getting fragments
+		//  + returns how many messages were queued to be sent again
+		int Update(float deltaTime, float rtt)
+		{
+			int resent = 0;
+			time += deltaTime;
+			const float resend_time = rtt * 2.0f > 0.1f ? rtt * 2.0f : 0.1f;
+			for (int i = 0; i < numChannels; ++i)
+			{
+				Channel& c = channels[i];
+				if (c.type == ChannelUnreliable)
+				{
+					for (std::map<uint32_t, Message>::iterator itor = c.messages.begin(); itor != c.messages.end(); )
+					{
+						std::map<uint32_t, Message>::iterator next = itor;
+						++next;
+						if (Expired(itor->second))
+							Drop(i, itor->first);
+						itor = next;
+					}
+					continue;
+				}
+				for (std::map<uint32_t, Message>::iterator itor = c.messages.begin(); itor != c.messages.end(); ++itor)
+				{
+					Message& message = itor->second;
+					if (message.queued)
+						continue;
+					message.age += deltaTime;
+					if (message.age >= resend_time)
+					{
+						Activate(c);
+						message.queued = true;
+						c.pending.push_front(itor->first);
+						NET_TRACE_EVENT(TraceRetransmit, itor->first, (unsigned int)message.data.size());
+						++resent;
+					}
+				}
+			}
+
+			for (int i = 0; i < MaxReassemblies; ++i)
+			{
+				Reassembly& r = reassembly[i];
+				if (!r.active)
+					continue;
+				r.age += deltaTime;
+				if (r.age > ReassemblyTimeout)
+					r.Release();
+			}
+			return resent;
+		}
+
+	private:
+
+		struct Message
+		{
+			std::vector<unsigned char> data;	// fragments carry their fragment header in front
+			float age;							// seconds since last sent
+			bool queued;						// waiting in pending
+			bool fragment;
+			bool tracked;						// counts toward the notice kept under first_id
+			uint32_t first_id;
+			int priority;
+			double expiry;						// time it is dropped at if still unsent, 0 for never
+		};
+
+		struct Outgoing
+		{
+			std::vector<unsigned char> data;
+			int next_fragment;
+			int fragments;						// 0 when the message goes whole
+			uint64_t token;						// 0 when no notice is wanted
+			uint32_t first_id;					// id of the first fragment, the notice is kept under it
+			int priority;
+			double expiry;
+		};
+
+		// a message sent with a token, done when remaining (its fragments, or 1) reaches 0
+		struct Notice
+		{
+			uint64_t token;
+			int remaining;
+		};
+
+		struct Channel
+		{
+			ChannelType type;
+			int weight;
+			double virtual_time;
+			uint32_t send_id;
+			uint32_t receive_id;							// oldest id not yet received (ordered: not yet delivered)
+			std::map<uint32_t, Message> messages;			// queued or unacked, by id (ids never wrap inside the process)
+			std::deque<uint32_t> pending;					// ids to send, resends go to the front
+			std::deque<Outgoing> backlog;					// sent but not given ids yet, waiting for the window
+			std::map<uint32_t, Notice> waiting;				// messages with a token not yet answered, by first id
+			std::vector<unsigned char> received;			// MessageWindow flags from receive_id on
+			std::vector<std::vector<unsigned char> > early;	// ordered messages waiting for a gap to fill
+			std::vector<unsigned char> early_fragment;
+
+			void Reset()
+			{
+				virtual_time = 0.0;
+				send_id = 0;
+				receive_id = 0;
+				messages.clear();
+				pending.clear();
+				backlog.clear();
+				waiting.clear();
+				received.assign(MessageWindow, 0);
+				early.assign(type == ChannelReliableOrdered ? MessageWindow : 0, std::vector<unsigned char>());
+				early_fragment.assign(type == ChannelReliableOrdered ? MessageWindow : 0, 0);
+			}
+
+			bool WindowFull() const
+			{
+				return type != ChannelUnreliable && !messages.empty() && send_id - messages.begin()->first >= (uint32_t)MessageWindow;
+			}
+
+			// the next message to send, stale ids (acked while waiting) are dropped on the way
+			Message* Front()
+			{
+				while (!pending.empty())
+				{
+					std::map<uint32_t, Message>::iterator itor = messages.find(pending.front());
+					if (itor != messages.end() && itor->second.queued)
+						return &itor->second;
+					pending.pop_front();
+				}
+				return NULL;
+			}
+		};
+
+		struct MessageRef
+		{
+			MessageRef(int channel, uint32_t id, const Message& message)
+				: channel(channel), id(id), tracked(message.tracked), first_id(message.first_id) {}
+			int channel;
+			uint32_t id;
+			bool tracked;						// copied, an unreliable message is gone by the time its packet is answered
+			uint32_t first_id;
+		};
+
+		struct SentPacket
+		{
+			unsigned int sequence;
+			std::vector<MessageRef> messages;
+		};
+
+		struct Delivered
+		{
+			int channel;
+			std::vector<unsigned char> data;
+		};
+
+		// one message being put back together, the buffer is sized for the whole message on its first fragment
+		struct Reassembly
+		{
+			bool active;
+			int channel;
+			uint32_t first_id;
+			int fragments;
+			int received_fragments;
+			int size;
+			float age;
+			std::vector<unsigned char> buffer;		// fragments in the order they came in
+			std::vector<uint16_t> order;			// index of each fragment in buffer
+			std::vector<uint64_t> received;			// one bit per fragment
+
+			void Release()
+			{
+				active = false;
+				std::vector<unsigned char>().swap(buffer);
+				std::vector<uint16_t>().swap(order);
+				std::vector<uint64_t>().swap(received);
+			}
+		};
+
+		// a channel coming off idle starts at the current virtual time, it cannot bank credit while idle
+		void Activate(Channel& c)
+		{
+			if (c.pending.empty() && c.virtual_time < virtual_time)
+				c.virtual_time = virtual_time;
+		}
+
+		// give backlog messages (or their next fragments) ids while the window has room
+		void Admit(Channel& c)
+		{
+			while (!c.backlog.empty() && !c.WindowFull())
+			{
+				Outgoing& outgoing = c.backlog.front();
+				Activate(c);
+				if (outgoing.token != 0 && outgoing.next_fragment == 0)
+				{
+					outgoing.first_id = c.send_id;
+					Notice& notice = c.waiting[c.send_id];
+					notice.token = outgoing.token;
+					notice.remaining = outgoing.fragments > 0 ? outgoing.fragments : 1;
+				}
+				Message& message = c.messages[c.send_id];
+				message.age = 0.0f;
+				message.queued = true;
+				message.fragment = outgoing.fragments > 0;
+				message.tracked = outgoing.token != 0;
+				message.first_id = outgoing.first_id;
+				message.priority = outgoing.priority;
+				message.expiry = outgoing.expiry;
+				Enqueue(c, c.send_id++, message.priority);
+
+				if (!message.fragment)
+				{
+					message.data.swap(outgoing.data);
+					c.backlog.pop_front();
+					continue;
+				}
+
+				const int index = outgoing.next_fragment++;
+				const int offset = index * FragmentSize;
+				const int size = (int)outgoing.data.size() - offset < FragmentSize ? (int)outgoing.data.size() - offset : FragmentSize;
+				message.data.resize(FragmentHeaderSize + size);
+				message.data[0] = (unsigned char)(index >> 8);
+				message.data[1] = (unsigned char)index;
+				message.data[2] = (unsigned char)(outgoing.fragments >> 8);
+				message.data[3] = (unsigned char)outgoing.fragments;
+				memcpy(&message.data[FragmentHeaderSize], &outgoing.data[offset], size);
+				if (outgoing.next_fragment == outgoing.fragments)
+					c.backlog.pop_front();
+			}
+		}
+
+		// behind everything of the same or higher priority, ahead of anything lower
+		//  + resends skip this and go to the front, they are the oldest messages waiting
+		void Enqueue(Channel& c, uint32_t id, int priority)
+		{
+			std::deque<uint32_t>::iterator itor = c.pending.end();
+			while (itor != c.pending.begin())
+			{
+				std::map<uint32_t, Message>::iterator previous = c.messages.find(*(itor - 1));
+				if (previous == c.messages.end() || previous->second.priority >= priority)
+					break;
+				--itor;
+			}
+			c.pending.insert(itor, id);
+		}
+
+		bool Expired(const Message& message) const
+		{
+			return message.expiry > 0.0 && time >= message.expiry;
+		}
+
+		// an unreliable message given up on before it went out, its notice (if any) says lost
+		void Drop(int channel, uint32_t id)
+		{
+			std::map<uint32_t, Message>::iterator itor = channels[channel].messages.find(id);
+			if (itor == channels[channel].messages.end())
+				return;
+			if (itor->second.tracked)
+				Count(channel, itor->second.first_id, false);
+			channels[channel].messages.erase(itor);
+		}
+
+		// the channel's next message to send, expired ones are dropped on the way
+		Message* Front(int channel)
+		{
+			Channel& c = channels[channel];
+			Message* message;
+			while ((message = c.Front()) != NULL && Expired(*message))
+				Drop(channel, c.pending.front());
+			return message;
+		}
+
+		// the packet's messages are answered, an acked reliable message is done and counts toward its notice
+		void Settle(SentPacket& sent, bool acked)
+		{
+			for (size_t i = 0; i < sent.messages.size(); ++i)
+			{
+				const MessageRef& ref = sent.messages[i];
+				Channel& c = channels[ref.channel];
+				if (c.type != ChannelUnreliable)
+				{
+					if (!acked || c.messages.erase(ref.id) == 0)
+						continue;	// lost and due for resend, or acked already through another packet
+				}
+				if (ref.tracked)
+					Count(ref.channel, ref.first_id, acked);
+			}
+			sent.messages.clear();
+		}
+
+		void Count(int channel, uint32_t first_id, bool acked)
+		{
+			std::map<uint32_t, Notice>& waiting = channels[channel].waiting;
+			std::map<uint32_t, Notice>::iterator itor = waiting.find(first_id);
+			if (itor == waiting.end())
+				return;
+			if (acked && --itor->second.remaining > 0)
+				return;
+			Notify(channel, itor->second.token, acked);
+			waiting.erase(itor);
+		}
+
+		void Notify(int channel, uint64_t token, bool acked)
+		{
+			DeliveryNotice notice;
+			notice.channel = channel;
+			notice.token = token;
+			notice.acked = acked;
+			notices.push_back(notice);
+		}
+
+		void Deliver(int channel, uint32_t id, bool fragment, const unsigned char* data, int size)
+		{
+			if (fragment)
+			{
+				Reassemble(channel, id, data, size);
+				return;
+			}
+			delivered.push_back(Delivered());
+			delivered.back().channel = channel;
+			delivered.back().data.assign(data, data + size);
+		}
+
+		// copy a fragment into its message's slot, the message is delivered once every fragment is in
+		//  + when every slot is busy the one that has gone longest without a fragment is dropped
+		//  + a slot holds only the fragments that came in, the fragment count is the peer's word and a
+		//    buffer sized from it would let one small packet cost megabytes
+		void Reassemble(int channel, uint32_t id, const unsigned char* data, int size)
+		{
+			if (size < FragmentHeaderSize)
+				return;
+			const int index = (data[0] << 8) | data[1];
+			const int fragments = (data[2] << 8) | data[3];
+			const int length = size - FragmentHeaderSize;
+			if (fragments < 2 || index >= fragments || fragments > (MaxMessageSize + FragmentSize - 1) / FragmentSize ||
+				length > FragmentSize || (index < fragments - 1 && length != FragmentSize))
+				return;
+
+			// unreliable ids are only 16 bits, the others were widened on receive
+			const uint32_t first_id = channels[channel].type == ChannelUnreliable ? (uint16_t)(id - index) : id - index;
+
+			Reassembly* slot = NULL;
+			for (int i = 0; i < MaxReassemblies && slot == NULL; ++i)
+				if (reassembly[i].active && reassembly[i].channel == channel && reassembly[i].first_id == first_id)
+					slot = &reassembly[i];
+
+			if (slot == NULL)
+			{
+				slot = &reassembly[0];
+				for (int i = 0; i < MaxReassemblies; ++i)
+				{
+					if (!reassembly[i].active)
+					{
+						slot = &reassembly[i];
+						break;
+					}
+					if (reassembly[i].age > slot->age)
+						slot = &reassembly[i];
+				}
+				slot->Release();
+				slot->active = true;
+				slot->channel = channel;
+				slot->first_id = first_id;
+				slot->fragments = fragments;
+				slot->received_fragments = 0;
+				slot->size = 0;
+				slot->age = 0.0f;
+				slot->received.assign((fragments + 63) / 64, 0);
+			}
+
+			const uint64_t bit = (uint64_t)1 << (index & 63);
+			if (slot->fragments != fragments || (slot->received[index >> 6] & bit))
+				return;
+			slot->received[index >> 6] |= bit;
+			slot->received_fragments++;
+			slot->age = 0.0f;
+			slot->buffer.insert(slot->buffer.end(), data + FragmentHeaderSize, data + size);
+			slot->order.push_back((uint16_t)index);
+			if (index == fragments - 1)
+				slot->size = index * FragmentSize + length;
+
+			if (slot->received_fragments == fragments)
+			{
+				// every fragment but the last is FragmentSize, they go to their place in the message
+				delivered.push_back(Delivered());
+				delivered.back().channel = channel;
+				std::vector<unsigned char>& message = delivered.back().data;
+				message.resize(slot->size);
+				int offset = 0;
+				for (size_t i = 0; i < slot->order.size(); ++i)
+				{
+					const int position = slot->order[i] * FragmentSize;
+					const int bytes = slot->order[i] == fragments - 1 ? slot->size - position : FragmentSize;
+					if (bytes > 0)
+						memcpy(&message[position], &slot->buffer[offset], bytes);
+					offset += bytes;
+				}
+				slot->Release();
+			}
+		}
+
+		void Receive(Channel& c, int channel, uint16_t wire_id, bool fragment, const unsigned char* data, int size)
+		{
+			if (c.type == ChannelUnreliable)
+			{
+				Deliver(channel, wire_id, fragment, data, size);
+				return;
+			}
+
+			// widen the 16 bit id around the oldest id still expected
+			const int32_t delta = (int16_t)(uint16_t)(wire_id - (uint16_t)c.receive_id);
+			if (delta < 0 || delta >= MessageWindow)
+				return;
+			const uint32_t id = c.receive_id + delta;
+			const int slot = id % MessageWindow;
+			if (c.received[slot])
+				return;
+			c.received[slot] = 1;
+
+			if (c.type == ChannelReliableUnordered)
+			{
+				Deliver(channel, id, fragment, data, size);
+			}
+			else
+			{
+				c.early[slot].assign(data, data + size);
+				c.early_fragment[slot] = fragment;
+			}
+
+			// slide the window past everything that has arrived, ordered messages are delivered as it goes
+			while (c.received[c.receive_id % MessageWindow])
+			{
+				const int next = c.receive_id % MessageWindow;
+				if (c.type == ChannelReliableOrdered)
+				{
+					Deliver(channel, c.receive_id, c.early_fragment[next] != 0,
+						c.early[next].empty() ? NULL : &c.early[next][0], (int)c.early[next].size());
+					c.early[next].clear();
+				}
+				c.received[next] = 0;
+				c.receive_id++;
+			}
+		}
+
+		Channel channels[MaxChannels];
+		int numChannels;
+		double virtual_time;						// virtual time of the last message scheduled
+		double time;								// seconds of updates, deadlines are measured on it
+		SentPacket history[PacketHistory];
+		Reassembly reassembly[MaxReassemblies];
+		std::deque<Delivered> delivered;
+		std::deque<DeliveryNotice> notices;			// tokens answered, until popped
+	};
+}
+
+#endif
@@ -0,0 +1,44 @@
+/* Filename: NetCheck.cpp
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This file contains the runner for the reliability property check in Net.h.
+*				It is not part of the ReliableUDP project, build and run it on its own:
+*
+*				g++ -std=c++14 -O2 NetCheck.cpp FileTransfer.cpp FileFEC.cpp FileCompress.cpp
+*					FileQueue.cpp FileDelta.cpp -lpthread -o netcheck && ./netcheck
+*
+*				(cl /EHsc /O2 with the same files on Windows). It returns 0 when every seed passes,
+*				and 1 with the seed and step of the first disagreement printed otherwise
+*/
+
+#ifndef NET_UNIT_TEST
+#define NET_UNIT_TEST
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Net.h"
+
+/* Function: int main(int argc, char* argv[])
+         * Description: This function runs the check for 50 seeds over each sequence space, the seed count
+         *				and steps per seed can be given as the first and second arguments
+         * Parameters: int argc, char* argv[]
+         * Returns: 0 if the check passed, 1 if it failed
+         */
+int main(int argc, char* argv[]) {
+    const unsigned int spaces[] = { 0xFF, 1000, 0xFFFF, 0x12345, 0xFFFFFFFF };
+    const int seeds = argc > 1 ? atoi(argv[1]) : 50;
+    const int steps = argc > 2 ? atoi(argv[2]) : 20000;
+
+    for (int seed = 1; seed <= seeds; ++seed) {
+        for (int i = 0; i < 5; ++i) {
+            if (!net::CheckReliability(seed, steps, spaces[i])) {
+                return 1;
+            }
+        }
+    }
+    printf("reliability check passed: %d seeds, %d steps each\n", seeds, steps);
+    return 0;
+}
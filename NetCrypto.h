@@ -0,0 +1,717 @@
+/* Filename: NetCrypto.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains the crypto used by the connection: siphash for
+*				handshake cookies, x25519 key exchange and chacha20-poly1305 packet
+*				encryption (batched four blocks at a time with sse2)
+*/
+
+#ifndef NETCRYPTO_H
+#define NETCRYPTO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment( lib, "bcrypt.lib" )
+#else
+#include <errno.h>
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace net
+{
+	// fill a buffer from the os csprng: BCryptGenRandom on windows, getrandom on linux, /dev/urandom elsewhere
+	// (and on kernels without getrandom)
+	//  + every key and cookie secret comes from here, with no source the process stops rather than run on
+	//    predictable keys
+
+	inline void random_bytes(unsigned char* data, int size)
+	{
+		if (size <= 0)
+			return;
+#if defined(_WIN32)
+		if (BCRYPT_SUCCESS(BCryptGenRandom(NULL, data, (ULONG)size, BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+			return;
+#else
+		int filled = 0;
+#if defined(__linux__)
+		while (filled < size)
+		{
+			const ssize_t bytes = getrandom(data + filled, size - filled, 0);
+			if (bytes < 0 && errno == EINTR)
+				continue;
+			if (bytes <= 0)
+				break;
+			filled += (int)bytes;
+		}
+#endif
+		if (filled < size)
+		{
+			FILE* file = fopen("/dev/urandom", "rb");
+			if (file != NULL)
+			{
+				filled += (int)fread(data + filled, 1, size - filled, file);
+				fclose(file);
+			}
+		}
+		if (filled == size)
+			return;
+#endif
+		printf("no os random source, stopping\n");
+		abort();
+	}
+
+	// siphash-2-4: 64 bit keyed hash, short input MAC for cookies and tickets
+
+	inline uint64_t siphash_read64(const unsigned char* p)
+	{
+		return ((uint64_t)p[0]) | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+			((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+	}
+
+	inline uint64_t siphash(const unsigned char key[16], const unsigned char* data, int size)
+	{
+		uint64_t k0 = siphash_read64(key);
+		uint64_t k1 = siphash_read64(key + 8);
+		uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+		uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+		uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+		uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+
+#define SIPROUND \
+		v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+		v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+		v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+		v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32)
+
+		int blocks = size / 8;
+		for (int i = 0; i < blocks; ++i)
+		{
+			uint64_t m = siphash_read64(data + i * 8);
+			v3 ^= m;
+			SIPROUND;
+			SIPROUND;
+			v0 ^= m;
+		}
+
+		uint64_t last = (uint64_t)(size & 0xFF) << 56;
+		const unsigned char* tail = data + blocks * 8;
+		for (int i = 0; i < (size & 7); ++i)
+			last |= (uint64_t)tail[i] << (i * 8);
+
+		v3 ^= last;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= last;
+		v2 ^= 0xFF;
+		SIPROUND;
+		SIPROUND;
+		SIPROUND;
+		SIPROUND;
+
+#undef SIPROUND
+
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
+
+	// constant time compare, for checking MACs
+
+	inline bool secure_equal(const unsigned char* a, const unsigned char* b, int size)
+	{
+		unsigned char difference = 0;
+		for (int i = 0; i < size; ++i)
+			difference |= a[i] ^ b[i];
+		return difference == 0;
+	}
+
+	// chacha20 (rfc 8439)
+	//  + blocks are generated four at a time, one per sse2 lane, and the lanes need not belong to the same packet
+
+	inline uint32_t chacha_read32(const unsigned char* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	inline void chacha_write32(unsigned char* p, uint32_t v)
+	{
+		p[0] = (unsigned char)v;
+		p[1] = (unsigned char)(v >> 8);
+		p[2] = (unsigned char)(v >> 16);
+		p[3] = (unsigned char)(v >> 24);
+	}
+
+	// one keystream block: key, 64 bit nonce (the rfc's 96 bit nonce with the first word zero) and block counter
+	struct ChaChaBlock
+	{
+		uint64_t nonce;
+		uint32_t counter;
+		unsigned char* out;				// 64 bytes
+	};
+
+	inline void chacha20_block(const unsigned char key[32], const ChaChaBlock& block)
+	{
+		uint32_t input[16];
+		input[0] = 0x61707865;
+		input[1] = 0x3320646e;
+		input[2] = 0x79622d32;
+		input[3] = 0x6b206574;
+		for (int i = 0; i < 8; ++i)
+			input[4 + i] = chacha_read32(key + i * 4);
+		input[12] = block.counter;
+		input[13] = 0;
+		input[14] = (uint32_t)block.nonce;
+		input[15] = (uint32_t)(block.nonce >> 32);
+
+		uint32_t x[16];
+		for (int i = 0; i < 16; ++i)
+			x[i] = input[i];
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_QR(a, b, c, d) \
+		x[a] += x[b]; x[d] ^= x[a]; x[d] = CHACHA_ROTL(x[d], 16); \
+		x[c] += x[d]; x[b] ^= x[c]; x[b] = CHACHA_ROTL(x[b], 12); \
+		x[a] += x[b]; x[d] ^= x[a]; x[d] = CHACHA_ROTL(x[d], 8); \
+		x[c] += x[d]; x[b] ^= x[c]; x[b] = CHACHA_ROTL(x[b], 7)
+
+		for (int i = 0; i < 10; ++i)
+		{
+			CHACHA_QR(0, 4, 8, 12);
+			CHACHA_QR(1, 5, 9, 13);
+			CHACHA_QR(2, 6, 10, 14);
+			CHACHA_QR(3, 7, 11, 15);
+			CHACHA_QR(0, 5, 10, 15);
+			CHACHA_QR(1, 6, 11, 12);
+			CHACHA_QR(2, 7, 8, 13);
+			CHACHA_QR(3, 4, 9, 14);
+		}
+
+#undef CHACHA_QR
+#undef CHACHA_ROTL
+
+		for (int i = 0; i < 16; ++i)
+			chacha_write32(block.out + i * 4, x[i] + input[i]);
+	}
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+
+	inline void chacha20_blocks4(const unsigned char key[32], const ChaChaBlock blocks[4])
+	{
+		__m128i input[16];
+		input[0] = _mm_set1_epi32(0x61707865);
+		input[1] = _mm_set1_epi32(0x3320646e);
+		input[2] = _mm_set1_epi32(0x79622d32);
+		input[3] = _mm_set1_epi32(0x6b206574);
+		for (int i = 0; i < 8; ++i)
+			input[4 + i] = _mm_set1_epi32((int)chacha_read32(key + i * 4));
+		input[12] = _mm_setr_epi32((int)blocks[0].counter, (int)blocks[1].counter, (int)blocks[2].counter, (int)blocks[3].counter);
+		input[13] = _mm_setzero_si128();
+		input[14] = _mm_setr_epi32((int)(uint32_t)blocks[0].nonce, (int)(uint32_t)blocks[1].nonce,
+			(int)(uint32_t)blocks[2].nonce, (int)(uint32_t)blocks[3].nonce);
+		input[15] = _mm_setr_epi32((int)(uint32_t)(blocks[0].nonce >> 32), (int)(uint32_t)(blocks[1].nonce >> 32),
+			(int)(uint32_t)(blocks[2].nonce >> 32), (int)(uint32_t)(blocks[3].nonce >> 32));
+
+		__m128i x[16];
+		for (int i = 0; i < 16; ++i)
+			x[i] = input[i];
+
+#define CHACHA_ROTL4(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define CHACHA_QR4(a, b, c, d) \
+		x[a] = _mm_add_epi32(x[a], x[b]); x[d] = _mm_xor_si128(x[d], x[a]); x[d] = CHACHA_ROTL4(x[d], 16); \
+		x[c] = _mm_add_epi32(x[c], x[d]); x[b] = _mm_xor_si128(x[b], x[c]); x[b] = CHACHA_ROTL4(x[b], 12); \
+		x[a] = _mm_add_epi32(x[a], x[b]); x[d] = _mm_xor_si128(x[d], x[a]); x[d] = CHACHA_ROTL4(x[d], 8); \
+		x[c] = _mm_add_epi32(x[c], x[d]); x[b] = _mm_xor_si128(x[b], x[c]); x[b] = CHACHA_ROTL4(x[b], 7)
+
+		for (int i = 0; i < 10; ++i)
+		{
+			CHACHA_QR4(0, 4, 8, 12);
+			CHACHA_QR4(1, 5, 9, 13);
+			CHACHA_QR4(2, 6, 10, 14);
+			CHACHA_QR4(3, 7, 11, 15);
+			CHACHA_QR4(0, 5, 10, 15);
+			CHACHA_QR4(1, 6, 11, 12);
+			CHACHA_QR4(2, 7, 8, 13);
+			CHACHA_QR4(3, 4, 9, 14);
+		}
+
+#undef CHACHA_QR4
+#undef CHACHA_ROTL4
+
+		// transpose: lane l of words i..i+3 becomes 16 contiguous bytes of block l
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128i a = _mm_add_epi32(x[i + 0], input[i + 0]);
+			__m128i b = _mm_add_epi32(x[i + 1], input[i + 1]);
+			__m128i c = _mm_add_epi32(x[i + 2], input[i + 2]);
+			__m128i d = _mm_add_epi32(x[i + 3], input[i + 3]);
+			__m128i t0 = _mm_unpacklo_epi32(a, b);
+			__m128i t1 = _mm_unpacklo_epi32(c, d);
+			__m128i t2 = _mm_unpackhi_epi32(a, b);
+			__m128i t3 = _mm_unpackhi_epi32(c, d);
+			_mm_storeu_si128((__m128i*)(blocks[0].out + i * 4), _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128((__m128i*)(blocks[1].out + i * 4), _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128((__m128i*)(blocks[2].out + i * 4), _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128((__m128i*)(blocks[3].out + i * 4), _mm_unpackhi_epi64(t2, t3));
+		}
+	}
+
+#else
+
+	inline void chacha20_blocks4(const unsigned char key[32], const ChaChaBlock blocks[4])
+	{
+		for (int i = 0; i < 4; ++i)
+			chacha20_block(key, blocks[i]);
+	}
+
+#endif
+
+	// poly1305 (rfc 8439), 26 bit limbs so it needs no 128 bit integers
+
+	class Poly1305
+	{
+	public:
+
+		Poly1305(const unsigned char key[32])
+		{
+			r[0] = (chacha_read32(key + 0)) & 0x3ffffff;
+			r[1] = (chacha_read32(key + 3) >> 2) & 0x3ffff03;
+			r[2] = (chacha_read32(key + 6) >> 4) & 0x3ffc0ff;
+			r[3] = (chacha_read32(key + 9) >> 6) & 0x3f03fff;
+			r[4] = (chacha_read32(key + 12) >> 8) & 0x00fffff;
+			for (int i = 0; i < 5; ++i)
+				h[i] = 0;
+			for (int i = 0; i < 4; ++i)
+				pad[i] = chacha_read32(key + 16 + i * 4);
+		}
+
+		// absorb data, zero padded to a multiple of 16 bytes (all the aead construction needs)
+		void UpdatePadded(const unsigned char* data, int size)
+		{
+			int full = size & ~15;
+			if (full > 0)
+				Blocks(data, full, 1 << 24);
+			if (size > full)
+			{
+				unsigned char block[16];
+				memset(block, 0, sizeof(block));
+				memcpy(block, data + full, size - full);
+				Blocks(block, 16, 1 << 24);
+			}
+		}
+
+		void Finish(unsigned char mac[16])
+		{
+			uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+			uint32_t c;
+
+			c = h1 >> 26; h1 &= 0x3ffffff;
+			h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+			h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+			h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+			h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+			h1 += c;
+
+			// h - p, selected if h >= p
+			uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+			uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+			uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+			uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+			uint32_t g4 = h4 + c - (1 << 26);
+
+			uint32_t mask = (g4 >> 31) - 1;
+			g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+			mask = ~mask;
+			h0 = (h0 & mask) | g0;
+			h1 = (h1 & mask) | g1;
+			h2 = (h2 & mask) | g2;
+			h3 = (h3 & mask) | g3;
+			h4 = (h4 & mask) | g4;
+
+			h0 = (h0 | (h1 << 26)) & 0xffffffff;
+			h1 = ((h1 >> 6) | (h2 << 20)) & 0xffffffff;
+			h2 = ((h2 >> 12) | (h3 << 14)) & 0xffffffff;
+			h3 = ((h3 >> 18) | (h4 << 8)) & 0xffffffff;
+
+			uint64_t f;
+			f = (uint64_t)h0 + pad[0]; chacha_write32(mac + 0, (uint32_t)f);
+			f = (uint64_t)h1 + pad[1] + (f >> 32); chacha_write32(mac + 4, (uint32_t)f);
+			f = (uint64_t)h2 + pad[2] + (f >> 32); chacha_write32(mac + 8, (uint32_t)f);
+			f = (uint64_t)h3 + pad[3] + (f >> 32); chacha_write32(mac + 12, (uint32_t)f);
+		}
+
+	private:
+
+		void Blocks(const unsigned char* m, int size, uint32_t hibit)
+		{
+			const uint32_t r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+			const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+			uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+			while (size >= 16)
+			{
+				h0 += (chacha_read32(m + 0)) & 0x3ffffff;
+				h1 += (chacha_read32(m + 3) >> 2) & 0x3ffffff;
+				h2 += (chacha_read32(m + 6) >> 4) & 0x3ffffff;
+				h3 += (chacha_read32(m + 9) >> 6) & 0x3ffffff;
+				h4 += (chacha_read32(m + 12) >> 8) | hibit;
+
+				uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+				uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+				uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+				uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+				uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+				uint32_t c;
+				c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+				d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+				d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+				d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+				d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+				h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+				h1 += c;
+
+				m += 16;
+				size -= 16;
+			}
+
+			h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+		}
+
+		uint32_t r[5];
+		uint32_t h[5];
+		uint32_t pad[4];
+	};
+
+	// chacha20-poly1305 aead
+	//  + the nonce is a 64 bit packet number: it must never repeat under one key
+	//  + sealed output is the ciphertext followed by a 16 byte tag
+
+	enum { AeadTagSize = 16, AeadKeySize = 32 };
+
+	struct AeadPacket
+	{
+		uint64_t nonce;
+		const unsigned char* ad;		// associated data: authenticated, sent in the clear
+		int ad_size;
+		const unsigned char* in;		// plaintext to seal, or ciphertext (without tag) to open
+		int size;
+		unsigned char* out;				// size bytes (+ AeadTagSize when sealing)
+	};
+
+	inline void aead_tag(const unsigned char poly_key[32], const AeadPacket& packet, const unsigned char* ciphertext, unsigned char tag[16])
+	{
+		Poly1305 poly(poly_key);
+		poly.UpdatePadded(packet.ad, packet.ad_size);
+		poly.UpdatePadded(ciphertext, packet.size);
+		unsigned char lengths[16];
+		for (int i = 0; i < 8; ++i)
+		{
+			lengths[i] = (unsigned char)((uint64_t)packet.ad_size >> (i * 8));
+			lengths[8 + i] = (unsigned char)((uint64_t)packet.size >> (i * 8));
+		}
+		poly.UpdatePadded(lengths, 16);
+		poly.Finish(tag);
+	}
+
+	// keystream for a batch of packets, four blocks per pass wherever they come from
+	//  + block 0 of each packet is its poly1305 key (first 32 bytes), blocks 1.. encrypt the payload
+	inline void aead_xor_batch(const unsigned char key[32], AeadPacket* packets, int count, unsigned char (*poly_keys)[32])
+	{
+		unsigned char stream[4][64];
+		ChaChaBlock lanes[4];
+		int lane_packet[4];
+		int lane_offset[4];
+		int used = 0;
+
+		for (int p = 0; p <= count; ++p)
+		{
+			int blocks = p < count ? 1 + (packets[p].size + 63) / 64 : 0;
+			for (int b = 0; b <= blocks; ++b)
+			{
+				bool flush = (p == count && b == 0 && used > 0) || used == 4;
+				if (flush)
+				{
+					if (used == 4)
+						chacha20_blocks4(key, lanes);
+					else
+						for (int i = 0; i < used; ++i)
+							chacha20_block(key, lanes[i]);
+					for (int i = 0; i < used; ++i)
+					{
+						AeadPacket& target = packets[lane_packet[i]];
+						if (lane_offset[i] < 0)
+						{
+							memcpy(poly_keys[lane_packet[i]], stream[i], 32);
+							continue;
+						}
+						int n = target.size - lane_offset[i] < 64 ? target.size - lane_offset[i] : 64;
+						const unsigned char* in = target.in + lane_offset[i];
+						unsigned char* out = target.out + lane_offset[i];
+						int j = 0;
+						for (; j + 8 <= n; j += 8)
+						{
+							uint64_t a, b;
+							memcpy(&a, in + j, 8);
+							memcpy(&b, stream[i] + j, 8);
+							a ^= b;
+							memcpy(out + j, &a, 8);
+						}
+						for (; j < n; ++j)
+							out[j] = in[j] ^ stream[i][j];
+					}
+					used = 0;
+				}
+				if (b == blocks)
+					break;
+				lanes[used].nonce = packets[p].nonce;
+				lanes[used].counter = (uint32_t)b;
+				lanes[used].out = stream[used];
+				lane_packet[used] = p;
+				lane_offset[used] = b == 0 ? -1 : (b - 1) * 64;
+				used++;
+			}
+		}
+	}
+
+	inline void aead_seal_batch(const unsigned char key[32], AeadPacket* packets, int count)
+	{
+		unsigned char (*poly_keys)[32] = new unsigned char[count > 0 ? count : 1][32];
+		aead_xor_batch(key, packets, count, poly_keys);
+		for (int i = 0; i < count; ++i)
+			aead_tag(poly_keys[i], packets[i], packets[i].out, packets[i].out + packets[i].size);
+		delete[] poly_keys;
+	}
+
+	inline void aead_seal(const unsigned char key[32], AeadPacket& packet)
+	{
+		unsigned char poly_keys[1][32];
+		aead_xor_batch(key, &packet, 1, poly_keys);
+		aead_tag(poly_keys[0], packet, packet.out, packet.out + packet.size);
+	}
+
+	// in holds size bytes of ciphertext followed by the tag, out is written only if the tag checks out
+	inline bool aead_open(const unsigned char key[32], AeadPacket& packet)
+	{
+		unsigned char poly_key[32];
+		ChaChaBlock block;
+		block.nonce = packet.nonce;
+		block.counter = 0;
+		unsigned char first[64];
+		block.out = first;
+		chacha20_block(key, block);
+		memcpy(poly_key, first, 32);
+
+		unsigned char tag[16];
+		aead_tag(poly_key, packet, packet.in, tag);
+		if (!secure_equal(tag, packet.in + packet.size, AeadTagSize))
+			return false;
+
+		unsigned char unused[1][32];
+		aead_xor_batch(key, &packet, 1, unused);
+		return true;
+	}
+
+	// key derivation: 64 bytes of chacha20 keystream under a secret, the context selects independent outputs
+
+	inline void derive_keys(const unsigned char secret[32], uint64_t context, unsigned char out[64])
+	{
+		ChaChaBlock block;
+		block.nonce = context;
+		block.counter = 0;
+		block.out = out;
+		chacha20_block(secret, block);
+	}
+
+	// keyed hash of an input into a new 32 byte secret, binds what is derived from it to the whole input
+	//  + a cascade: the length and then each 8 bytes of input are the context of a derive_keys under the
+	//    previous output, so the result is a prf of the input under the key
+
+	inline void derive_secret(const unsigned char key[32], const unsigned char* data, int size, unsigned char out[32])
+	{
+		unsigned char keys[64];
+		derive_keys(key, (uint64_t)size, keys);
+		for (int i = 0; i < size; i += 8)
+		{
+			uint64_t word = 0;
+			for (int j = 0; j < 8 && i + j < size; ++j)
+				word |= (uint64_t)data[i + j] << (j * 8);
+			derive_keys(keys, word, keys);
+		}
+		memcpy(out, keys, 32);
+	}
+
+	// x25519 (rfc 7748) key exchange, after tweetnacl
+
+	typedef int64_t x25519_field[16];
+
+	inline void x25519_carry(x25519_field o)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			o[i] += (int64_t)1 << 16;
+			int64_t c = o[i] >> 16;
+			o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+			o[i] -= c * ((int64_t)1 << 16);
+		}
+	}
+
+	inline void x25519_select(x25519_field p, x25519_field q, int b)
+	{
+		int64_t c = ~((int64_t)b - 1);
+		for (int i = 0; i < 16; ++i)
+		{
+			int64_t t = c & (p[i] ^ q[i]);
+			p[i] ^= t;
+			q[i] ^= t;
+		}
+	}
+
+	inline void x25519_pack(unsigned char* o, const x25519_field n)
+	{
+		x25519_field m, t;
+		for (int i = 0; i < 16; ++i)
+			t[i] = n[i];
+		x25519_carry(t);
+		x25519_carry(t);
+		x25519_carry(t);
+		for (int j = 0; j < 2; ++j)
+		{
+			m[0] = t[0] - 0xffed;
+			for (int i = 1; i < 15; ++i)
+			{
+				m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+				m[i - 1] &= 0xffff;
+			}
+			m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+			int b = (int)((m[15] >> 16) & 1);
+			m[14] &= 0xffff;
+			x25519_select(t, m, 1 - b);
+		}
+		for (int i = 0; i < 16; ++i)
+		{
+			o[2 * i] = (unsigned char)(t[i] & 0xff);
+			o[2 * i + 1] = (unsigned char)(t[i] >> 8);
+		}
+	}
+
+	inline void x25519_unpack(x25519_field o, const unsigned char* n)
+	{
+		for (int i = 0; i < 16; ++i)
+			o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+		o[15] &= 0x7fff;
+	}
+
+	inline void x25519_add(x25519_field o, const x25519_field a, const x25519_field b)
+	{
+		for (int i = 0; i < 16; ++i)
+			o[i] = a[i] + b[i];
+	}
+
+	inline void x25519_sub(x25519_field o, const x25519_field a, const x25519_field b)
+	{
+		for (int i = 0; i < 16; ++i)
+			o[i] = a[i] - b[i];
+	}
+
+	inline void x25519_mul(x25519_field o, const x25519_field a, const x25519_field b)
+	{
+		int64_t t[31];
+		for (int i = 0; i < 31; ++i)
+			t[i] = 0;
+		for (int i = 0; i < 16; ++i)
+			for (int j = 0; j < 16; ++j)
+				t[i + j] += a[i] * b[j];
+		for (int i = 0; i < 15; ++i)
+			t[i] += 38 * t[i + 16];
+		for (int i = 0; i < 16; ++i)
+			o[i] = t[i];
+		x25519_carry(o);
+		x25519_carry(o);
+	}
+
+	inline void x25519_invert(x25519_field o, const x25519_field in)
+	{
+		x25519_field c;
+		for (int i = 0; i < 16; ++i)
+			c[i] = in[i];
+		for (int a = 253; a >= 0; --a)
+		{
+			x25519_mul(c, c, c);
+			if (a != 2 && a != 4)
+				x25519_mul(c, c, in);
+		}
+		for (int i = 0; i < 16; ++i)
+			o[i] = c[i];
+	}
+
+	// q = n * p, all 32 byte little endian
+	inline void x25519(unsigned char q[32], const unsigned char n[32], const unsigned char p[32])
+	{
+		static const x25519_field a24 = { 0xDB41, 1 };
+		unsigned char z[32];
+		x25519_field x, a, b, c, d, e, f;
+
+		for (int i = 0; i < 31; ++i)
+			z[i] = n[i];
+		z[31] = (n[31] & 127) | 64;
+		z[0] &= 248;
+
+		x25519_unpack(x, p);
+		for (int i = 0; i < 16; ++i)
+		{
+			b[i] = x[i];
+			d[i] = a[i] = c[i] = 0;
+		}
+		a[0] = d[0] = 1;
+
+		for (int i = 254; i >= 0; --i)
+		{
+			int r = (z[i >> 3] >> (i & 7)) & 1;
+			x25519_select(a, b, r);
+			x25519_select(c, d, r);
+			x25519_add(e, a, c);
+			x25519_sub(a, a, c);
+			x25519_add(c, b, d);
+			x25519_sub(b, b, d);
+			x25519_mul(d, e, e);
+			x25519_mul(f, a, a);
+			x25519_mul(a, c, a);
+			x25519_mul(c, b, e);
+			x25519_add(e, a, c);
+			x25519_sub(a, a, c);
+			x25519_mul(b, a, a);
+			x25519_sub(c, d, f);
+			x25519_mul(a, c, a24);
+			x25519_add(a, a, d);
+			x25519_mul(c, c, a);
+			x25519_mul(a, d, f);
+			x25519_mul(d, b, x);
+			x25519_mul(b, e, e);
+			x25519_select(a, b, r);
+			x25519_select(c, d, r);
+		}
+
+		x25519_invert(c, c);
+		x25519_mul(a, a, c);
+		x25519_pack(q, a);
+	}
+
+	inline void x25519_public_key(unsigned char public_key[32], const unsigned char private_key[32])
+	{
+		static const unsigned char base[32] = { 9 };
+		x25519(public_key, private_key, base);
+	}
+}
+
+#endif
@@ -0,0 +1,67 @@
+/* Filename: NetFuzz.cpp
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This file contains the libFuzzer entry point for the fuzz targets in Net.h.
+*				It is not part of the ReliableUDP project, each target is a build of its own:
+*
+*				clang++ -std=c++14 -g -O1 -fsanitize=fuzzer,address,undefined -DFUZZ_TARGET=FuzzHeader
+*					NetFuzz.cpp FileTransfer.cpp FileFEC.cpp FileCompress.cpp FileQueue.cpp FileDelta.cpp
+*					-lpthread -o fuzz_header
+*
+*				FUZZ_TARGET is FuzzHeader, FuzzReliability, FuzzChannels or FuzzMetadata. Built
+*				with -DFUZZ_STANDALONE in place of -fsanitize=fuzzer (any compiler) it runs the
+*				files named on its command line through the target, to replay what a fuzzer found
+*/
+
+#ifndef NET_UNIT_TEST
+#define NET_UNIT_TEST
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "Net.h"
+
+#ifndef FUZZ_TARGET
+#define FUZZ_TARGET FuzzReliability
+#endif
+
+// an input that crashes nothing but takes over the budget is reported as a crash too
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (net::FUZZ_TARGET(data, size) > net::FuzzTimeBudget) {
+        printf("input of %d bytes took longer than %llu us\n", (int)size, (unsigned long long)net::FuzzTimeBudget);
+        abort();
+    }
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+/* Function: int main(int argc, char* argv[])
+         * Description: This function runs each file named on the command line through the target
+         * Parameters: int argc, char* argv[]
+         * Returns: 0 once every input has run, 1 if one could not be read
+         */
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        FILE* file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            printf("Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<unsigned char> input;
+        unsigned char buffer[4096];
+        size_t bytes;
+        while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            input.insert(input.end(), buffer, buffer + bytes);
+        }
+        fclose(file);
+        LLVMFuzzerTestOneInput(input.empty() ? NULL : &input[0], input.size());
+        printf("%s: ok\n", argv[i]);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,288 @@
+/* Filename: NetGso.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains UDP segmentation offload for the socket on Linux.
+*				Back to back sends of the same size to the same address are gathered into
+*				one buffer and handed over with a single sendmsg, the kernel or the NIC cuts
+*				it back into datagrams. On receive UDP_GRO lets the kernel hand over a run
+*				of same size datagrams in one call and they are split here. A batch the
+*				kernel has no buffer space for is held and offered again on the next flush.
+*/
+
+#ifndef NETGSO_H
+#define NETGSO_H
+
+#if defined(__linux__) && !defined(NET_NO_GSO)
+#include <netinet/udp.h>
+#if defined(UDP_SEGMENT) && defined(UDP_GRO) && defined(SOL_UDP)
+#define NET_GSO 1
+#endif
+#endif
+
+#ifdef NET_GSO
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <vector>
+
+#include "NetMetrics.h"
+
+namespace net
+{
+	class GsoSocket
+	{
+	public:
+
+		static const int MaxSegments = 64;			// the kernel's limit on segments per send
+		static const int MaxBytes = 65000;			// one UDP datagram before it is segmented
+
+		GsoSocket()
+		{
+			fd = -1;
+			sending = false;
+			receiving = false;
+			addressLength = 0;
+			ClearBatch();
+			receiveOffset = 0;
+			receiveSize = 0;
+			receiveSegment = 0;
+			receiveOverflow = 0;
+		}
+
+		// turns segmentation on if the kernel knows UDP_SEGMENT, and GRO if asked for
+		bool Open(int socket, bool gro)
+		{
+			fd = socket;
+			int value = 0;
+			socklen_t length = sizeof(value);
+			sending = getsockopt(fd, SOL_UDP, UDP_SEGMENT, &value, &length) == 0;
+
+			int one = 1;
+			receiving = gro && setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0;
+			if (sending)
+				sendBuffer.resize(MaxBytes);
+			if (receiving)
+				receiveBuffer.resize(MaxBytes);
+			receiveOffset = 0;
+			receiveSize = 0;
+			receiveOverflow = 0;
+			return sending || receiving;
+		}
+
+		void Close()
+		{
+			Flush();
+			sending = false;
+			receiving = false;
+			fd = -1;
+		}
+
+		bool IsSending() const
+		{
+			return sending;
+		}
+
+		bool IsReceiving() const
+		{
+			return receiving;
+		}
+
+		// size of the segments being gathered, 0 when the next send starts a new batch
+		int GetSegmentSize() const
+		{
+			return count > 0 && !closed && !blocked ? segment : 0;
+		}
+
+		// a batch the kernel refused for lack of buffer space is waiting for the next flush
+		bool IsBlocked() const
+		{
+			return blocked;
+		}
+
+		// adds a datagram to the batch, one that does not fit the batch sends the batch first
+		//  + only the last segment may be shorter, it closes the batch
+		//  + false if the kernel had no room for the batch, it is held for the next flush and the datagram is not taken
+		bool Send(const sockaddr_storage& destination, int destinationLength, const void* data, int size)
+		{
+			if (count > 0 && (blocked || closed || size > segment || count == MaxSegments || used + size > MaxBytes ||
+				destinationLength != addressLength || memcmp(&destination, &address, destinationLength) != 0))
+			{
+				Flush();
+				if (blocked)
+					return false;
+			}
+			if (count == 0)
+			{
+				memcpy(&address, &destination, destinationLength);
+				addressLength = destinationLength;
+				segment = size;
+			}
+			memcpy(&sendBuffer[used], data, size);
+			used += size;
+			count++;
+			closed = size < segment;
+			return true;
+		}
+
+		// sends the batch, one datagram goes as is and a run goes with a UDP_SEGMENT control message
+		//  + when the kernel is out of buffer space the batch is kept and IsBlocked says so
+		void Flush()
+		{
+			if (count == 0 || fd < 0)
+				return;
+			if (count == 1)
+			{
+				const int sent = (int)sendto(fd, (const char*)&sendBuffer[0], used, 0, (const sockaddr*)&address, addressLength);
+				GetProcessMetrics().send_syscalls.Add();
+				blocked = sent < 0 && Refused();
+				if (!blocked)
+					ClearBatch();
+				return;
+			}
+
+			iovec vector;
+			vector.iov_base = &sendBuffer[0];
+			vector.iov_len = used;
+			char control[CMSG_SPACE(sizeof(uint16_t))];
+			memset(control, 0, sizeof(control));
+			msghdr header;
+			memset(&header, 0, sizeof(header));
+			header.msg_name = &address;
+			header.msg_namelen = addressLength;
+			header.msg_iov = &vector;
+			header.msg_iovlen = 1;
+			header.msg_control = control;
+			header.msg_controllen = sizeof(control);
+			cmsghdr* message = CMSG_FIRSTHDR(&header);
+			message->cmsg_level = SOL_UDP;
+			message->cmsg_type = UDP_SEGMENT;
+			message->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			const uint16_t segmentSize = (uint16_t)segment;
+			memcpy(CMSG_DATA(message), &segmentSize, sizeof(segmentSize));
+
+			const int sent = (int)sendmsg(fd, &header, 0);
+			GetProcessMetrics().send_syscalls.Add();
+			blocked = sent < 0 && Refused();
+			if (blocked)
+				return;
+			if (sent < 0)
+			{
+				// the route or the device cannot segment, send this batch one by one and stop gathering
+				sending = false;
+				for (int offset = 0; offset < used; offset += segment)
+				{
+					const int size = used - offset < segment ? used - offset : segment;
+					sendto(fd, (const char*)&sendBuffer[offset], size, 0, (const sockaddr*)&address, addressLength);
+					GetProcessMetrics().send_syscalls.Add();
+				}
+			}
+			ClearBatch();
+		}
+
+		// the next datagram, split off the last coalesced receive or read fresh, 0 when there are none
+		//  + stamp is the kernel's receive time of the run when the socket has SO_TIMESTAMPNS on
+		//  + overflow is the socket's count of datagrams dropped on a full receive buffer (SO_RXQ_OVFL)
+		int Receive(sockaddr_storage& from, void* data, int size, timespec& stamp, uint32_t& overflow)
+		{
+			if (receiveOffset >= receiveSize)
+			{
+				iovec vector;
+				vector.iov_base = &receiveBuffer[0];
+				vector.iov_len = receiveBuffer.size();
+				char control[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+				msghdr header;
+				memset(&header, 0, sizeof(header));
+				header.msg_name = &receiveFrom;
+				header.msg_namelen = sizeof(receiveFrom);
+				header.msg_iov = &vector;
+				header.msg_iovlen = 1;
+				header.msg_control = control;
+				header.msg_controllen = sizeof(control);
+
+				const int bytes = (int)recvmsg(fd, &header, 0);
+				GetProcessMetrics().recv_syscalls.Add();
+				if (bytes <= 0)
+					return 0;
+
+				// without the control message the kernel did not coalesce, it is one datagram
+				receiveSegment = bytes;
+				receiveStamp.tv_sec = 0;
+				receiveStamp.tv_nsec = 0;
+				for (cmsghdr* message = CMSG_FIRSTHDR(&header); message != NULL; message = CMSG_NXTHDR(&header, message))
+				{
+					if (message->cmsg_level == SOL_UDP && message->cmsg_type == UDP_GRO)
+					{
+						int segmentSize = 0;
+						memcpy(&segmentSize, CMSG_DATA(message), sizeof(segmentSize));
+						if (segmentSize > 0)
+							receiveSegment = segmentSize;
+					}
+#ifdef SO_TIMESTAMPNS
+					if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS)
+						memcpy(&receiveStamp, CMSG_DATA(message), sizeof(receiveStamp));
+#endif
+#ifdef SO_RXQ_OVFL
+					if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL)
+						memcpy(&receiveOverflow, CMSG_DATA(message), sizeof(receiveOverflow));
+#endif
+				}
+				receiveOffset = 0;
+				receiveSize = bytes;
+			}
+
+			int bytes = receiveSize - receiveOffset < receiveSegment ? receiveSize - receiveOffset : receiveSegment;
+			from = receiveFrom;
+			stamp = receiveStamp;
+			overflow = receiveOverflow;
+			memcpy(data, &receiveBuffer[receiveOffset], bytes < size ? bytes : size);
+			receiveOffset += bytes;
+			return bytes < size ? bytes : size;
+		}
+
+	private:
+
+		void ClearBatch()
+		{
+			count = 0;
+			used = 0;
+			segment = 0;
+			closed = false;
+			blocked = false;
+		}
+
+		// the kernel is out of buffer space, as opposed to a send that can never work
+		static bool Refused()
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+		}
+
+		int fd;
+		bool sending;
+		bool receiving;
+
+		std::vector<unsigned char> sendBuffer;
+		sockaddr_storage address;
+		int addressLength;
+		int segment;
+		int count;
+		int used;
+		bool closed;
+		bool blocked;						// the batch was refused and is held for the next flush
+
+		std::vector<unsigned char> receiveBuffer;
+		sockaddr_storage receiveFrom;
+		timespec receiveStamp;
+		uint32_t receiveOverflow;
+		int receiveOffset;
+		int receiveSize;
+		int receiveSegment;
+	};
+}
+
+#endif
+
+#endif
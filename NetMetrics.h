@@ -0,0 +1,635 @@
+/* Filename: NetMetrics.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains the 64 bit counters, gauges and histograms
+*				used to track connection and process statistics, and the scrape
+*				functions that export them as Prometheus text or JSON
+*/
+
+#ifndef NETMETRICS_H
+#define NETMETRICS_H
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace net
+{
+	// counter: monotonic 64 bit value, updated with relaxed atomics so any thread may read it
+
+	class Counter
+	{
+	public:
+
+		Counter() : value(0) {}
+
+		void Add(uint64_t amount = 1)
+		{
+			value.fetch_add(amount, std::memory_order_relaxed);
+		}
+
+		uint64_t Get() const
+		{
+			return value.load(std::memory_order_relaxed);
+		}
+
+		void Reset()
+		{
+			value.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+
+		std::atomic<uint64_t> value;
+	};
+
+	// gauge: last written value, single writer
+
+	class Gauge
+	{
+	public:
+
+		Gauge() : value(0.0) {}
+
+		void Set(double v)
+		{
+			value.store(v, std::memory_order_relaxed);
+		}
+
+		double Get() const
+		{
+			return value.load(std::memory_order_relaxed);
+		}
+
+	private:
+
+		std::atomic<double> value;
+	};
+
+	// histogram: power of two buckets, bucket i counts values <= 2^i (last bucket is +Inf)
+
+	class Histogram
+	{
+	public:
+
+		enum { NumBuckets = 32 };
+
+		Histogram()
+		{
+			Reset();
+		}
+
+		void Record(uint64_t v)
+		{
+			buckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+			sum.fetch_add(v, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void Reset()
+		{
+			for (int i = 0; i < NumBuckets; ++i)
+				buckets[i].store(0, std::memory_order_relaxed);
+			sum.store(0, std::memory_order_relaxed);
+			count.store(0, std::memory_order_relaxed);
+		}
+
+		uint64_t GetBucket(int index) const
+		{
+			return buckets[index].load(std::memory_order_relaxed);
+		}
+
+		uint64_t GetSum() const
+		{
+			return sum.load(std::memory_order_relaxed);
+		}
+
+		uint64_t GetCount() const
+		{
+			return count.load(std::memory_order_relaxed);
+		}
+
+		static uint64_t BucketBound(int index)
+		{
+			return (uint64_t)1 << index;
+		}
+
+		static int BucketIndex(uint64_t v)
+		{
+			if (v <= 1)
+				return 0;
+			int index = 64 - CountLeadingZeros(v - 1);
+			return index < NumBuckets - 1 ? index : NumBuckets - 1;
+		}
+
+	private:
+
+		static int CountLeadingZeros(uint64_t v)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanReverse64(&index, v);
+			return 63 - (int)index;
+#else
+			return __builtin_clzll(v);
+#endif
+		}
+
+		std::atomic<uint64_t> buckets[NumBuckets];
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> count;
+	};
+
+	// statistics for a single connection (owned by its reliability system, reset with it)
+
+	struct ConnectionMetrics
+	{
+		Counter packets_sent;
+		Counter packets_received;
+		Counter packets_acked;
+		Counter packets_lost;
+		Counter bytes_sent;
+		Counter bytes_received;
+		Counter retransmits;				// reliable channel messages sent again after going unacked
+		Counter receive_drops;				// datagrams the kernel dropped on a full receive buffer
+		Counter send_drops;					// datagrams the kernel refused for lack of buffer space
+
+		Gauge rtt;							// smoothed round trip time in seconds
+		Gauge sent_bandwidth;				// kbps
+		Gauge acked_bandwidth;				// kbps
+		Gauge bottleneck_bandwidth;			// kbps, windowed max of the delivery rate samples
+		Gauge min_rtt;						// seconds, windowed min of the rtt samples
+
+		Histogram rtt_us;					// per ack rtt samples in microseconds
+		Histogram packet_size;				// payload bytes per sent packet
+		Histogram queue_depth;				// packets pending ack at send time
+
+		void Reset()
+		{
+			packets_sent.Reset();
+			packets_received.Reset();
+			packets_acked.Reset();
+			packets_lost.Reset();
+			bytes_sent.Reset();
+			bytes_received.Reset();
+			retransmits.Reset();
+			receive_drops.Reset();
+			send_drops.Reset();
+			rtt.Set(0.0);
+			sent_bandwidth.Set(0.0);
+			acked_bandwidth.Set(0.0);
+			bottleneck_bandwidth.Set(0.0);
+			min_rtt.Set(0.0);
+			rtt_us.Reset();
+			packet_size.Reset();
+			queue_depth.Reset();
+		}
+	};
+
+	// statistics for the whole process (never reset)
+
+	struct ProcessMetrics
+	{
+		ConnectionMetrics totals;			// sum over every connection ever started
+
+		Counter send_syscalls;
+		Counter recv_syscalls;
+		Histogram syscalls_per_batch;		// receive calls needed to drain the socket each frame
+	};
+
+	inline ProcessMetrics& GetProcessMetrics()
+	{
+		static ProcessMetrics metrics;
+		return metrics;
+	}
+
+	// registry of live connections, read by the scrape functions
+	//  + registration takes a lock, the hot path never does
+
+	class MetricsRegistry
+	{
+	public:
+
+		void Register(const char* name, const ConnectionMetrics* metrics)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Entry entry;
+			entry.name = name;
+			entry.metrics = metrics;
+			entries.push_back(entry);
+		}
+
+		void Unregister(const ConnectionMetrics* metrics)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				if (entries[i].metrics == metrics)
+				{
+					entries.erase(entries.begin() + i);
+					return;
+				}
+			}
+		}
+
+		// text exposition format: each family once, its HELP and TYPE lines then a sample for the process
+		// totals and one for each live connection
+		void WritePrometheus(std::string& out)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ProcessMetrics& process = GetProcessMetrics();
+
+			WriteFamily(out, "rudp_send_syscalls_total", "counter", "datagram send calls");
+			WriteCounter(out, "rudp_send_syscalls_total", "", process.send_syscalls);
+			WriteFamily(out, "rudp_recv_syscalls_total", "counter", "datagram receive calls");
+			WriteCounter(out, "rudp_recv_syscalls_total", "", process.recv_syscalls);
+			WriteFamily(out, "rudp_syscalls_per_batch", "histogram", "receive calls needed to drain the socket each frame");
+			WriteHistogram(out, "rudp_syscalls_per_batch", "", process.syscalls_per_batch, 1.0);
+
+			// the families each connection exports, in scrape order
+			static const CounterFamily counters[] =
+			{
+				{ "rudp_packets_sent_total", "packets sent", &ConnectionMetrics::packets_sent },
+				{ "rudp_packets_received_total", "packets received", &ConnectionMetrics::packets_received },
+				{ "rudp_packets_acked_total", "sent packets acked by the peer", &ConnectionMetrics::packets_acked },
+				{ "rudp_packets_lost_total", "sent packets taken as lost on the path", &ConnectionMetrics::packets_lost },
+				{ "rudp_bytes_sent_total", "payload bytes sent", &ConnectionMetrics::bytes_sent },
+				{ "rudp_bytes_received_total", "payload bytes received", &ConnectionMetrics::bytes_received },
+				{ "rudp_retransmits_total", "reliable channel messages sent again after going unacked", &ConnectionMetrics::retransmits },
+				{ "rudp_receive_drops_total", "datagrams the kernel dropped on a full receive buffer", &ConnectionMetrics::receive_drops },
+				{ "rudp_send_drops_total", "datagrams the kernel refused for lack of buffer space", &ConnectionMetrics::send_drops }
+			};
+
+			static const GaugeFamily gauges[] =
+			{
+				{ "rudp_rtt_seconds", "smoothed round trip time", &ConnectionMetrics::rtt },
+				{ "rudp_sent_bandwidth_kbps", "bandwidth sent", &ConnectionMetrics::sent_bandwidth },
+				{ "rudp_acked_bandwidth_kbps", "bandwidth acked by the peer", &ConnectionMetrics::acked_bandwidth },
+				{ "rudp_bottleneck_bandwidth_kbps", "windowed max of the delivery rate samples", &ConnectionMetrics::bottleneck_bandwidth },
+				{ "rudp_min_rtt_seconds", "windowed min of the rtt samples", &ConnectionMetrics::min_rtt }
+			};
+
+			static const HistogramFamily histograms[] =
+			{
+				{ "rudp_rtt_sample_seconds", "per ack round trip time samples", &ConnectionMetrics::rtt_us, 0.000001 },
+				{ "rudp_packet_size_bytes", "payload bytes per sent packet", &ConnectionMetrics::packet_size, 1.0 },
+				{ "rudp_queue_depth_packets", "packets pending ack at send time", &ConnectionMetrics::queue_depth, 1.0 }
+			};
+
+			std::vector<std::string> labels(1, "process=\"total\"");
+			std::vector<const ConnectionMetrics*> sources(1, &process.totals);
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				labels.push_back("connection=\"" + entries[i].name + "\"");
+				sources.push_back(entries[i].metrics);
+			}
+
+			for (size_t f = 0; f < sizeof(counters) / sizeof(counters[0]); ++f)
+			{
+				WriteFamily(out, counters[f].name, "counter", counters[f].help);
+				for (size_t i = 0; i < sources.size(); ++i)
+					WriteCounter(out, counters[f].name, labels[i], sources[i]->*counters[f].counter);
+			}
+			for (size_t f = 0; f < sizeof(gauges) / sizeof(gauges[0]); ++f)
+			{
+				WriteFamily(out, gauges[f].name, "gauge", gauges[f].help);
+				for (size_t i = 0; i < sources.size(); ++i)
+					WriteGauge(out, gauges[f].name, labels[i], sources[i]->*gauges[f].gauge);
+			}
+			for (size_t f = 0; f < sizeof(histograms) / sizeof(histograms[0]); ++f)
+			{
+				WriteFamily(out, histograms[f].name, "histogram", histograms[f].help);
+				for (size_t i = 0; i < sources.size(); ++i)
+					WriteHistogram(out, histograms[f].name, labels[i], sources[i]->*histograms[f].histogram, histograms[f].scale);
+			}
+		}
+
+		void WriteJson(std::string& out)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ProcessMetrics& process = GetProcessMetrics();
+
+			char buffer[256];
+			snprintf(buffer, sizeof(buffer), "{\"send_syscalls\":%llu,\"recv_syscalls\":%llu,\"syscalls_per_batch\":",
+				(unsigned long long)process.send_syscalls.Get(), (unsigned long long)process.recv_syscalls.Get());
+			out += buffer;
+			WriteJsonHistogram(out, process.syscalls_per_batch);
+			out += ",\"total\":";
+			WriteJsonConnection(out, process.totals);
+			out += ",\"connections\":{";
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				if (i > 0)
+					out += ",";
+				out += "\"" + entries[i].name + "\":";
+				WriteJsonConnection(out, *entries[i].metrics);
+			}
+			out += "}}\n";
+		}
+
+	private:
+
+		struct CounterFamily
+		{
+			const char* name;
+			const char* help;
+			Counter ConnectionMetrics::* counter;
+		};
+
+		struct GaugeFamily
+		{
+			const char* name;
+			const char* help;
+			Gauge ConnectionMetrics::* gauge;
+		};
+
+		struct HistogramFamily
+		{
+			const char* name;
+			const char* help;
+			Histogram ConnectionMetrics::* histogram;
+			double scale;
+		};
+
+		static void WriteFamily(std::string& out, const char* name, const char* type, const char* help)
+		{
+			out += "# HELP ";
+			out += name;
+			out += " ";
+			out += help;
+			out += "\n# TYPE ";
+			out += name;
+			out += " ";
+			out += type;
+			out += "\n";
+		}
+
+		// name{labels} or name{labels,extra}, without the braces when there are no labels at all
+		static void WriteSample(std::string& out, const char* name, const char* suffix, const std::string& labels, const char* extra, const char* value)
+		{
+			out += name;
+			out += suffix;
+			if (!labels.empty() || extra[0])
+			{
+				out += "{";
+				out += labels;
+				out += !labels.empty() && extra[0] ? "," : "";
+				out += extra;
+				out += "}";
+			}
+			out += " ";
+			out += value;
+			out += "\n";
+		}
+
+		static void WriteCounter(std::string& out, const char* name, const std::string& labels, const Counter& counter)
+		{
+			char value[32];
+			snprintf(value, sizeof(value), "%llu", (unsigned long long)counter.Get());
+			WriteSample(out, name, "", labels, "", value);
+		}
+
+		static void WriteGauge(std::string& out, const char* name, const std::string& labels, const Gauge& gauge)
+		{
+			char value[32];
+			snprintf(value, sizeof(value), "%g", gauge.Get());
+			WriteSample(out, name, "", labels, "", value);
+		}
+
+		// scale converts recorded units into exported units (eg. microseconds to seconds)
+		static void WriteHistogram(std::string& out, const char* name, const std::string& labels, const Histogram& histogram, double scale)
+		{
+			char bound[48];
+			char value[32];
+			uint64_t cumulative = 0;
+			for (int i = 0; i < Histogram::NumBuckets - 1; ++i)
+			{
+				cumulative += histogram.GetBucket(i);
+				snprintf(bound, sizeof(bound), "le=\"%g\"", Histogram::BucketBound(i) * scale);
+				snprintf(value, sizeof(value), "%llu", (unsigned long long)cumulative);
+				WriteSample(out, name, "_bucket", labels, bound, value);
+			}
+			snprintf(value, sizeof(value), "%llu", (unsigned long long)histogram.GetCount());
+			WriteSample(out, name, "_bucket", labels, "le=\"+Inf\"", value);
+			snprintf(value, sizeof(value), "%g", histogram.GetSum() * scale);
+			WriteSample(out, name, "_sum", labels, "", value);
+			snprintf(value, sizeof(value), "%llu", (unsigned long long)histogram.GetCount());
+			WriteSample(out, name, "_count", labels, "", value);
+		}
+
+		static void WriteJsonHistogram(std::string& out, const Histogram& histogram)
+		{
+			char buffer[32 + 2 * 20];		// the format with both numbers at their longest
+			snprintf(buffer, sizeof(buffer), "{\"count\":%llu,\"sum\":%llu,\"buckets\":[",
+				(unsigned long long)histogram.GetCount(), (unsigned long long)histogram.GetSum());
+			out += buffer;
+			for (int i = 0; i < Histogram::NumBuckets; ++i)
+			{
+				snprintf(buffer, sizeof(buffer), i > 0 ? ",%llu" : "%llu", (unsigned long long)histogram.GetBucket(i));
+				out += buffer;
+			}
+			out += "]}";
+		}
+
+		static void WriteJsonConnection(std::string& out, const ConnectionMetrics& m)
+		{
+			char buffer[768];
+			snprintf(buffer, sizeof(buffer),
+				"{\"packets_sent\":%llu,\"packets_received\":%llu,\"packets_acked\":%llu,\"packets_lost\":%llu,"
+				"\"bytes_sent\":%llu,\"bytes_received\":%llu,\"retransmits\":%llu,"
+				"\"receive_drops\":%llu,\"send_drops\":%llu,"
+				"\"rtt\":%g,\"sent_bandwidth\":%g,\"acked_bandwidth\":%g,\"bottleneck_bandwidth\":%g,\"min_rtt\":%g,\"rtt_us\":",
+				(unsigned long long)m.packets_sent.Get(), (unsigned long long)m.packets_received.Get(),
+				(unsigned long long)m.packets_acked.Get(), (unsigned long long)m.packets_lost.Get(),
+				(unsigned long long)m.bytes_sent.Get(), (unsigned long long)m.bytes_received.Get(),
+				(unsigned long long)m.retransmits.Get(),
+				(unsigned long long)m.receive_drops.Get(), (unsigned long long)m.send_drops.Get(),
+				m.rtt.Get(), m.sent_bandwidth.Get(), m.acked_bandwidth.Get(), m.bottleneck_bandwidth.Get(), m.min_rtt.Get());
+			out += buffer;
+			WriteJsonHistogram(out, m.rtt_us);
+			out += ",\"packet_size\":";
+			WriteJsonHistogram(out, m.packet_size);
+			out += ",\"queue_depth\":";
+			WriteJsonHistogram(out, m.queue_depth);
+			out += "}";
+		}
+
+		struct Entry
+		{
+			std::string name;
+			const ConnectionMetrics* metrics;
+		};
+
+		std::mutex mutex;
+		std::vector<Entry> entries;
+	};
+
+	inline MetricsRegistry& GetMetricsRegistry()
+	{
+		static MetricsRegistry registry;
+		return registry;
+	}
+
+	enum MetricsFormat
+	{
+		MetricsPrometheus,
+		MetricsJson
+	};
+
+	inline void ScrapeMetrics(std::string& out, MetricsFormat format)
+	{
+		if (format == MetricsJson)
+			GetMetricsRegistry().WriteJson(out);
+		else
+			GetMetricsRegistry().WritePrometheus(out);
+	}
+
+	// write a scrape to a file, via a temporary so readers never see a partial file
+
+	inline bool WriteMetricsFile(const char* path, MetricsFormat format)
+	{
+		std::string out;
+		ScrapeMetrics(out, format);
+
+		std::string temp = std::string(path) + ".tmp";
+		FILE* file = fopen(temp.c_str(), "wb");
+		if (file == NULL)
+			return false;
+		bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+		fclose(file);
+		if (!ok)
+			return false;
+#if defined(_WIN32)
+		remove(path);
+#endif
+		return rename(temp.c_str(), path) == 0;
+	}
+
+#if !defined(_WIN32)
+
+	// serve scrapes on a unix domain socket: each client that connects gets one scrape, then is closed
+	//  + eg. "socat - UNIX-CONNECT:/tmp/rudp.sock"
+	//  + a client that hangs up early costs nothing (no SIGPIPE), one that never reads gets what fits in
+	//    the socket buffer, the network loop never waits on either
+
+	class MetricsSocket
+	{
+	public:
+
+		MetricsSocket()
+		{
+			socket = -1;
+			format = MetricsPrometheus;
+		}
+
+		~MetricsSocket()
+		{
+			Close();
+		}
+
+		bool Open(const char* path, MetricsFormat format)
+		{
+			assert(socket < 0);
+
+			sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (strlen(path) >= sizeof(address.sun_path))
+				return false;
+			strcpy(address.sun_path, path);
+
+			socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if (socket < 0)
+			{
+				printf("failed to create metrics socket\n");
+				return false;
+			}
+
+			unlink(path);
+			if (::bind(socket, (const sockaddr*)&address, sizeof(address)) < 0 || listen(socket, 4) < 0)
+			{
+				printf("failed to bind metrics socket %s\n", path);
+				Close();
+				return false;
+			}
+
+			if (fcntl(socket, F_SETFL, O_NONBLOCK) == -1)
+			{
+				printf("failed to set non-blocking metrics socket\n");
+				Close();
+				return false;
+			}
+
+			this->path = path;
+			this->format = format;
+			return true;
+		}
+
+		void Close()
+		{
+			if (socket >= 0)
+			{
+				close(socket);
+				unlink(path.c_str());
+				socket = -1;
+			}
+		}
+
+		// call once per frame: answers every client waiting on the socket
+		void Update()
+		{
+			if (socket < 0)
+				return;
+			int client;
+			while ((client = accept(socket, NULL, NULL)) >= 0)
+			{
+				// accepted sockets don't inherit O_NONBLOCK
+				fcntl(client, F_SETFL, O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+				int one = 1;
+				setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+				std::string out;
+				ScrapeMetrics(out, format);
+				size_t offset = 0;
+				while (offset < out.size())
+				{
+					ssize_t written = send(client, out.data() + offset, out.size() - offset, SendFlags);
+					if (written <= 0)
+						break;
+					offset += (size_t)written;
+				}
+				close(client);
+			}
+		}
+
+	private:
+
+#if defined(MSG_NOSIGNAL)
+		static const int SendFlags = MSG_NOSIGNAL;
+#else
+		static const int SendFlags = 0;		// SO_NOSIGPIPE on the client instead
+#endif
+
+		int socket;
+		MetricsFormat format;
+		std::string path;
+	};
+
+#endif
+}
+
+#endif
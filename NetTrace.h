@@ -0,0 +1,288 @@
+/* Filename: NetTrace.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains the hot path event tracer. Events are fixed size
+*				binary records stamped with the TSC and written into a per thread ring,
+*				and a decoder turns a dumped trace into Chrome trace / Perfetto JSON.
+*				Recording is compiled in only when NET_TRACE is defined.
+*/
+
+#ifndef NETTRACE_H
+#define NETTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef NET_TRACE
+#define NET_TRACE_EVENT(type, sequence, value) net::TraceRecord(type, sequence, value)
+#else
+#define NET_TRACE_EVENT(type, sequence, value) ((void)0)
+#endif
+
+namespace net
+{
+	enum TraceEventType
+	{
+		TraceSend = 1,					// sequence, payload bytes
+		TraceReceive,					// sequence, payload bytes
+		TraceAck,						// sequence, rtt in microseconds
+		TraceLoss,						// sequence, payload bytes
+		TraceRetransmit,				// message id, message bytes (a reliable channel message sent again)
+		TraceStateChange,				// port, new connection state
+		TraceDuplicate					// sequence that was already in a queue
+	};
+
+	// one trace record, two per cache line
+
+	struct TraceEvent
+	{
+		uint64_t timestamp;				// raw tsc (or steady clock nanoseconds where there is no tsc)
+		uint32_t sequence;
+		uint32_t value;
+		uint16_t type;
+		uint16_t reserved;
+		uint32_t thread;
+		uint64_t extra;
+	};
+
+	static_assert(sizeof(TraceEvent) == 32, "trace events must stay 32 bytes");
+
+	inline uint64_t TraceTimestamp()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	inline uint64_t TraceClockNanoseconds()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// single producer ring owned by one thread, oldest events are overwritten
+	//  + the dumper may read concurrently, it discards anything the writer could have lapped
+
+	class TraceRing
+	{
+	public:
+
+		enum { Capacity = 1 << 16 };	// power of two, 2MB per thread
+
+		TraceRing(uint32_t thread)
+		{
+			this->thread = thread;
+			head.store(0, std::memory_order_relaxed);
+			events = new TraceEvent[Capacity];
+		}
+
+		~TraceRing()
+		{
+			delete[] events;
+		}
+
+		void Push(uint16_t type, uint32_t sequence, uint32_t value)
+		{
+			uint64_t index = head.load(std::memory_order_relaxed);
+			TraceEvent& e = events[index & (Capacity - 1)];
+			e.timestamp = TraceTimestamp();
+			e.sequence = sequence;
+			e.value = value;
+			e.type = type;
+			e.reserved = 0;
+			e.thread = thread;
+			e.extra = 0;
+			head.store(index + 1, std::memory_order_release);
+		}
+
+		// copy out the events still in the ring, oldest first
+		void Snapshot(std::vector<TraceEvent>& out) const
+		{
+			uint64_t end = head.load(std::memory_order_acquire);
+			uint64_t begin = end > Capacity ? end - Capacity : 0;
+			size_t base = out.size();
+			for (uint64_t i = begin; i < end; ++i)
+				out.push_back(events[i & (Capacity - 1)]);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t lapped = head.load(std::memory_order_relaxed) + 1;	// + 1: the writer may be mid way through the next slot
+			if (lapped > Capacity && lapped - Capacity > begin)
+			{
+				size_t overwritten = (size_t)(lapped - Capacity - begin);
+				if (overwritten > end - begin)
+					overwritten = (size_t)(end - begin);
+				out.erase(out.begin() + base, out.begin() + base + overwritten);
+			}
+		}
+
+		uint32_t GetThread() const
+		{
+			return thread;
+		}
+
+	private:
+
+		std::atomic<uint64_t> head;
+		uint32_t thread;
+		TraceEvent* events;
+	};
+
+	// every ring ever created, rings are never freed so a dump can see threads that have exited
+
+	class TraceRegistry
+	{
+	public:
+
+		TraceRegistry()
+		{
+			base_timestamp = TraceTimestamp();
+			base_nanoseconds = TraceClockNanoseconds();
+		}
+
+		TraceRing* CreateRing()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			TraceRing* ring = new TraceRing((uint32_t)rings.size() + 1);
+			rings.push_back(ring);
+			return ring;
+		}
+
+		// binary dump: header, then every ring's events
+		bool Dump(const char* path)
+		{
+			std::vector<TraceEvent> events;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (size_t i = 0; i < rings.size(); ++i)
+					rings[i]->Snapshot(events);
+			}
+
+			FileHeader header;
+			memcpy(header.magic, "RUDPTRC1", 8);
+			header.base_timestamp = base_timestamp;
+			header.ticks_per_second = TicksPerSecond();
+			header.count = events.size();
+
+			FILE* file = fopen(path, "wb");
+			if (file == NULL)
+				return false;
+			bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+			if (ok && !events.empty())
+				ok = fwrite(&events[0], sizeof(TraceEvent), events.size(), file) == events.size();
+			fclose(file);
+			return ok;
+		}
+
+		struct FileHeader
+		{
+			char magic[8];
+			uint64_t base_timestamp;
+			double ticks_per_second;
+			uint64_t count;
+		};
+
+	private:
+
+		// calibrate the tsc against the steady clock over the life of the trace
+		double TicksPerSecond() const
+		{
+			uint64_t nanoseconds = TraceClockNanoseconds() - base_nanoseconds;
+			uint64_t ticks = TraceTimestamp() - base_timestamp;
+			if (nanoseconds == 0)
+				return 1000000000.0;
+			return (double)ticks * 1000000000.0 / (double)nanoseconds;
+		}
+
+		std::mutex mutex;
+		std::vector<TraceRing*> rings;
+		uint64_t base_timestamp;
+		uint64_t base_nanoseconds;
+	};
+
+	inline TraceRegistry& GetTraceRegistry()
+	{
+		static TraceRegistry registry;
+		return registry;
+	}
+
+	inline void TraceRecord(uint16_t type, uint32_t sequence, uint32_t value)
+	{
+		thread_local TraceRing* ring = NULL;
+		if (ring == NULL)
+			ring = GetTraceRegistry().CreateRing();
+		ring->Push(type, sequence, value);
+	}
+
+	inline bool TraceDump(const char* path)
+	{
+		return GetTraceRegistry().Dump(path);
+	}
+
+	// offline decoder: binary trace to Chrome trace event format (loads in chrome://tracing and ui.perfetto.dev)
+
+	inline bool TraceDecodeToChrome(const char* input, const char* output)
+	{
+		static const char* names[] = { "?", "send", "recv", "ack", "loss", "retransmit", "state", "duplicate" };
+		static const char* args[][2] = {
+			{ "a", "b" }, { "seq", "bytes" }, { "seq", "bytes" }, { "seq", "rtt_us" },
+			{ "seq", "bytes" }, { "id", "bytes" }, { "port", "state" }, { "seq", "value" } };
+
+		FILE* in = fopen(input, "rb");
+		if (in == NULL)
+		{
+			printf("failed to open trace %s\n", input);
+			return false;
+		}
+
+		TraceRegistry::FileHeader header;
+		if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, "RUDPTRC1", 8) != 0)
+		{
+			printf("%s is not a trace file\n", input);
+			fclose(in);
+			return false;
+		}
+
+		FILE* out = fopen(output, "wb");
+		if (out == NULL)
+		{
+			printf("failed to open %s\n", output);
+			fclose(in);
+			return false;
+		}
+
+		fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+		TraceEvent e;
+		uint64_t written = 0;
+		while (written < header.count && fread(&e, sizeof(e), 1, in) == 1)
+		{
+			int type = e.type < sizeof(names) / sizeof(names[0]) ? e.type : 0;
+			double us = (double)(int64_t)(e.timestamp - header.base_timestamp) * 1000000.0 / header.ticks_per_second;
+			fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"%s\":%u,\"%s\":%u}}",
+				written > 0 ? ",\n" : "", names[type], type == TraceStateChange ? "p" : "t", us, e.thread,
+				args[type][0], e.sequence, args[type][1], e.value);
+			written++;
+		}
+		fprintf(out, "\n]}\n");
+
+		fclose(out);
+		fclose(in);
+		printf("decoded %llu trace events to %s\n", (unsigned long long)written, output);
+		return true;
+	}
+}
+
+#endif
@@ -0,0 +1,425 @@
+/* Filename: NetUring.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains the io_uring backend for the UDP socket on Linux.
+*				One multishot recvmsg stays armed and fills buffers from a ring of pooled
+*				receive buffers, and sends are queued and submitted together. The rings are
+*				driven with the raw syscalls, anything the kernel does not support sends
+*				the socket back to plain recvfrom / sendto.
+*/
+
+#ifndef NETURING_H
+#define NETURING_H
+
+#if defined(__linux__) && !defined(NET_NO_URING)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define NET_URING 1
+#endif
+#endif
+
+#ifdef NET_URING
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NetMetrics.h"
+
+namespace net
+{
+	class UringSocket
+	{
+	public:
+
+		static const unsigned int RingEntries = 256;		// submission queue, the completion queue is twice this
+		static const unsigned int BufferCount = 64;			// pooled receive buffers, a power of two
+		static const unsigned int SendSlots = 256;			// sends in flight
+		static const unsigned int BufferSize = 2048;		// recvmsg header, address, timestamp, drop count and payload
+		static const unsigned int SubmitBatch = 16;			// queued sends that force a submit
+		static const int MaxFailedArms = 64;				// failed receives in a row before falling back
+		static const unsigned long long ReceiveTag = ~0ULL;
+
+		UringSocket()
+		{
+			ringFd = -1;
+			refused = 0;
+		}
+
+		~UringSocket()
+		{
+			Close();
+		}
+
+		// sets the rings up for a socket, false leaves the caller on the plain syscalls
+		bool Open(int socket)
+		{
+			assert(ringFd < 0);
+			fd = socket;
+
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			ringFd = (int)syscall(__NR_io_uring_setup, RingEntries, &params);
+			if (ringFd < 0)
+				return false;
+			if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+				return Fail();
+
+			// the submission and completion rings share one mapping, the entries have their own
+			ringSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+			size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (cqSize > ringSize)
+				ringSize = cqSize;
+			ring = (unsigned char*)mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+			sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+			sqes = (io_uring_sqe*)mmap(NULL, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+			if (ring == MAP_FAILED || sqes == MAP_FAILED)
+				return Fail();
+
+			sqHead = (unsigned int*)(ring + params.sq_off.head);
+			sqTail = (unsigned int*)(ring + params.sq_off.tail);
+			sqMask = *(unsigned int*)(ring + params.sq_off.ring_mask);
+			sqEntries = params.sq_entries;
+			sqArray = (unsigned int*)(ring + params.sq_off.array);
+			cqHead = (unsigned int*)(ring + params.cq_off.head);
+			cqTail = (unsigned int*)(ring + params.cq_off.tail);
+			cqMask = *(unsigned int*)(ring + params.cq_off.ring_mask);
+			cqes = (io_uring_cqe*)(ring + params.cq_off.cqes);
+			localTail = *sqTail;
+			pending = 0;
+
+			// one pool: the receive buffers, then the send slots
+			poolSize = (BufferCount + SendSlots) * BufferSize;
+			pool = (unsigned char*)mmap(NULL, poolSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			bufRingSize = BufferCount * sizeof(io_uring_buf);
+			bufRing = (io_uring_buf_ring*)mmap(NULL, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (pool == MAP_FAILED || bufRing == MAP_FAILED)
+				return Fail();
+
+			io_uring_buf_reg reg;
+			memset(&reg, 0, sizeof(reg));
+			reg.ring_addr = (unsigned long long)(uintptr_t)bufRing;
+			reg.ring_entries = BufferCount;
+			reg.bgid = 0;
+			if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+				return Fail();
+			bufTail = 0;
+			failedArms = 0;
+			refused = 0;
+			for (unsigned int i = 0; i < BufferCount; i++)
+				AddBuffer(i);
+
+			freeSlots.clear();
+			for (unsigned int i = 0; i < SendSlots; i++)
+				freeSlots.push_back(SendSlots - 1 - i);
+
+			memset(&receiveHeader, 0, sizeof(receiveHeader));
+			receiveHeader.msg_namelen = sizeof(sockaddr_storage);
+			receiveHeader.msg_controllen = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t));
+			if (!ArmReceive())
+				return Fail();
+			Flush();
+			return true;
+		}
+
+		void Close()
+		{
+			if (ringFd >= 0)
+				close(ringFd);
+			if (ring != NULL && ring != MAP_FAILED)
+				munmap(ring, ringSize);
+			if (sqes != NULL && sqes != MAP_FAILED)
+				munmap(sqes, sqeSize);
+			if (pool != NULL && pool != MAP_FAILED)
+				munmap(pool, poolSize);
+			if (bufRing != NULL && bufRing != MAP_FAILED)
+				munmap(bufRing, bufRingSize);
+			ringFd = -1;
+			ring = NULL;
+			sqes = NULL;
+			pool = NULL;
+			bufRing = NULL;
+		}
+
+		bool IsOpen() const
+		{
+			return ringFd >= 0;
+		}
+
+		// copies the packet into a send slot and queues it, false if it has to go the plain way
+		bool Send(const sockaddr* address, socklen_t addressLength, const void* data, int size)
+		{
+			if (size > (int)BufferSize || addressLength > (socklen_t)sizeof(sockaddr_storage))
+				return false;
+			if (freeSlots.empty())
+			{
+				Flush();
+				ReapSends();
+				if (freeSlots.empty())
+					return false;
+			}
+			io_uring_sqe* sqe = GetSqe();
+			if (sqe == NULL)
+				return false;
+
+			unsigned int index = freeSlots.back();
+			freeSlots.pop_back();
+			SendSlot& slot = slots[index];
+			unsigned char* buffer = pool + (BufferCount + index) * BufferSize;
+			memcpy(buffer, data, size);
+			memcpy(&slot.address, address, addressLength);
+			slot.vector.iov_base = buffer;
+			slot.vector.iov_len = size;
+			memset(&slot.header, 0, sizeof(slot.header));
+			slot.header.msg_name = &slot.address;
+			slot.header.msg_namelen = addressLength;
+			slot.header.msg_iov = &slot.vector;
+			slot.header.msg_iovlen = 1;
+
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = fd;
+			sqe->addr = (unsigned long long)(uintptr_t)&slot.header;
+			sqe->len = 1;
+			sqe->user_data = index;
+
+			if (pending >= SubmitBatch)
+				Flush();
+			return true;
+		}
+
+		// the next packet, 0 when there are none, -1 if the kernel cannot do multishot receives
+		//  + stamp is the kernel's receive time when the socket has SO_TIMESTAMPNS on
+		//  + overflow is the socket's count of datagrams dropped on a full receive buffer, left alone
+		//    when the packet does not carry it
+		int Receive(sockaddr_storage& from, void* data, int size, timespec& stamp, uint32_t& overflow)
+		{
+			Flush();
+			int result = Reap(from, data, size, stamp, overflow);
+			if (result == 0 && IsOpen())
+			{
+				// let the kernel post anything it has, then look once more
+				syscall(__NR_io_uring_enter, ringFd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0);
+				GetProcessMetrics().recv_syscalls.Add();
+				result = Reap(from, data, size, stamp, overflow);
+			}
+			return IsOpen() ? result : -1;
+		}
+
+		// sends that completed with the kernel out of buffer space since the last call, they are gone
+		unsigned int TakeRefused()
+		{
+			const unsigned int count = refused;
+			refused = 0;
+			return count;
+		}
+
+		// submits everything queued with one syscall
+		void Flush()
+		{
+			if (pending == 0 || ringFd < 0)
+				return;
+			__atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+			int submitted = (int)syscall(__NR_io_uring_enter, ringFd, pending, 0, 0, NULL, 0);
+			GetProcessMetrics().send_syscalls.Add();
+			if (submitted > 0)
+				pending -= submitted < (int)pending ? submitted : pending;
+		}
+
+	private:
+
+		struct SendSlot
+		{
+			sockaddr_storage address;
+			iovec vector;
+			msghdr header;
+		};
+
+		bool Fail()
+		{
+			Close();
+			return false;
+		}
+
+		io_uring_sqe* GetSqe()
+		{
+			if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+			{
+				Flush();
+				if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+					return NULL;
+			}
+			unsigned int index = localTail & sqMask;
+			io_uring_sqe* sqe = &sqes[index];
+			memset(sqe, 0, sizeof(*sqe));
+			sqArray[index] = index;
+			localTail++;
+			pending++;
+			return sqe;
+		}
+
+		// hands a receive buffer back to the kernel
+		void AddBuffer(unsigned int id)
+		{
+			// the header's flexible array is laid out differently under C++, index the ring directly
+			io_uring_buf* buf = (io_uring_buf*)bufRing + (bufTail & (BufferCount - 1));
+			buf->addr = (unsigned long long)(uintptr_t)(pool + id * BufferSize);
+			buf->len = BufferSize;
+			buf->bid = (unsigned short)id;
+			bufTail++;
+			__atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+		}
+
+		bool ArmReceive()
+		{
+			io_uring_sqe* sqe = GetSqe();
+			if (sqe == NULL)
+				return false;
+			sqe->opcode = IORING_OP_RECVMSG;
+			sqe->fd = fd;
+			sqe->addr = (unsigned long long)(uintptr_t)&receiveHeader;
+			sqe->len = 1;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = 0;
+			sqe->ioprio = IORING_RECV_MULTISHOT;
+			sqe->user_data = ReceiveTag;
+			return true;
+		}
+
+		// the receive timestamp and drop count out of the control messages the kernel wrote into the buffer
+		void ReadControl(const unsigned char* control, unsigned int length, timespec& stamp, uint32_t& overflow)
+		{
+			stamp.tv_sec = 0;
+			stamp.tv_nsec = 0;
+			msghdr header;
+			memset(&header, 0, sizeof(header));
+			header.msg_control = (void*)control;
+			header.msg_controllen = length;
+			for (cmsghdr* message = CMSG_FIRSTHDR(&header); message != NULL; message = CMSG_NXTHDR(&header, message))
+			{
+#ifdef SO_TIMESTAMPNS
+				if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS)
+					memcpy(&stamp, CMSG_DATA(message), sizeof(stamp));
+#endif
+#ifdef SO_RXQ_OVFL
+				if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL)
+					memcpy(&overflow, CMSG_DATA(message), sizeof(overflow));
+#endif
+			}
+		}
+
+		// a finished send gives its slot back, one the kernel had no buffer space for is counted
+		void SendDone(const io_uring_cqe& cqe)
+		{
+			if (cqe.res == -EAGAIN || cqe.res == -ENOBUFS)
+				refused++;
+			freeSlots.push_back((unsigned int)cqe.user_data);
+		}
+
+		// frees the slots of finished sends at the front of the completion queue, stopping at a packet
+		void ReapSends()
+		{
+			unsigned int head = *cqHead;
+			while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) && cqes[head & cqMask].user_data != ReceiveTag)
+			{
+				SendDone(cqes[head & cqMask]);
+				head++;
+			}
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		}
+
+		// works through completions until a packet turns up, send completions free their slot
+		int Reap(sockaddr_storage& from, void* data, int size, timespec& stamp, uint32_t& overflow)
+		{
+			while (ringFd >= 0)
+			{
+				unsigned int head = *cqHead;
+				if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+					return 0;
+				io_uring_cqe cqe = cqes[head & cqMask];
+				__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+				if (cqe.user_data != ReceiveTag)
+				{
+					SendDone(cqe);
+					continue;
+				}
+
+				// multishot ends on errors and when the buffers run out, it is armed again
+				if (!(cqe.flags & IORING_CQE_F_MORE))
+				{
+					// a receive that keeps failing without delivering anything is given up on
+					if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP || (cqe.res < 0 && ++failedArms > MaxFailedArms))
+					{
+						Close();
+						return 0;
+					}
+					ArmReceive();
+					Flush();
+				}
+				if (cqe.res <= 0 || !(cqe.flags & IORING_CQE_F_BUFFER))
+					continue;
+
+				unsigned int id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+				unsigned char* buffer = pool + id * BufferSize;
+				const io_uring_recvmsg_out* out = (const io_uring_recvmsg_out*)buffer;
+				const unsigned char* name = buffer + sizeof(io_uring_recvmsg_out);
+				const unsigned char* payload = name + receiveHeader.msg_namelen + receiveHeader.msg_controllen;
+
+				int bytes = 0;
+				if (!(out->flags & MSG_TRUNC) && (int)out->payloadlen <= size)
+				{
+					memset(&from, 0, sizeof(from));
+					memcpy(&from, name, out->namelen < receiveHeader.msg_namelen ? out->namelen : receiveHeader.msg_namelen);
+					memcpy(data, payload, out->payloadlen);
+					bytes = (int)out->payloadlen;
+					ReadControl(name + receiveHeader.msg_namelen, out->controllen, stamp, overflow);
+				}
+				AddBuffer(id);
+				failedArms = 0;
+				if (bytes > 0)
+					return bytes;
+			}
+			return 0;
+		}
+
+		int fd;
+		int ringFd;
+		unsigned char* ring = NULL;
+		size_t ringSize = 0;
+		io_uring_sqe* sqes = NULL;
+		size_t sqeSize = 0;
+		unsigned int* sqHead;
+		unsigned int* sqTail;
+		unsigned int* sqArray;
+		unsigned int sqMask;
+		unsigned int sqEntries;
+		unsigned int localTail;
+		unsigned int pending;
+		unsigned int* cqHead;
+		unsigned int* cqTail;
+		unsigned int cqMask;
+		io_uring_cqe* cqes;
+
+		unsigned char* pool = NULL;
+		size_t poolSize = 0;
+		io_uring_buf_ring* bufRing = NULL;
+		size_t bufRingSize = 0;
+		unsigned short bufTail;
+		int failedArms;
+		unsigned int refused;				// sends the kernel had no buffer space for, see TakeRefused
+		msghdr receiveHeader;
+
+		SendSlot slots[SendSlots];
+		std::vector<unsigned int> freeSlots;
+	};
+}
+
+#endif
+
+#endif
@@ -0,0 +1,540 @@
+/* Filename: NetXdp.h
+*  Project: ReliableUDP
+*  Programmer: Ismail Gangat, Hasan Dukanwala
+*  First Version: Oct 19th 2026
+*  Description: This header file contains the AF_XDP backend for the UDP socket on Linux.
+*				A small XDP program hands the frames for our port on one queue of an
+*				interface straight to a ring in memory shared with the kernel, and sends
+*				are written there as whole Ethernet frames. The IPv4 and UDP headers are
+*				parsed and built here, everything else is left to the kernel stack.
+*/
+
+#ifndef NETXDP_H
+#define NETXDP_H
+
+#if defined(__linux__) && !defined(NET_NO_XDP)
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#if defined(__NR_bpf) && defined(XDP_USE_NEED_WAKEUP) && defined(XDP_FLAGS_SKB_MODE)
+#define NET_XDP 1
+#endif
+#endif
+
+#ifdef NET_XDP
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <map>
+#include <vector>
+
+#include "NetMetrics.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+namespace net
+{
+	class XdpSocket
+	{
+	public:
+
+		static const unsigned int FrameCount = 4096;		// frames in the shared memory, half receive and half send
+		static const unsigned int FrameSize = 2048;
+		static const unsigned int RingSize = 2048;			// every ring, a power of two
+		static const unsigned int SubmitBatch = 32;			// queued sends that force a wakeup
+		static const int EthernetSize = 14;
+		static const int IpSize = 20;
+		static const int UdpSize = 8;
+		static const int FrameHeaderSize = EthernetSize + IpSize + UdpSize;
+
+		XdpSocket()
+		{
+			fd = -1;
+			mapFd = -1;
+			programFd = -1;
+			linkFd = -1;
+			umem = NULL;
+			fill.map = NULL;
+			completion.map = NULL;
+			rx.map = NULL;
+			tx.map = NULL;
+			ipId = 0;
+		}
+
+		~XdpSocket()
+		{
+			Close();
+		}
+
+		// attaches to "interface" or "interface:queue" for the port, false leaves the socket on the kernel path
+		bool Open(unsigned short bindPort, const char* spec)
+		{
+			assert(fd < 0);
+			char name[IF_NAMESIZE];
+			unsigned int queue = 0;
+			const char* colon = strchr(spec, ':');
+			size_t length = colon != NULL ? (size_t)(colon - spec) : strlen(spec);
+			if (length == 0 || length >= sizeof(name))
+				return false;
+			memcpy(name, spec, length);
+			name[length] = '\0';
+			if (colon != NULL)
+				queue = (unsigned int)atoi(colon + 1);
+			ifindex = if_nametoindex(name);
+			if (ifindex == 0)
+				return false;
+			port = htons(bindPort);
+
+			fd = ::socket(AF_XDP, SOCK_RAW, 0);
+			if (fd < 0 || !ReadMac(name))
+				return Fail();
+
+			// the shared memory, frames are handed around by their offset into it
+			umemSize = (size_t)FrameCount * FrameSize;
+			umem = (unsigned char*)mmap(NULL, umemSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (umem == MAP_FAILED)
+				return Fail();
+			xdp_umem_reg reg;
+			memset(&reg, 0, sizeof(reg));
+			reg.addr = (unsigned long long)(uintptr_t)umem;
+			reg.len = umemSize;
+			reg.chunk_size = FrameSize;
+			if (setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+				return Fail();
+
+			const unsigned int size = RingSize;
+			if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0 ||
+				setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) < 0 ||
+				setsockopt(fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0 ||
+				setsockopt(fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0)
+				return Fail();
+
+			xdp_mmap_offsets offsets;
+			socklen_t offsetsLength = sizeof(offsets);
+			if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsetsLength) < 0)
+				return Fail();
+			if (!MapRing(fill, offsets.fr, sizeof(unsigned long long), XDP_UMEM_PGOFF_FILL_RING) ||
+				!MapRing(completion, offsets.cr, sizeof(unsigned long long), XDP_UMEM_PGOFF_COMPLETION_RING) ||
+				!MapRing(rx, offsets.rx, sizeof(xdp_desc), XDP_PGOFF_RX_RING) ||
+				!MapRing(tx, offsets.tx, sizeof(xdp_desc), XDP_PGOFF_TX_RING))
+				return Fail();
+
+			// the first half of the frames wait in the fill ring for packets, the rest are free for sends
+			for (unsigned int i = 0; i < FrameCount / 2; i++)
+				((unsigned long long*)fill.entries)[i] = (unsigned long long)i * FrameSize;
+			__atomic_store_n(fill.producer, FrameCount / 2, __ATOMIC_RELEASE);
+			fill.local = FrameCount / 2;
+			freeFrames.clear();
+			for (unsigned int i = FrameCount / 2; i < FrameCount; i++)
+				freeFrames.push_back((unsigned long long)i * FrameSize);
+
+			sockaddr_xdp address;
+			memset(&address, 0, sizeof(address));
+			address.sxdp_family = AF_XDP;
+			address.sxdp_flags = XDP_USE_NEED_WAKEUP;
+			address.sxdp_ifindex = ifindex;
+			address.sxdp_queue_id = queue;
+			if (bind(fd, (const sockaddr*)&address, sizeof(address)) < 0)
+				return Fail();
+
+			if (!LoadProgram() || !MapUpdate(queue, fd) || !Attach())
+				return Fail();
+			pending = 0;
+			neighbours.clear();
+			return true;
+		}
+
+		void Close()
+		{
+			if (linkFd >= 0)
+				close(linkFd);
+			if (programFd >= 0)
+				close(programFd);
+			if (mapFd >= 0)
+				close(mapFd);
+			if (fd >= 0)
+				close(fd);
+			UnmapRing(fill);
+			UnmapRing(completion);
+			UnmapRing(rx);
+			UnmapRing(tx);
+			if (umem != NULL && umem != MAP_FAILED)
+				munmap(umem, umemSize);
+			linkFd = -1;
+			programFd = -1;
+			mapFd = -1;
+			fd = -1;
+			umem = NULL;
+		}
+
+		bool IsOpen() const
+		{
+			return fd >= 0;
+		}
+
+		// writes the frame for a datagram to the send ring, false if the peer's MAC is not known yet
+		//  + the peer's MAC and the local address it used are learned from its packets, until then the
+		//    kernel sends (and resolves the address)
+		bool Send(const sockaddr_in& destination, const void* data, int size)
+		{
+			std::map<unsigned int, Neighbour>::iterator itor = neighbours.find(destination.sin_addr.s_addr);
+			if (itor == neighbours.end() || size > (int)FrameSize - FrameHeaderSize)
+				return false;
+			Reclaim();
+			if (freeFrames.empty() || tx.local - __atomic_load_n(tx.consumer, __ATOMIC_ACQUIRE) >= tx.size)
+			{
+				Flush();
+				Reclaim();
+				if (freeFrames.empty() || tx.local - __atomic_load_n(tx.consumer, __ATOMIC_ACQUIRE) >= tx.size)
+					return false;
+			}
+
+			const unsigned long long frame = freeFrames.back();
+			freeFrames.pop_back();
+			unsigned char* packet = umem + frame;
+			const Neighbour& neighbour = itor->second;
+
+			memcpy(packet, neighbour.mac, 6);
+			memcpy(packet + 6, mac, 6);
+			packet[12] = 0x08;
+			packet[13] = 0x00;
+
+			unsigned char* ip = packet + EthernetSize;
+			const int ipLength = IpSize + UdpSize + size;
+			ip[0] = 0x45;
+			ip[1] = 0;
+			ip[2] = (unsigned char)(ipLength >> 8);
+			ip[3] = (unsigned char)ipLength;
+			ip[4] = (unsigned char)(ipId >> 8);
+			ip[5] = (unsigned char)ipId;
+			ipId++;
+			ip[6] = 0x40;		// don't fragment
+			ip[7] = 0;
+			ip[8] = 64;
+			ip[9] = IPPROTO_UDP;
+			ip[10] = 0;
+			ip[11] = 0;
+			memcpy(ip + 12, &neighbour.local, 4);
+			memcpy(ip + 16, &destination.sin_addr.s_addr, 4);
+			const unsigned short checksum = Checksum(ip, IpSize);
+			ip[10] = (unsigned char)(checksum >> 8);
+			ip[11] = (unsigned char)checksum;
+
+			// the UDP checksum is optional over IPv4, the payload carries its own authentication tag
+			unsigned char* udp = ip + IpSize;
+			const int udpLength = UdpSize + size;
+			memcpy(udp, &port, 2);
+			memcpy(udp + 2, &destination.sin_port, 2);
+			udp[4] = (unsigned char)(udpLength >> 8);
+			udp[5] = (unsigned char)udpLength;
+			udp[6] = 0;
+			udp[7] = 0;
+			memcpy(udp + UdpSize, data, size);
+
+			xdp_desc& desc = ((xdp_desc*)tx.entries)[tx.local & (tx.size - 1)];
+			desc.addr = frame;
+			desc.len = FrameHeaderSize + size;
+			desc.options = 0;
+			tx.local++;
+			__atomic_store_n(tx.producer, tx.local, __ATOMIC_RELEASE);
+			if (++pending >= SubmitBatch)
+				Flush();
+			return true;
+		}
+
+		// wakes the kernel to send what is in the ring
+		void Flush()
+		{
+			if (pending == 0 || fd < 0)
+				return;
+			if (__atomic_load_n(tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+			{
+				sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+				GetProcessMetrics().send_syscalls.Add();
+			}
+			pending = 0;
+		}
+
+		// the next datagram for our port from the receive ring, 0 when there are none
+		int Receive(sockaddr_in& from, void* data, int size)
+		{
+			while (true)
+			{
+				if (rx.local == __atomic_load_n(rx.producer, __ATOMIC_ACQUIRE))
+				{
+					if (__atomic_load_n(fill.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+					{
+						recvfrom(fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+						GetProcessMetrics().recv_syscalls.Add();
+					}
+					return 0;
+				}
+				const xdp_desc desc = ((const xdp_desc*)rx.entries)[rx.local & (rx.size - 1)];
+				rx.local++;
+				__atomic_store_n(rx.consumer, rx.local, __ATOMIC_RELEASE);
+
+				int bytes = Parse(umem + desc.addr, (int)desc.len, from, data, size);
+
+				// the frame goes straight back to the fill ring, it always has room for it
+				((unsigned long long*)fill.entries)[fill.local & (fill.size - 1)] = desc.addr & ~(unsigned long long)(FrameSize - 1);
+				fill.local++;
+				__atomic_store_n(fill.producer, fill.local, __ATOMIC_RELEASE);
+				if (bytes > 0)
+					return bytes;
+			}
+		}
+
+	private:
+
+		struct Ring
+		{
+			unsigned int* producer;
+			unsigned int* consumer;
+			unsigned int* flags;
+			void* entries;
+			unsigned int size;
+			unsigned int local;			// our producer for the fill and send rings, our consumer for the others
+			void* map;
+			size_t mapSize;
+		};
+
+		struct Neighbour
+		{
+			unsigned char mac[6];
+			unsigned int local;			// the address the peer sent to, used as our source address
+		};
+
+		bool Fail()
+		{
+			Close();
+			return false;
+		}
+
+		bool MapRing(Ring& ring, const xdp_ring_offset& offset, size_t entrySize, off_t pageOffset)
+		{
+			ring.mapSize = offset.desc + RingSize * entrySize;
+			ring.map = mmap(NULL, ring.mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pageOffset);
+			if (ring.map == MAP_FAILED)
+			{
+				ring.map = NULL;
+				return false;
+			}
+			unsigned char* base = (unsigned char*)ring.map;
+			ring.producer = (unsigned int*)(base + offset.producer);
+			ring.consumer = (unsigned int*)(base + offset.consumer);
+			ring.flags = (unsigned int*)(base + offset.flags);
+			ring.entries = base + offset.desc;
+			ring.size = RingSize;
+			ring.local = 0;
+			return true;
+		}
+
+		void UnmapRing(Ring& ring)
+		{
+			if (ring.map != NULL)
+				munmap(ring.map, ring.mapSize);
+			ring.map = NULL;
+		}
+
+		// finished sends give their frames back
+		void Reclaim()
+		{
+			const unsigned int produced = __atomic_load_n(completion.producer, __ATOMIC_ACQUIRE);
+			while (completion.local != produced)
+			{
+				freeFrames.push_back(((unsigned long long*)completion.entries)[completion.local & (completion.size - 1)]);
+				completion.local++;
+			}
+			__atomic_store_n(completion.consumer, completion.local, __ATOMIC_RELEASE);
+		}
+
+		// checks the Ethernet, IPv4 and UDP headers and copies the payload out, 0 for anything else
+		int Parse(const unsigned char* packet, int length, sockaddr_in& from, void* data, int size)
+		{
+			if (length < FrameHeaderSize || packet[12] != 0x08 || packet[13] != 0x00)
+				return 0;
+			const unsigned char* ip = packet + EthernetSize;
+			const int headerLength = (ip[0] & 0x0F) * 4;
+			const int totalLength = (ip[2] << 8) | ip[3];
+			if ((ip[0] >> 4) != 4 || headerLength < IpSize || ip[9] != IPPROTO_UDP ||
+				(((ip[6] & 0x3F) << 8) | ip[7]) != 0 || totalLength > length - EthernetSize ||
+				headerLength + UdpSize > totalLength)
+				return 0;
+			const unsigned char* udp = ip + headerLength;
+			const int udpLength = (udp[4] << 8) | udp[5];
+			if (memcmp(udp + 2, &port, 2) != 0 || udpLength < UdpSize || udpLength > totalLength - headerLength)
+				return 0;
+
+			Neighbour& neighbour = neighbours[*(const unsigned int*)(ip + 12)];
+			memcpy(neighbour.mac, packet + 6, 6);
+			memcpy(&neighbour.local, ip + 16, 4);
+
+			memset(&from, 0, sizeof(from));
+			from.sin_family = AF_INET;
+			memcpy(&from.sin_addr.s_addr, ip + 12, 4);
+			memcpy(&from.sin_port, udp, 2);
+			const int bytes = udpLength - UdpSize < size ? udpLength - UdpSize : size;
+			memcpy(data, udp + UdpSize, bytes);
+			return bytes;
+		}
+
+		static unsigned short Checksum(const unsigned char* data, int length)
+		{
+			unsigned int sum = 0;
+			for (int i = 0; i + 1 < length; i += 2)
+				sum += (data[i] << 8) | data[i + 1];
+			while (sum >> 16)
+				sum = (sum & 0xFFFF) + (sum >> 16);
+			return (unsigned short)~sum;
+		}
+
+		bool ReadMac(const char* name)
+		{
+			ifreq request;
+			memset(&request, 0, sizeof(request));
+			memcpy(request.ifr_name, name, strlen(name) + 1);
+			// an AF_XDP socket has no interface ioctls, ask through a throwaway UDP socket
+			int probe = ::socket(AF_INET, SOCK_DGRAM, 0);
+			if (probe < 0)
+				return false;
+			const bool found = ioctl(probe, SIOCGIFHWADDR, &request) == 0;
+			close(probe);
+			if (found)
+				memcpy(mac, request.ifr_hwaddr.sa_data, 6);
+			return found;
+		}
+
+		static int Bpf(int command, bpf_attr& attr)
+		{
+			return (int)syscall(__NR_bpf, command, &attr, sizeof(attr));
+		}
+
+		static bpf_insn Instruction(unsigned char code, unsigned char dst, unsigned char src, short off, int imm)
+		{
+			bpf_insn insn;
+			insn.code = code;
+			insn.dst_reg = dst;
+			insn.src_reg = src;
+			insn.off = off;
+			insn.imm = imm;
+			return insn;
+		}
+
+		// an xskmap with our socket and the program that sends IPv4 UDP frames for our port to it
+		//  + r2 = data, r3 = data_end, the first 42 bytes are bounds checked before any header is read
+		//  + everything else, and frames on other queues, go on to the kernel
+		bool LoadProgram()
+		{
+			bpf_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.map_type = BPF_MAP_TYPE_XSKMAP;
+			attr.key_size = 4;
+			attr.value_size = 4;
+			attr.max_entries = 64;
+			mapFd = Bpf(BPF_MAP_CREATE, attr);
+			if (mapFd < 0)
+				return false;
+
+			const unsigned char pass = 20;
+			bpf_insn program[] =
+			{
+				Instruction(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),
+				Instruction(BPF_LDX | BPF_MEM | BPF_W, 2, 6, 0, 0),
+				Instruction(BPF_LDX | BPF_MEM | BPF_W, 3, 6, 4, 0),
+				Instruction(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+				Instruction(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, FrameHeaderSize),
+				Instruction(BPF_JMP | BPF_JGT | BPF_X, 4, 3, pass - 6, 0),
+				Instruction(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0),
+				Instruction(BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass - 8, htons(0x0800)),
+				Instruction(BPF_LDX | BPF_MEM | BPF_B, 5, 2, EthernetSize, 0),
+				Instruction(BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass - 10, 0x45),
+				Instruction(BPF_LDX | BPF_MEM | BPF_B, 5, 2, EthernetSize + 9, 0),
+				Instruction(BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass - 12, IPPROTO_UDP),
+				Instruction(BPF_LDX | BPF_MEM | BPF_H, 5, 2, EthernetSize + IpSize + 2, 0),
+				Instruction(BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass - 14, port),
+				Instruction(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, mapFd),
+				Instruction(0, 0, 0, 0, 0),
+				Instruction(BPF_LDX | BPF_MEM | BPF_W, 2, 6, 16, 0),
+				Instruction(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),
+				Instruction(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+				Instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+				Instruction(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),
+				Instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+			};
+			static const char license[] = "GPL";
+
+			memset(&attr, 0, sizeof(attr));
+			attr.prog_type = BPF_PROG_TYPE_XDP;
+			attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+			attr.insns = (unsigned long long)(uintptr_t)program;
+			attr.license = (unsigned long long)(uintptr_t)license;
+			attr.expected_attach_type = BPF_XDP;
+			programFd = Bpf(BPF_PROG_LOAD, attr);
+			return programFd >= 0;
+		}
+
+		bool MapUpdate(unsigned int key, int value)
+		{
+			bpf_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.map_fd = mapFd;
+			attr.key = (unsigned long long)(uintptr_t)&key;
+			attr.value = (unsigned long long)(uintptr_t)&value;
+			return Bpf(BPF_MAP_UPDATE_ELEM, attr) == 0;
+		}
+
+		// driver mode where the interface has it, the generic hook otherwise, detached when the link closes
+		bool Attach()
+		{
+			const unsigned int modes[2] = { 0, XDP_FLAGS_SKB_MODE };
+			for (int i = 0; i < 2 && linkFd < 0; i++)
+			{
+				bpf_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.link_create.prog_fd = programFd;
+				attr.link_create.target_ifindex = ifindex;
+				attr.link_create.attach_type = BPF_XDP;
+				attr.link_create.flags = modes[i];
+				linkFd = Bpf(BPF_LINK_CREATE, attr);
+			}
+			return linkFd >= 0;
+		}
+
+		int fd;
+		int mapFd;
+		int programFd;
+		int linkFd;
+		unsigned int ifindex;
+		unsigned short port;			// network order
+		unsigned char mac[6];
+		unsigned short ipId;
+
+		unsigned char* umem;
+		size_t umemSize;
+		Ring fill;
+		Ring completion;
+		Ring rx;
+		Ring tx;
+		std::vector<unsigned long long> freeFrames;
+		unsigned int pending;
+		std::map<unsigned int, Neighbour> neighbours;
+	};
+}
+
+#endif
+
+#endif
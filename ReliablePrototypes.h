@@ -12,17 +12,179 @@
 
 #pragma warning(disable:4996)
 
+#include <stdio.h>
+
 // Struct to represent chunks of data
 typedef struct {
     unsigned char* data;
     size_t size;
+    unsigned char* packed;      // compressed copy, NULL when the chunk goes out raw
+    size_t packedSize;
 } Chunk;
 
+// worker pool that compresses the chunks of a transfer's files ahead of the sender, one job per file
+typedef struct CompressPool CompressPool;
+typedef struct CompressJob CompressJob;
+
+// delta being matched against a file's chunks on a worker thread
+typedef struct DeltaJob DeltaJob;
+
+// file transfer packets, the first byte of every message is the type and the next two the file id
+#define FILE_PACKET_METADATA 1  // [type][file 2] path:size:digest
+#define FILE_PACKET_DATA 2      // [type][file 2][chunk index 4][chunk]
+#define FILE_PACKET_PARITY 3    // [type][file 2][group 4][parity index][data chunks in group][parity chunk]
+#define FILE_PACKET_STATUS 4    // [type][file 2][files done 4][all done], the receiver's reply or the sender's heartbeat
+#define FILE_PACKET_PACKED 5    // [type][file 2][chunk index 4][lz4 block of the chunk]
+#define FILE_PACKET_RESUME 6    // [type][file 2][range count 4][first chunk 4, chunk count 4]..., the chunks the receiver is missing
+#define FILE_PACKET_MANIFEST 7  // [type][file 2][total files 4][total bytes 8][file id 2, size 8, path length 1, path]...
+#define FILE_PACKET_DONE 8      // [type][file 2], the receiver has the whole file
+#define FILE_PACKET_SIGNATURE 9 // [type][file 2][block size 4][block count 4][weak 4, strong 8]..., the receiver's old copy
+#define FILE_PACKET_DELTA 10    // [type][file 2][run count 4][new offset 8, first block 4, block count 4]..., blocks to copy from it
+#define FILE_HEADER_SIZE 9
+#define FILE_ID_NONE 0xFFFF     // file id of messages about the whole transfer
+
+// resume requests list at most this many missing ranges, the last one runs to the end of the file
+#define FILE_RESUME_RANGES 4096
+#define FILE_RESUME_SIZE (7 + 8 * FILE_RESUME_RANGES)
+
+// delta transfers sign at most this many blocks of the old copy, the blocks grow with the file to fit
+#define FILE_SIGNATURE_BLOCKS 2048
+#define FILE_SIGNATURE_SIZE (11 + 12 * FILE_SIGNATURE_BLOCKS)
+#define FILE_DELTA_SIZE (7 + 16 * FILE_SIGNATURE_BLOCKS)
+
+// directory transfers
+#define FILE_MAX_FILES 65535    // file ids are 16 bits
+#define FILE_MAX_ACTIVE 32      // files in flight at once
+#define FILE_PRELOAD 16         // files the reader threads load ahead of the sender
+#define FILE_READERS 2
+#define FILE_MAX_PATH 128
+
+// forward error correction, k data chunks per group plus up to m parity chunks
+#define FEC_MAX_DATA 16
+#define FEC_MAX_PARITY 8
+
+// Struct for the sending side of one file
+typedef struct {
+    int fileId;
+    int metadataQueued;         // metadata has gone out on the current connection
+    Chunk* chunks;
+    int numChunks;
+    int chunkSize;
+    char* metadata;
+    int complete;               // receiver reported the whole file
+    unsigned char* parity;      // FEC_MAX_PARITY chunks of scratch for the encoder
+    CompressJob* compressor;    // NULL when compression is off
+    unsigned long long digest;  // of the whole file, lets the receiver check a checkpoint is for the same file
+    unsigned char* needed;      // per chunk, cleared for chunks a resume request says the receiver has
+    int* groupNeeded;           // needed chunks per group
+    int resumed;                // the receiver has said which chunks it needs on this connection
+    DeltaJob* delta;            // matching the receiver's signature, queued once it is done
+    int blockSize;              // of the receiver's signature
+    int deltaEmpty;             // the signature could not be matched, an empty delta answers it
+} FileSender;
+
+// Struct for one group on the receiving side, parity is kept until the group is whole
+typedef struct {
+    unsigned char* parity;      // FEC_MAX_PARITY chunks, allocated by the first parity packet
+    int parityMask;
+    int dataCount;
+} FecGroup;
+
+// Struct for the receiving side of one file
+typedef struct {
+    int fileId;
+    FILE* file;
+    char name[FILE_MAX_PATH];
+    long size;
+    int chunkSize;
+    int numChunks;
+    int received;
+    int recovered;
+    unsigned char* have;
+    FecGroup* groups;
+    unsigned long long digest;  // from the metadata, 0 if the sender did not send one
+    int dirty;                  // chunks arrived since the last checkpoint
+    int resumePending;          // a resume request should go out now
+    int delta;                  // an old copy of the file may be used as the base of a delta
+    FILE* base;                 // the old copy, renamed to <name>.base while the delta is pending
+    int blockSize;
+    int baseBlocks;
+    int signaturePending;       // the signature of the old copy should go out now
+    int deltaPending;           // no resume requests until the sender's delta is in
+} FileReceiver;
+
+// Struct for the receiving side of a transfer, one slot per file in flight
+typedef struct {
+    FileReceiver files[FILE_MAX_ACTIVE];
+    int chunkSize;
+    int filesExpected;          // from the manifest, 0 until it arrives
+    long long bytesExpected;
+    int filesDone;
+    int delta;                  // files that differ from the copy in ./output are sent as deltas
+} TransferReceiver;
+
+// sending side of a transfer: the files to send, the reader threads and the files in flight
+typedef struct TransferSender TransferSender;
+
 
 // prototypes
 void getFilename(char* filename, int size);
 char* SendMetadata(const char* file_name);
 Chunk* breakFileIntoChunks(const char* filename, int* numChunks, const int chunkSize);
+void freeChunks(Chunk* chunks, int numChunks);
+
+int fileSenderStart(FileSender* sender, const char* path, const char* name, int fileId, int chunkSize);
+int fileSenderGroupCount(const FileSender* sender);
+int fileSenderNextGroup(const FileSender* sender, int group);
+int fileSenderBuildGroup(FileSender* sender, int group, int parityCount, unsigned char* packets, int* sizes);
+int fileSenderMetadata(const FileSender* sender, unsigned char* packet);
+void fileSenderResume(FileSender* sender, const unsigned char* packet, int size);
+void fileSenderDelta(FileSender* sender, const unsigned char* packet, int size);
+int fileSenderDeltaPacket(FileSender* sender, unsigned char* packet);
+void fileSenderClose(FileSender* sender);
+
+void fileReceiverInit(FileReceiver* receiver, int chunkSize);
+int fileParseMetadata(const unsigned char* packet, int size, char* name, long* fileSize, unsigned long long* digest);
+void fileReceiverHandle(FileReceiver* receiver, const unsigned char* packet, int size);
+int fileReceiverResume(FileReceiver* receiver, unsigned char* packet);
+int fileReceiverSignature(FileReceiver* receiver, unsigned char* packet);
+void fileReceiverCheckpoint(FileReceiver* receiver);
+int fileReceiverComplete(const FileReceiver* receiver);
+void fileReceiverClose(FileReceiver* receiver);
+
+void transferReceiverInit(TransferReceiver* transfer, int chunkSize);
+int transferReceiverHandle(TransferReceiver* transfer, const unsigned char* packet, int size);
+int transferReceiverStatus(const TransferReceiver* transfer, unsigned char* packet);
+void transferReceiverCheckpoint(TransferReceiver* transfer);
+void transferReceiverClose(TransferReceiver* transfer);
+
+TransferSender* transferSenderOpen(const char* path, int chunkSize, int compress);
+void transferSenderConnected(TransferSender* transfer);
+int transferSenderControl(TransferSender* transfer, unsigned char* packet);
+int transferSenderBulk(TransferSender* transfer, int parityCount, unsigned char* packets, int* sizes);
+int transferSenderHeartbeat(const TransferSender* transfer, unsigned char* packet);
+void transferSenderHandle(TransferSender* transfer, const unsigned char* packet, int size);
+int transferSenderDone(const TransferSender* transfer);
+void transferSenderClose(TransferSender* transfer);
+
+void fecEncode(unsigned char** data, int k, unsigned char** parity, int m, int size);
+int fecDecode(unsigned char** data, const int* present, int k, unsigned char** parity, const int* parityIndex, int parityCount, int size);
+int fecParityCount(float lossRate, int k);
+
+int lz4Compress(const unsigned char* src, int srcSize, unsigned char* dst, int capacity);
+int lz4Decompress(const unsigned char* src, int srcSize, unsigned char* dst, int capacity);
+CompressPool* compressPoolStart();
+void compressPoolStop(CompressPool* pool);
+CompressJob* compressStart(CompressPool* pool, Chunk* chunks, int numChunks);
+void compressWait(CompressJob* job, int group);
+void compressFinish(CompressJob* job);
+
+void deltaChecksum(const unsigned char* data, int length, unsigned int* a, unsigned int* b);
+int deltaSignature(FILE* file, int blockSize, int blocks, unsigned char* signature);
+int deltaMatch(const unsigned char* data, long size, int blockSize, const unsigned char* signature, int blocks, unsigned char* runs, int maxRuns);
+DeltaJob* deltaStart(const Chunk* chunks, int numChunks, int chunkSize, int blockSize, const unsigned char* signature, int blocks);
+int deltaReady(const DeltaJob* job);
+int deltaFinish(DeltaJob* job, unsigned char* runs);
 
 
 #endif // !RELIABLEPROTOTYPES_H
\ No newline at end of file
@@ -16,12 +16,12 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <chrono>
 
 #include "Net.h"
 #include "ReliablePrototypes.h"
 
 //#pragma warning(disable:4996)
-//#define SHOW_ACKS
 
 using namespace std;
 using namespace net;
@@ -29,7 +29,8 @@ using namespace net;
 const int ServerPort = 30000;
 const int ClientPort = 30001;
 const int ProtocolId = 0x11223344;
-const float DeltaTime = 1.0f / 30.0f;
+const float DeltaTime = 1.0f / 30.0f;		// frame period, the loop measures what each frame really took
+const float MaxDeltaTime = 0.25f;
 const float SendRate = 1.0f / 30.0f;
 const float TimeOut = 10.0f;
 const int PacketSize = 256;
@@ -131,6 +132,101 @@ private:
 	float penalty_reduction_accumulator;
 };
 
+/* Function: void BenchmarkCrypto()
+         * Description: This function measures the packet encryption cost: chacha20-poly1305
+         *				seal and open per packet size, sealed one at a time and in batches,
+         *				reported as GB/s and cpu seconds per GB, plus the x25519 handshake cost
+         * Parameters: -
+         * Returns: -
+         */
+void BenchmarkCrypto()
+{
+	const int sizes[] = { 256, 1200 };
+	const int BatchSize = 32;
+	const double Bytes = 256.0 * 1024 * 1024;
+
+	unsigned char key[32];
+	random_bytes(key, sizeof(key));
+	unsigned char header[13] = { 0 };
+
+	for (int s = 0; s < 2; ++s)
+	{
+		const int size = sizes[s];
+		const int packets = (int)(Bytes / size);
+		vector<unsigned char> plain(size * BatchSize, 0x5A);
+		vector<unsigned char> sealed((size + AeadTagSize) * BatchSize);
+		vector<unsigned char> opened(size * BatchSize);
+
+		AeadPacket batch[BatchSize];
+		for (int i = 0; i < BatchSize; ++i)
+		{
+			batch[i].ad = header;
+			batch[i].ad_size = sizeof(header);
+			batch[i].in = &plain[i * size];
+			batch[i].size = size;
+			batch[i].out = &sealed[i * (size + AeadTagSize)];
+		}
+
+		for (int mode = 0; mode < 3; ++mode)
+		{
+			uint64_t nonce = 0;
+			int failures = 0;
+			auto start = chrono::steady_clock::now();
+			if (mode == 2)
+			{
+				// open the same sealed batch over and over
+				for (int i = 0; i < BatchSize; ++i)
+					batch[i].nonce = i;
+				aead_seal_batch(key, batch, BatchSize);
+				start = chrono::steady_clock::now();
+			}
+			for (int sent = 0; sent < packets; sent += BatchSize)
+			{
+				if (mode != 2)
+					for (int i = 0; i < BatchSize; ++i)
+						batch[i].nonce = nonce++;
+				if (mode == 0)
+				{
+					for (int i = 0; i < BatchSize; ++i)
+						aead_seal(key, batch[i]);
+				}
+				else if (mode == 1)
+				{
+					aead_seal_batch(key, batch, BatchSize);
+				}
+				else
+				{
+					for (int i = 0; i < BatchSize; ++i)
+					{
+						AeadPacket open = batch[i];
+						open.in = batch[i].out;
+						open.out = &opened[i * size];
+						if (!aead_open(key, open))
+							failures++;
+					}
+				}
+			}
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			double gigabytes = (double)packets * size / (1024.0 * 1024.0 * 1024.0);
+			static const char* names[] = { "seal", "seal (batch of 32)", "open" };
+			printf("%4d byte packets, %-18s: %6.2f GB/s, %6.1f ns/packet, %.2f cpu seconds per GB%s\n",
+				size, names[mode], gigabytes / seconds, seconds * 1e9 / packets, seconds / gigabytes,
+				failures ? " (TAG FAILURES)" : "");
+		}
+	}
+
+	unsigned char private_key[32], public_key[32];
+	random_bytes(private_key, sizeof(private_key));
+	const int exchanges = 200;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < exchanges; ++i)
+		x25519_public_key(public_key, private_key);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("x25519: %.1f us per scalar multiply, the server does one per handshake (%.0f handshakes/s per core)\n",
+		seconds * 1e6 / exchanges, exchanges / seconds);
+
+}
+
 // ----------------------------------------------
 
 int main(int argc, char* argv[])
@@ -153,19 +249,57 @@ int main(int argc, char* argv[])
 	boolean client_sending = false;
 	boolean server_receiving = false;
 	boolean client_receiving = false;
-	int metaDataFlag = 0; // ) flag means metadata is not sent
-	char filename[50] = { 0 };
-	int numChunks;
+	char filename[256] = { 0 };
+	boolean useFec = false;				// -fec, add parity chunks sized to the measured loss
+	boolean useCompression = false;		// -compress, lz4 chunks that shrink, the rest go raw
+	boolean useDelta = false;			// -delta, files the receiver has an old copy of go as deltas
+	const char* metricsPath = NULL;		// -metrics <file> or -metrics unix:<socket path>
+	MetricsFormat metricsFormat = MetricsPrometheus;
+#ifdef NET_TRACE
+	const char* tracePath = NULL;		// -trace <file>
+#endif
+
+	// optional metrics export, may appear anywhere on the command line
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-metrics") == 0 && i + 1 < argc)
+			metricsPath = argv[i + 1];
+		else if (strcmp(argv[i], "-json") == 0)
+			metricsFormat = MetricsJson;
+#ifdef NET_TRACE
+		else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+			tracePath = argv[i + 1];
+#endif
+		else if (strcmp(argv[i], "-fec") == 0)
+			useFec = true;
+		else if (strcmp(argv[i], "-compress") == 0)
+			useCompression = true;
+		else if (strcmp(argv[i], "-delta") == 0)
+			useDelta = true;
+	}
+
+	// offline trace decode: -decode-trace <trace file> <json file>
+
+	if (argc >= 4 && strcmp(argv[1], "-decode-trace") == 0)
+		return TraceDecodeToChrome(argv[2], argv[3]) ? 0 : 1;
+
+	// packet encryption cost: -bench-crypto
+
+	if (argc >= 2 && strcmp(argv[1], "-bench-crypto") == 0)
+	{
+		BenchmarkCrypto();
+		return 0;
+	}
 
 	// Command line args parse 
 	if (argc >= 2)
 	{
-		int a, b, c, d;
-		if (sscanf(argv[1], "%d.%d.%d.%d", &a, &b, &c, &d))
+		// a.b.c.d, or an IPv6 address such as ::1 or fe80::1%eth0
+		if (Address::Parse(argv[1], ServerPort, address))
 		{
 			mode = Client;
 
-			address = Address(a, b, c, d, ServerPort);
 			if (argc >= 3 && strcmp(argv[2], "-send") == 0)
 			{
 
@@ -189,6 +323,13 @@ int main(int argc, char* argv[])
 			client_receiving = true;
 
 		}
+		else
+		{
+			// only options, same as no arguments
+			mode = Server;
+			client_sending = true;
+			server_receiving = true;
+		}
 	}
 	else
 	{
@@ -224,16 +365,70 @@ int main(int argc, char* argv[])
 	bool connected = false;
 	float sendAccumulator = 0.0f;
 	float statsAccumulator = 0.0f;
+	float metricsAccumulator = 0.0f;
+#ifdef NET_TRACE
+	float traceAccumulator = 0.0f;
+#endif
+
+#if PLATFORM != PLATFORM_WINDOWS
+	MetricsSocket metricsSocket;
+	if (metricsPath != NULL && strncmp(metricsPath, "unix:", 5) == 0)
+	{
+		if (!metricsSocket.Open(metricsPath + 5, metricsFormat))
+			printf("could not open metrics socket %s\n", metricsPath + 5);
+		metricsPath = NULL;
+	}
+#endif
 
 	FlowControl flowControl;
 
+	const boolean sending = (mode == Client && client_sending) || (mode == Server && server_sending);
+	const boolean receiving = (mode == Server && server_receiving) || (mode == Client && client_receiving);
+	const int FileStride = FILE_HEADER_SIZE + PacketSize;
+	const int GroupsPerSend = 4;
+
+	TransferSender* transfer = NULL;		// a file or a whole directory
+	vector<unsigned char> groupPackets((FEC_MAX_DATA + FEC_MAX_PARITY) * FileStride);
+
+	TransferReceiver receiver;
+	transferReceiverInit(&receiver, PacketSize);
+	receiver.delta = useDelta;
+
+	// message channels: the manifest, metadata, resume requests and done messages are sent once so
+	// they go reliable and ordered, status and chunks are repeated until the receiver has the files so
+	// they go unreliable. Control is weighted well above bulk, it never waits behind a backlog of
+	// chunks. Status goes ahead of both and a status the pacer has not sent by the next one is dropped,
+	// only the latest means anything
+	const int ChannelControl = connection.AddChannel(ChannelReliableOrdered, 8);
+	const int ChannelStatus = connection.AddChannel(ChannelUnreliable, 8);
+	const int ChannelBulk = connection.AddChannel(ChannelUnreliable, 1);
+	const int StatusPriority = 1;
+	const float StatusDeadline = DeltaTime * 2.0f;
+	const int PacketsPerSend = GroupsPerSend * (FEC_MAX_DATA + FEC_MAX_PARITY);
+	vector<unsigned char> messageBuffer(FILE_RESUME_SIZE > FILE_DELTA_SIZE ? FILE_RESUME_SIZE : FILE_DELTA_SIZE);
+	float resumeAccumulator = 0.0f;
+	float checkpointAccumulator = 0.0f;
+
+
+	// loss rate seen by the reliability system, drives the parity count
+	float lossRate = 0.0f;
+	unsigned long long lastSent = 0;
+	unsigned long long lastLost = 0;
+
+	uint64_t frameStart = GetTime();
 
 	while (true)
 	{
+		// the real time since the last frame, capped so a stall (the filename prompt, a slow disk) does
+		// not come back as one burst of sends
+		const uint64_t now = GetTime();
+		const float deltaTime = min((float)(now - frameStart) / 1000000.0f, MaxDeltaTime);
+		frameStart = now;
+
 		// update flow control
 
 		if (connection.IsConnected())
-			flowControl.Update(DeltaTime, connection.GetReliabilitySystem().GetRoundTripTime() * 1000.0f);
+			flowControl.Update(deltaTime, connection.GetReliabilitySystem().GetRoundTripTime() * 1000.0f);
 
 		const float sendRate = flowControl.GetSendRate();
 
@@ -246,10 +441,22 @@ int main(int argc, char* argv[])
 			connected = false;
 		}
 
+		// a client that times out reconnects, resuming with its session ticket (0-RTT) when it has one
+
+		if (mode == Client && connected && !connection.IsConnected() && !connection.IsConnecting())
+		{
+			flowControl.Reset();
+			printf("reconnecting to server\n");
+			connection.Connect(address);
+			connected = false;
+		}
+
 		if (!connected && connection.IsConnected())
 		{
 			printf("client connected to server\n");
 			connected = true;
+			if (transfer != NULL)
+				transferSenderConnected(transfer);		// channels start empty on every connection
 		}
 
 		if (!connected && connection.ConnectFailed())
@@ -258,164 +465,246 @@ int main(int argc, char* argv[])
 			break;
 		}
 
-		sendAccumulator += DeltaTime;
+		sendAccumulator += deltaTime;
 		static int count = 1;
 
 
 		while (sendAccumulator > 1.0f / sendRate)
 		{
 
-			unsigned char packet[PacketSize];
-			memset(packet, 0, sizeof(packet));
-
-
-			// If client connection
-			if (mode == Client && client_sending == true && server_sending == false)
+			if (sending && connection.CanSend())
 			{
 
-				if (filename[0] == '\0')
+				if (transfer == NULL)
 				{
-					getFilename(filename, sizeof(filename));
-				}
-
-				// send file to extract metadata and receive metadata from function
-				char* fileMetaData = SendMetadata(filename);
+					if (filename[0] == '\0')
+					{
+						getFilename(filename, sizeof(filename));
+					}
 
-				if (fileMetaData != NULL && metaDataFlag == 0) {
-					memcpy(packet, fileMetaData, strlen(fileMetaData));
-					printf("Debug: Metadata is %s\n", fileMetaData);
-					if (!connection.SendPacket(packet, sizeof(packet))) {
-						perror("Failed to send metadata");
+					// list the file or directory, reader threads load the files ahead of the sender
+					transfer = transferSenderOpen(filename, PacketSize, useCompression);
+					if (transfer == NULL)
+					{
+						printf("failed to get filemetadata.\n");
+						filename[0] = '\0';
+						sendAccumulator -= 1.0f / sendRate;
+						continue;
 					}
-					free(fileMetaData);
 
+					printf("I am %s sending %s in %s mode.\n", mode == Client ? "client" : "server", filename, mode == Client ? "client" : "server");
+					transferSenderConnected(transfer);
 				}
-				else
+
+				// the manifest goes out once per connection on the reliable channel, then the metadata of
+				// each file as it comes off the readers
+				int size;
+				while (connection.GetChannelSystem().GetQueuedMessages(ChannelControl) < 64 &&
+					(size = transferSenderControl(transfer, &messageBuffer[0])) > 0)
 				{
-					printf("failed to get filemetadata.\n");
+					if (!connection.QueueMessage(ChannelControl, &messageBuffer[0], size)) {
+						printf("Failed to send metadata\n");
+					}
 				}
 
-				printf("I am client sending the file %s in client mode.\n", filename);
+				// heartbeat, keeps the receiver's side of the connection up once the chunks are through
+				unsigned char packet[FILE_HEADER_SIZE];
+				connection.QueueMessage(ChannelStatus, packet, transferSenderHeartbeat(transfer, packet), 0, StatusPriority, StatusDeadline);
 
-				// Break data into chunks
-				Chunk* chunks = breakFileIntoChunks(filename, &numChunks, PacketSize);
+				// then a few groups, taking the files in flight in turn and going back around until the
+				// receiver has each of them
+				//  + only topped up when the bulk channel has drained, so chunks never queue up behind the pacer
+				//  + after a resume request only groups with chunks the receiver is missing are visited
+				const int parityCount = useFec ? fecParityCount(lossRate, FEC_MAX_DATA) : 0;
 
-				for (int i = 0; i < numChunks; i++) {
-					if (!connection.SendPacket(chunks[i].data, chunks[i].size)) {
-						printf("Failed to send packet\n");
-						return -1;
+				for (int g = 0; g < GroupsPerSend &&
+					connection.GetChannelSystem().GetQueuedMessages(ChannelBulk) < FEC_MAX_DATA + FEC_MAX_PARITY; g++)
+				{
+					int sizes[FEC_MAX_DATA + FEC_MAX_PARITY];
+					int count = transferSenderBulk(transfer, parityCount, &groupPackets[0], sizes);
+					if (count == 0)
+						break;
+					for (int i = 0; i < count; i++) {
+						connection.QueueMessage(ChannelBulk, &groupPackets[i * FileStride], sizes[i]);
 					}
 				}
 			}
 
+			connection.FlushMessages(PacketsPerSend);
+
 			sendAccumulator -= 1.0f / sendRate;
 
 
 		}
 
+		// receive messages
+
+		int receiveCalls = 0;
+		int sinceStatus = 0;
+
 		while (true)
 		{
-			unsigned char packet[256];
-			int bytes_read = connection.ReceivePacket(packet, sizeof(packet));
+			unsigned char* message = &messageBuffer[0];
+			int channel = 0;
+			int bytes_read = connection.ReceiveMessage(channel, message, (int)messageBuffer.size());
+			receiveCalls++;
 			if (bytes_read == 0)
 				break;
+			if (bytes_read < 0)
+				continue;
 
-
-			// Parse and print the metadata
-			char file_name[128];
-			long file_size;
-
-			int ret;
-			ret = sscanf((char*)packet, "%[^:]:%ld", file_name, &file_size);
-
-			if (file_name[strlen(file_name) - 1] == '\n') {
-				file_name[strlen(file_name) - 1] = '\0';
-			}
-			if (ret != 2) {
-				// Handle the error
-				printf("Failed to parse packet. Expected 2 items, but sscanf returned %d.\n", ret);
-			}
-
-			// Ensure buffer is large enough
-			char filePath[1024];
-			strcpy(filePath, "./output/");
-			strcat(filePath, file_name);
-
-			// Server Connection
-			if (mode == Server && server_receiving == true && client_receiving == false)
+			if (receiving)
 			{
-				// prompt whos connected
-				printf("I am server receiving the file in server mode.\n");
-				printf("Received metadata:\n");
-				printf("File name: %s\n", file_name);
-				printf("File size: %ld\n", file_size);
-
-				// Recieve file
-				FILE* file = fopen(filePath, "wb");
-				if (file == NULL) {
-					printf("Failed to open file\n");
-					return -1;
+				// the sender moves on from a file once it hears it is done
+				int done = transferReceiverHandle(&receiver, message, bytes_read);
+				if (done >= 0)
+				{
+					unsigned char reply[3] = { FILE_PACKET_DONE, (unsigned char)(done >> 8), (unsigned char)done };
+					connection.QueueMessage(ChannelControl, reply, sizeof(reply));
 				}
 
-				unsigned char buffer[PacketSize];
-				int size;
-
-				while ((size = connection.ReceivePacket(buffer, PacketSize)) > 0) {
-					fwrite(buffer, 1, size, file);
+				// acks only reach 33 packets back, answer often enough that none fall out of the window
+				if (++sinceStatus >= 16)
+				{
+					connection.QueueMessage(ChannelStatus, message, transferReceiverStatus(&receiver, message), 0, StatusPriority, StatusDeadline);
+					connection.FlushMessages(1);
+					sinceStatus = 0;
 				}
+			}
+			else if (sending && channel == ChannelControl && transfer != NULL)
+			{
+				transferSenderHandle(transfer, message, bytes_read);
+			}
+		}
 
-				fclose(file);
+		// the receiver asks for the chunks it is missing when a file starts (fresh or from a
+		// checkpoint) and every couple of seconds after, and checkpoints what it has. A file it has
+		// an old copy of starts with the signature instead, the resume waits for the delta
 
-			}
+		resumeAccumulator += deltaTime;
+		checkpointAccumulator += deltaTime;
 
+		if (receiving && connection.CanSend())
+		{
+			const bool periodic = resumeAccumulator >= 2.0f;
+			for (int i = 0; i < FILE_MAX_ACTIVE; i++)
+			{
+				FileReceiver* file = &receiver.files[i];
+				if (file->file == NULL || (!file->resumePending && !file->signaturePending && !periodic))
+					continue;
+				int size = file->signaturePending ? fileReceiverSignature(file, &messageBuffer[0]) : fileReceiverResume(file, &messageBuffer[0]);
+				if (size > 0)
+					connection.QueueMessage(ChannelControl, &messageBuffer[0], size);
+			}
+			connection.FlushMessages(PacketsPerSend);
+			if (periodic)
+				resumeAccumulator = 0.0f;
 		}
 
+		if (checkpointAccumulator >= 0.5f)
+		{
+			transferReceiverCheckpoint(&receiver);
+			checkpointAccumulator = 0.0f;
+		}
 
-		// show packets that were acked this frame
+		// the receiver answers every tick so the sender gets acks and the completion flag
 
-#ifdef SHOW_ACKS
-		unsigned int* acks = NULL;
-		int ack_count = 0;
-		connection.GetReliabilitySystem().GetAcks(&acks, ack_count);
-		if (ack_count > 0)
+		if (receiving && connection.CanSend())
 		{
-			printf("acks: %d", acks[0]);
-			for (int i = 1; i < ack_count; ++i)
-				printf(",%d", acks[i]);
-			printf("\n");
+			unsigned char status[FILE_HEADER_SIZE];
+			connection.QueueMessage(ChannelStatus, status, transferReceiverStatus(&receiver, status), 0, StatusPriority, StatusDeadline);
+			connection.FlushMessages(1);
 		}
-#endif
+
+		GetProcessMetrics().syscalls_per_batch.Record(receiveCalls);
 
 		// update connection
 
-		connection.Update(DeltaTime);
+		connection.Update(deltaTime);
 
 		// show connection stats
 
-		statsAccumulator += DeltaTime;
+		statsAccumulator += deltaTime;
 
 		while (statsAccumulator >= 0.25f && connection.IsConnected())
 		{
 			float rtt = connection.GetReliabilitySystem().GetRoundTripTime();
 
-			unsigned int sent_packets = connection.GetReliabilitySystem().GetSentPackets();
-			unsigned int acked_packets = connection.GetReliabilitySystem().GetAckedPackets();
-			unsigned int lost_packets = connection.GetReliabilitySystem().GetLostPackets();
+			unsigned long long sent_packets = connection.GetReliabilitySystem().GetSentPackets();
+			unsigned long long acked_packets = connection.GetReliabilitySystem().GetAckedPackets();
+			unsigned long long lost_packets = connection.GetReliabilitySystem().GetLostPackets();
+			unsigned long long local_drops = connection.GetReliabilitySystem().GetLocalDrops();
 
 			float sent_bandwidth = connection.GetReliabilitySystem().GetSentBandwidth();
 			float acked_bandwidth = connection.GetReliabilitySystem().GetAckedBandwidth();
+			float bottleneck = connection.GetReliabilitySystem().GetBottleneckBandwidth();
+			float min_rtt = connection.GetReliabilitySystem().GetMinRoundTripTime();
+
+			// smoothed loss over the last interval, sizes the fec parity
+
+			if (sent_packets < lastSent || lost_packets < lastLost)
+			{
+				lastSent = 0;
+				lastLost = 0;
+			}
+			if (sent_packets > lastSent)
+			{
+				float sample = (float)(lost_packets - lastLost) / (float)(sent_packets - lastSent);
+				lossRate += (sample - lossRate) * 0.25f;
+			}
+			lastSent = sent_packets;
+			lastLost = lost_packets;
 
-			printf("rtt %.1fms, sent %d, acked %d, lost %d (%.1f%%), sent bandwidth = %.1fkbps, acked bandwidth = %.1fkbps\n",
-				rtt * 1000.0f, sent_packets, acked_packets, lost_packets,
-				sent_packets > 0.0f ? (float)lost_packets / (float)sent_packets * 100.0f : 0.0f,
-				sent_bandwidth, acked_bandwidth);
+			printf("rtt %.1fms (min %.1fms), sent %llu, acked %llu, lost %llu (%.1f%%), dropped locally %llu, sent bandwidth = %.1fkbps, acked bandwidth = %.1fkbps, bottleneck = %.1fkbps\n",
+				rtt * 1000.0f, min_rtt * 1000.0f, sent_packets, acked_packets, lost_packets,
+				sent_packets > 0.0f ? (float)lost_packets / (float)sent_packets * 100.0f : 0.0f, local_drops,
+				sent_bandwidth, acked_bandwidth, bottleneck);
 
 			statsAccumulator -= 0.25f;
 		}
 
-		net::wait(DeltaTime);
+		// export metrics
+
+		metricsAccumulator += deltaTime;
+
+		if (metricsAccumulator >= 0.25f)
+		{
+			if (metricsPath != NULL && !WriteMetricsFile(metricsPath, metricsFormat))
+				printf("failed to write metrics to %s\n", metricsPath);
+			metricsAccumulator = 0.0f;
+		}
+
+#ifdef NET_TRACE
+		// dump the trace rings once a second (acks, sends, losses etc. are recorded as they happen)
+
+		traceAccumulator += deltaTime;
+
+		if (tracePath != NULL && traceAccumulator >= 1.0f)
+		{
+			if (!TraceDump(tracePath))
+				printf("failed to write trace to %s\n", tracePath);
+			traceAccumulator = 0.0f;
+		}
+#endif
+
+#if PLATFORM != PLATFORM_WINDOWS
+		metricsSocket.Update();
+#endif
+
+		// sleep out the rest of the frame
+		const float spent = (float)(GetTime() - frameStart) / 1000000.0f;
+		if (spent < DeltaTime)
+			net::wait(DeltaTime - spent);
 	}
 
+#ifdef NET_TRACE
+	if (tracePath != NULL)
+		TraceDump(tracePath);
+#endif
+
+	transferSenderClose(transfer);
+	transferReceiverClose(&receiver);
+
 	ShutdownSockets();
 
 	return 0;